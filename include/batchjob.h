@@ -0,0 +1,53 @@
+#ifndef BATCHJOB_H
+#define BATCHJOB_H
+
+#include <QDir>
+#include <QJsonObject>
+#include <QSize>
+#include <QString>
+#include <QVector>
+#include "gcodegenerator.h"
+#include "spirogenerator.h"
+
+// One pattern to generate headlessly and the files to write for it. Jobs are
+// read from JSON job files, either a single job object, an array of them, or
+// {"defaults": {...}, "jobs": [...]}, with these keys:
+//
+//   name, outerRadius, innerRadius, penOffset, rotations, numPens,
+//   rotationOffset, lineThickness, adaptive, chordTolerance, stepSize,
+//   svg, png, gcode, width, height, svgTolerance,
+//   machine: a profile file name, or an object with config.json keys
+//
+// Output and profile paths are relative to the job file. Keys that are left
+// out keep the value of the defaults the job was read against.
+struct BatchJob
+{
+    QString name;
+    SpiroParameters parameters;
+    SpiroSampling sampling;
+    double lineThickness;
+    QString svgFile;
+    QString pngFile;
+    QString gcodeFile;
+    // Image size for SVG and PNG
+    QSize size;
+    // Simplification of SVG paths in pixels, 0 for none
+    double svgTolerance;
+    GcodeGenerator::Config machine;
+
+    BatchJob();
+
+    bool hasOutput() const { return !svgFile.isEmpty() || !pngFile.isEmpty() || !gcodeFile.isEmpty(); }
+
+    // Overrides the fields present in json; false with error set if a value
+    // is unusable
+    bool apply(const QJsonObject &json, const QDir &baseDir, QString *error);
+
+    // Generates the pattern and writes every requested file
+    bool run(QString *error) const;
+
+    // Appends the jobs in the file at path, each starting from defaults
+    static bool loadFile(const QString &path, const BatchJob &defaults, QVector<BatchJob> &jobs, QString *error);
+};
+
+#endif // BATCHJOB_H
@@ -5,7 +5,16 @@
 #include <QPainterPath>
 #include <QColor>
 #include <QTimer>
+#include <QThreadPool>
+#include <QPixmap>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
 #include "gcodegenerator.h" // Add this line to include the full definition of GcodeGenerator
+#include "patternexporter.h"
+#include "spirogenerator.h"
+#include "spiroindex.h"
 
 class DrawingArea : public QWidget
 {
@@ -17,23 +26,80 @@ public:
 
     void setParameters(int outerRadius, int innerRadius, int penOffset, int rotations,
                        double lineThickness, int numPens, double rotationOffset);
+    void setSampling(const SpiroSampling &sampling);
     void generateSpirograph();
     void generateSpirographStep(int step);
+
+    // Regenerates on a worker thread. A request made while a job is running
+    // cancels that job, and all such requests coalesce into one follow-up job
+    // with the latest parameters. The last completed pattern stays on screen.
+    void requestRegeneration();
+    bool isRegenerating() const { return regenerationRunning; }
+
+    // Incremental drawing animation: keeps the already generated prefix and
+    // only appends the new parameter range, spending at most budgetMs per call
+    void beginIncrementalAnimation();
+    bool advanceIncrementalAnimation(double targetRotations, int budgetMs);
+    void endIncrementalAnimation();
+
     bool exportToSVG(const QString &filename) const;
     bool exportToPNG(const QString &filename, int width = 0, int height = 0) const;
     bool exportToGcode(const QString &filename, const GcodeGenerator::Config& config) const;
 
+    using GcodeExportStats = PatternExporter::GcodeStats;
+
+    // Captures the pattern as it is now and returns a job that writes the
+    // G-code for it, so the export can run on any thread while the widget
+    // keeps changing. progress and cancelCheck go to the generators; stats,
+    // if given, must outlive the job.
+    std::function<bool()> prepareGcodeExport(const QString &filename, const GcodeGenerator::Config& config,
+                                             std::function<void(double)> progress = std::function<void(double)>(),
+                                             std::function<bool()> cancelCheck = std::function<bool()>(),
+                                             GcodeExportStats *stats = nullptr) const;
+
     double calculateTotalPathLength() const;
 
+    // Plotter the plot time is estimated for. Each pattern is estimated on
+    // the regeneration thread along with the rest of its analysis; a new
+    // config has the pattern on screen estimated again in the background.
+    void setMachineConfig(const GcodeGenerator::Config &config);
+    // Seconds to plot the pattern on screen as it would be exported, or a
+    // negative time while that is still being worked out, which includes
+    // the whole incremental animation
+    double plotTime() const { return patternPlotTime; }
+
     // New methods for gear visualization
     void startAnimation();
     void stopAnimation();
 
+    // Timings and counters of the hot paths drawn over the pattern
+    void setPerformanceOverlayVisible(bool visible);
+    bool isPerformanceOverlayVisible() const { return performanceOverlayVisible; }
+    // Draws those figures in the top left corner of any paint device
+    static void drawPerformanceOverlay(QPainter &painter);
+
+    // Readout of the curve under the mouse: pen, how many lines pass there
+    // and how crowded with crossings the area is
+    void setHoverReadoutEnabled(bool enabled);
+    bool isHoverReadoutEnabled() const { return hoverReadoutEnabled; }
+
+    // The pattern as it is on screen, for other views of it. The id changes
+    // when the pattern is replaced, but not when the incremental animation
+    // appends to it.
+    const std::vector<SpiroPathBuffer> &patternPathBuffers() const { return patternPaths; }
+    quint64 patternId() const { return currentPatternId; }
+    const QVector<QColor> &patternPenColors() const { return penColors; }
+    double patternLineThickness() const { return lineThickness; }
+
 signals:
     void spirographUpdated();
+    void plotTimeEstimated();
 
 protected:
     void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override;
+    void leaveEvent(QEvent *event) override;
 
 private slots:
     void updateAnimation();
@@ -46,19 +112,112 @@ private:
     double lineThickness;
     int numPens;
     double rotationOffset;
-    QVector<QPainterPath> spirographPaths;
+    SpiroSampling sampling;
+
+    // Geometry plus its display levels of detail, built off the GUI thread
+    struct GeneratedPattern
+    {
+        std::vector<SpiroPathBuffer> paths;
+        SpiroParameters parameters;
+        SpiroSampling sampling;
+        int rotations;
+        double pathLength;
+        SpiroBounds bounds;
+        QVector<QVector<QPainterPath>> lodPaths;  // [pen][level]
+        QVector<double> lodTolerances;
+        SpiroSegmentIndex segmentIndex;
+        SpiroIntersectionMap crossings;
+        double plotTime;
+    };
+
+    quint64 currentPatternId;
+    int patternRotations;
+    double patternLength;
+    SpiroBounds patternBounds;
+    std::vector<SpiroPathBuffer> patternPaths;
+    // Settings patternPaths were generated with; the controls may already
+    // hold newer ones while a regeneration runs
+    SpiroParameters patternParameters;
+    SpiroSampling patternSampling;
+
+    // Display-only decimated copies of each pen, selected by zoom when
+    // painting; exports always use the full-resolution paths
+    QVector<QVector<QPainterPath>> lodPaths;
+    QVector<double> lodTolerances;
+
+    // Segments of patternPaths for hit-testing, and where they cross; empty
+    // while the incremental animation is adding to the paths
+    SpiroSegmentIndex segmentIndex;
+    SpiroIntersectionMap crossingMap;
+
+    GcodeGenerator::Config machineConfig;
+    double patternPlotTime;
+
+    QThreadPool regenerationPool;
+    std::atomic<quint64> regenerationGeneration;
+    // Bumped whenever the estimate of the pattern on screen is superseded
+    std::atomic<quint64> plotTimeGeneration;
+    bool regenerationRunning;
+    bool regenerationPending;
+    std::unique_ptr<SpiroIncrementalGenerator> incrementalGenerator;
     QVector<QColor> penColors;
 
     QRectF boundingBox;
     double zoomFactor;
 
+    // The stroked pattern is rasterized once and reused across repaints, so
+    // gear animation frames only pay for the overlay. Appends made by the
+    // incremental animation are stroked onto the existing pixmap when the
+    // view transform has not changed.
+    struct PatternCacheKey
+    {
+        quint64 serial;
+        QSize size;
+        qreal devicePixelRatio;
+        double zoomFactor;
+        QPointF center;
+        double lineThickness;
+
+        bool sameView(const PatternCacheKey &other) const;
+    };
+
+    QPixmap patternCache;
+    PatternCacheKey patternCacheKey;
+    quint64 patternSerial;
+    bool patternAppendOnly;
+    std::vector<std::size_t> cachedVertexCounts;
+
+    bool performanceOverlayVisible;
+    QTimer *performanceOverlayTimer;
+
+    bool hoverReadoutEnabled;
+    bool hoverActive;
+    QPointF hoverPosition;  // widget coordinates
+    SpiroNearestPoint hoverPoint;
+    int hoverPasses;
+
     // New members for gear visualization
     QTimer *animationTimer;
     double currentAngle;
     bool isAnimating;
 
+    SpiroParameters spiroParameters() const;
+    // The pattern on screen, detached from the widget for exporting
+    PatternExporter exporter() const;
+    static std::shared_ptr<GeneratedPattern> buildPattern(const SpiroGenerator &generator, int rotations,
+                                                          const GcodeGenerator::Config &machine);
+    void setPattern(std::shared_ptr<GeneratedPattern> pattern);
+    void startRegeneration();
+    void startPlotTimeEstimate();
+    void finishRegeneration(quint64 generation, std::shared_ptr<GeneratedPattern> pattern);
     void generatePenColors();
     void calculateBoundingBoxAndZoom();
+    void applyPatternTransform(QPainter &painter) const;
+    void updatePatternCache();
+    void invalidatePattern(bool appendOnly);
+    QPainterPath displayPath(int pen) const;
+    void updateHover();
+    void drawHoverReadout(QPainter &painter);
     
     // New methods for gear visualization
     void drawGears(QPainter &painter);
@@ -6,6 +6,8 @@
 
 class QLineEdit;
 class QDoubleSpinBox;
+class QSpinBox;
+class QCheckBox;
 class QComboBox;
 class QPlainTextEdit;
 
@@ -16,6 +18,7 @@ class GcodeExportDialog : public QDialog
 public:
     explicit GcodeExportDialog(QWidget *parent = nullptr);
     GcodeGenerator::Config getConfig() const;
+    void setConfig(const GcodeGenerator::Config& config);
 
 private:
     void loadConfigurationFromFile();
@@ -29,6 +32,15 @@ private:
     QDoubleSpinBox *travelSpeedSpinBox;
     QDoubleSpinBox *drawingSpeedSpinBox;
     QComboBox *originComboBox;
+    QDoubleSpinBox *mergeToleranceSpinBox;
+    QDoubleSpinBox *arcToleranceSpinBox;
+    QCheckBox *optimizeTravelCheckBox;
+    QCheckBox *modalCompressionCheckBox;
+    QSpinBox *xPrecisionSpinBox;
+    QSpinBox *yPrecisionSpinBox;
+    QSpinBox *zPrecisionSpinBox;
+    QCheckBox *planFeedsCheckBox;
+    QDoubleSpinBox *junctionDeviationSpinBox;
     QPlainTextEdit *startGcodeEdit;
     QPlainTextEdit *endGcodeEdit;
 };
@@ -5,6 +5,11 @@
 #include <QVector>
 #include <QPainterPath>
 #include <QRectF>
+#include <functional>
+#include <vector>
+#include "spiroarcfit.h"
+#include "spirofilewriter.h"
+#include "spiropath.h"
 
 class GcodeGenerator
 {
@@ -29,18 +34,111 @@ public:
         Origin origin;
         QString startGcode;
         QString endGcode;
+        // Output simplification in mm, 0 disables: runs of nearly collinear
+        // moves are merged into one G1, runs that follow a circle become G2/G3
+        double mergeTolerance = 0.0;
+        double arcTolerance = 0.0;
+        // Reorder and reverse strokes to shorten pen-up travel before export
+        bool optimizeTravel = true;
+        // Leave out words that repeat the controller's modal state (motion
+        // mode, feed rate, unchanged axes) and trailing zeros
+        bool modalCompression = true;
+        // Decimals written per axis; I and J follow X and Y. With arcs
+        // enabled, X and Y get at least 3 so controllers accept the arcs
+        int xPrecision = 3;
+        int yPrecision = 3;
+        int zPrecision = 3;
+        // Plan each stroke with maxAcceleration and give every move the feed
+        // it can actually reach instead of drawingSpeed throughout
+        bool planFeeds = true;
+        // Corner rounding allowed at speed, in mm; see SpiroMotionLimits
+        double junctionDeviation = 0.01;
     };
 
     GcodeGenerator();
+
+    // Writes one file per pen, all pens at once on the shared task pool.
+    // Returns false if a file could not be written or the export was
+    // cancelled; partially written files are removed in either case.
+    bool generateGcode(const std::vector<SpiroPathBuffer>& paths, const Config& config, const QString& filename);
+    // Flattens painter paths into path buffers first; curve elements are ignored
     bool generateGcode(const QVector<QPainterPath>& paths, const Config& config, const QString& filename);
 
+    // Seconds to plot the files generateGcode would write for paths, one pen
+    // after another: the same fitted moves and travel, planned with the speed
+    // and acceleration limits of config, plus the pen lifts. Returns a
+    // negative time if cancelled.
+    double estimatePlotTime(const std::vector<SpiroPathBuffer>& paths, const Config& config) const;
+
+    // Both are invoked from the worker threads writing the pen files. The
+    // progress callback receives the fraction of vertices written so far and
+    // is never entered by two threads at once.
+    void setProgressCallback(std::function<void(double)> callback);
+    void setCancelCheck(std::function<bool()> check);
+    bool isCancelled() const;
+
 private:
-    QString convertPathToGcode(const QPainterPath& path, const Config& config, const QRectF& boundingBox, double scale, double offsetX, double offsetY);
-    QString moveToPoint(const QPointF& point, bool penDown, const Config& config);
-    QString setPenPosition(bool down, const Config& config);
-    QPointF applyOriginTransform(const QPointF& point, const Config& config, const QRectF& boundingBox, double scale);
+    struct ExportProgress;
+
+    // What the controller has been told so far in one pen file; every pen is
+    // written by its own task. Coordinates are kept in output steps, so a
+    // word is repeated only if its written value would change.
+    struct PenState
+    {
+        bool penDown;
+        int motion;      // G word in effect, -1 until the first move
+        long long feed;  // F in effect, -1 until known
+        long long x;
+        long long y;
+        long long z;
+        bool knownX;
+        bool knownY;
+        bool knownZ;
+    };
+
+    // One G1/G2/G3 line before modal compression
+    struct Motion
+    {
+        int g;
+        bool hasXY;
+        double x;
+        double y;
+        bool hasIJ;
+        double i;
+        double j;
+        bool hasZ;
+        double z;
+        double feed;
+    };
+
+    // Where the pattern goes on the drawing area, shared by all pens
+    struct Placement
+    {
+        QRectF boundingBox;
+        double scale = 1.0;
+        double offsetX = 0.0;
+        double offsetY = 0.0;
+    };
+
+    static Placement placementOf(const std::vector<SpiroPathBuffer>& paths, const Config& config);
+    // Fits and, if plan is set, plans the moves of one pen in machine
+    // coordinates, handing them on in order: travel(point, feed, seconds)
+    // for the pen-up move to each stroke, draw(move, feed, seconds) for the
+    // moves along it. Seconds are 0 unless planned. Both writing and the
+    // plot time estimate go through here, so they see the same moves.
+    template <typename TravelFunction, typename DrawFunction>
+    bool planPath(const SpiroPathBuffer& path, const Config& config, bool plan, const Placement& placement, ExportProgress& progress,
+                  TravelFunction travel, DrawFunction draw) const;
+    bool writePenFile(const QString& penFilename, const SpiroPathBuffer& path, const Config& config, const Placement& placement, ExportProgress& progress) const;
+    void writeMove(SpiroFileWriter& out, PenState& state, const QPointF& point, bool penDown, double feed, const Config& config) const;
+    void writeArc(SpiroFileWriter& out, PenState& state, const SpiroMove& move, double feed, const Config& config) const;
+    void writePenPosition(SpiroFileWriter& out, PenState& state, bool down, const Config& config) const;
+    void writeMotion(SpiroFileWriter& out, PenState& state, const Motion& motion, const Config& config) const;
+    bool reportProgress(ExportProgress& progress, std::size_t vertices) const;
+    QPointF applyOriginTransform(const QPointF& point, const Config& config, const QRectF& boundingBox, double scale) const;
 
-    bool m_currentPenState;  // true if pen is down, false if pen is up
+    std::function<void(double)> m_progressCallback;
+    std::function<bool()> m_cancelCheck;
 };
 
 #endif // GCODEGENERATOR_H
\ No newline at end of file
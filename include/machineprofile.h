@@ -0,0 +1,30 @@
+#ifndef MACHINEPROFILE_H
+#define MACHINEPROFILE_H
+
+#include <QJsonObject>
+#include <QString>
+#include "gcodegenerator.h"
+
+// The plotter settings kept in config.json. The Gcode export dialog starts
+// from them, and the main window uses them for the plot time estimate.
+class MachineProfile
+{
+public:
+    // First config.json found next to the application or in its data
+    // directory, or an empty string if there is none
+    static QString locate();
+
+    // Built-in settings, for everything the file leaves out
+    static GcodeGenerator::Config defaults();
+
+    // Overrides the settings present in json ("defaultMaxSpeed" and so on)
+    static void apply(const QJsonObject& json, GcodeGenerator::Config& config);
+
+    // Applies the file at path to config; false if it cannot be read
+    static bool load(const QString& path, GcodeGenerator::Config& config);
+
+    // The defaults with the located file, if any, applied on top
+    static GcodeGenerator::Config load();
+};
+
+#endif // MACHINEPROFILE_H
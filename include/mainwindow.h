@@ -6,10 +6,13 @@
 #include <QSpinBox>
 #include <QLabel>
 #include <QDoubleSpinBox>
+#include <QCheckBox>
 #include <QPushButton>
 #include <QTimer>
+#include "gcodegenerator.h"
 
 class DrawingArea;
+class PatternGLView;
 
 class MainWindow : public QMainWindow
 {
@@ -25,6 +28,7 @@ private slots:
     void exportToPNG();
     void exportToGcode();
     void updateAnalysis();
+    void updatePreview();
     void updateValueLabels();
     void updateAnimation();
     void on_closeLoopButton_clicked();
@@ -36,6 +40,8 @@ private:
     int calculateRotationsToCloseLoop(int outerRadius, int innerRadius);
 
     DrawingArea *drawingArea;
+    // Null unless built with the OpenGL preview
+    PatternGLView *patternGLView;
     QSlider *outerRadiusSlider;
     QSlider *innerRadiusSlider;
     QSlider *penOffsetSlider;
@@ -43,8 +49,12 @@ private:
     QDoubleSpinBox *lineThicknessSpinBox;
     QSpinBox *numPensSpinBox;
     QDoubleSpinBox *rotationOffsetSpinBox;
+    QCheckBox *adaptiveSamplingCheckBox;
+    QDoubleSpinBox *chordToleranceSpinBox;
+    QSpinBox *animationBudgetSpinBox;
     QLabel *statusLabel;
     QLabel *pathLengthLabel;
+    QLabel *plotTimeLabel;
     QLabel *outerRadiusValueLabel;
     QLabel *innerRadiusValueLabel;
     QLabel *penOffsetValueLabel;
@@ -54,6 +64,12 @@ private:
     QTimer *animationTimer;
     int currentStep;
     int totalRotations;
+    // Plotter the time estimate is for: config.json at startup, then
+    // whatever the last Gcode export used
+    GcodeGenerator::Config machineProfile;
+    // Whether generated patterns are saved on exit and loaded on the next
+    // start; off unless chosen in the Options menu
+    bool keepPatternCache;
 };
 
 #endif // MAINWINDOW_H
\ No newline at end of file
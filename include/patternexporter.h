@@ -0,0 +1,91 @@
+#ifndef PATTERNEXPORTER_H
+#define PATTERNEXPORTER_H
+
+#include <QColor>
+#include <QPainterPath>
+#include <QSize>
+#include <QString>
+#include <QVector>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "gcodegenerator.h"
+#include "spirogenerator.h"
+
+class QPainter;
+
+// Writes a generated pattern to SVG, PNG or G-code. It only needs QtGui, so
+// the same code serves the drawing area and the headless command line tool.
+// Copies share the path data, and an exporter never changes after it is
+// made, so it can be handed to any thread.
+class PatternExporter
+{
+public:
+    // Pen-up travel in mm, summed over all pens, before and after the stroke
+    // order was optimized
+    struct GcodeStats
+    {
+        double travelBefore = 0.0;
+        double travelAfter = 0.0;
+    };
+
+    // paths must have been generated from parameters and sampling with the
+    // given number of rotations; they are resampled for G-code if needed
+    PatternExporter(const SpiroParameters &parameters, const SpiroSampling &sampling, int rotations,
+                    std::vector<SpiroPathBuffer> paths, double lineThickness);
+
+    // Generates the pattern in the calling thread (and the task pool)
+    static PatternExporter generate(const SpiroParameters &parameters, const SpiroSampling &sampling,
+                                    int rotations, double lineThickness);
+
+    // One evenly spaced hue per pen
+    static QVector<QColor> penColors(int numPens);
+
+    // Painting adapter for the path buffer. With from > 0 only the vertices
+    // from that index on are converted, starting one vertex early so the
+    // joint with the part that was already drawn gets stroked too.
+    static QPainterPath toPainterPath(const SpiroPathBuffer &buffer, std::size_t from = 0);
+
+    const SpiroParameters &parameters() const { return m_parameters; }
+    const std::vector<SpiroPathBuffer> &paths() const { return *m_paths; }
+
+    // The pattern is centred and scaled so the outer ring fills the smaller
+    // side of size. SVG paths are simplified to within simplifyTolerance
+    // pixels if it is above zero.
+    bool exportToSVG(const QString &filename, const QSize &size, double simplifyTolerance = 0.0) const;
+    bool exportToPNG(const QString &filename, const QSize &size) const;
+
+    // Returns a job that writes the G-code, so the export can run on any
+    // thread. progress and cancelCheck go to the generators; stats, if
+    // given, must outlive the job.
+    std::function<bool()> prepareGcodeExport(const QString &filename, const GcodeGenerator::Config &config,
+                                             std::function<void(double)> progress = std::function<void(double)>(),
+                                             std::function<bool()> cancelCheck = std::function<bool()>(),
+                                             GcodeStats *stats = nullptr) const;
+    bool exportToGcode(const QString &filename, const GcodeGenerator::Config &config, GcodeStats *stats = nullptr) const;
+
+    // Seconds to plot the G-code exportToGcode would write with config,
+    // worked out from the same resampled, reordered, fitted and planned
+    // moves; negative if cancelled. Runs in the calling thread and the task
+    // pool.
+    double estimatePlotTime(const GcodeGenerator::Config &config,
+                            std::function<bool()> cancelCheck = std::function<bool()>()) const;
+
+private:
+    void paint(QPainter &painter, const QSize &size) const;
+    // The paths as the G-code generator gets them: resampled at the output
+    // scale if the sampling is adaptive, and reordered for less pen-up
+    // travel if config asks for it. Null if cancelled.
+    std::shared_ptr<const std::vector<SpiroPathBuffer>> gcodePaths(const GcodeGenerator::Config &config,
+                                                                   const std::function<bool()> &cancelCheck,
+                                                                   GcodeStats *stats) const;
+
+    SpiroParameters m_parameters;
+    SpiroSampling m_sampling;
+    int m_rotations;
+    std::shared_ptr<const std::vector<SpiroPathBuffer>> m_paths;
+    SpiroBounds m_bounds;
+    double m_lineThickness;
+};
+
+#endif // PATTERNEXPORTER_H
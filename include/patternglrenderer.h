@@ -0,0 +1,87 @@
+#ifndef PATTERNGLRENDERER_H
+#define PATTERNGLRENDERER_H
+
+#include <QColor>
+#include <QOpenGLBuffer>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLVertexArrayObject>
+#include <QRectF>
+#include <QSize>
+#include <QString>
+#include <QVector>
+#include <vector>
+#include "spiropath.h"
+
+// Draws a pattern with the GPU, for patterns too dense for QPainter's
+// antialiased strokes. The points of every pen live in one vertex buffer;
+// each segment is one instance of a quad that the vertex shader widens to
+// the line thickness, and the fragment shader feathers its edges. Needs
+// OpenGL 3.3, which Mesa's llvmpipe provides on machines without a GPU.
+//
+// Not tied to a widget, so the preview and the benchmarks share it. Every
+// call that touches GL needs the context current.
+class PatternGLRenderer : protected QOpenGLExtraFunctions
+{
+public:
+    PatternGLRenderer();
+
+    // Copies the pattern; it goes to the GPU with the next render(). If
+    // patternId is the one given last time, the paths are taken to have only
+    // grown since, as they do in the incremental animation, and just the
+    // new vertices are copied and later written behind the uploaded ones.
+    void setPattern(const std::vector<SpiroPathBuffer> &paths, const QVector<QColor> &colors,
+                    double lineThickness, quint64 patternId);
+
+    // Builds the shaders and buffers in the current context; false, with the
+    // reason in error(), if the context cannot run them
+    bool initialize();
+    // Frees everything initialize() made; the pattern itself is kept and
+    // uploaded again after the next initialize()
+    void release();
+    bool isReady() const { return m_ready; }
+    const QString &error() const { return m_error; }
+
+    // Clears the bound framebuffer of the given size in device pixels and
+    // draws the pattern framed as DrawingArea frames it
+    void render(const QSize &pixels, qreal devicePixelRatio, const QColor &background);
+
+private:
+    // A run of consecutive vertices in the vertex buffer drawn as one line
+    struct Stroke
+    {
+        int pen;
+        int first;
+        int count;
+    };
+
+    bool buildProgram();
+    void appendVertices(int pen, const SpiroPathBuffer &path, std::size_t from);
+    void upload();
+
+    QOpenGLShaderProgram *m_program;
+    QOpenGLVertexArrayObject m_vertexArray;
+    QOpenGLBuffer m_cornerBuffer;
+    QOpenGLBuffer m_pointBuffer;
+    bool m_ready;
+    QString m_error;
+
+    // Interleaved x, y of every pen in the order they arrived, kept for when
+    // the context is recreated
+    std::vector<float> m_points;
+    std::vector<Stroke> m_strokes;
+    QVector<QColor> m_penColors;
+    double m_lineThickness;
+    SpiroBounds m_bounds;
+    QRectF m_boundingBox;
+    quint64 m_patternId;
+    // Vertices of each pen already copied into m_points
+    std::vector<std::size_t> m_takenVertices;
+
+    // Floats of m_points on the GPU, and room in the buffer for how many;
+    // a full upload is due whenever m_uploadedFloats is reset to 0
+    std::size_t m_uploadedFloats;
+    std::size_t m_bufferFloats;
+};
+
+#endif // PATTERNGLRENDERER_H
@@ -0,0 +1,43 @@
+#ifndef PATTERNGLVIEW_H
+#define PATTERNGLVIEW_H
+
+#include <QColor>
+#include <QOpenGLWidget>
+#include <QTimer>
+#include <QVector>
+#include <vector>
+#include "patternglrenderer.h"
+#include "spiropath.h"
+
+// Preview of the pattern drawn by PatternGLRenderer, for patterns too dense
+// for DrawingArea's antialiased QPainter strokes
+class PatternGLView : public QOpenGLWidget
+{
+    Q_OBJECT
+
+public:
+    explicit PatternGLView(QWidget *parent = nullptr);
+    ~PatternGLView();
+
+    // Copies the pattern; it goes to the GPU with the next frame and is
+    // drawn from there until the next call. Passing the patternId of the
+    // last call only copies and uploads what was appended since.
+    void setPattern(const std::vector<SpiroPathBuffer> &paths, const QVector<QColor> &colors, double lineThickness,
+                    quint64 patternId);
+
+    void setPerformanceOverlayVisible(bool visible);
+
+protected:
+    void initializeGL() override;
+    void paintGL() override;
+
+private:
+    void releaseGL();
+
+    PatternGLRenderer renderer;
+
+    bool performanceOverlayVisible;
+    QTimer *performanceOverlayTimer;
+};
+
+#endif // PATTERNGLVIEW_H
@@ -0,0 +1,46 @@
+#ifndef SPIROARCFIT_H
+#define SPIROARCFIT_H
+
+#include <cstddef>
+#include <vector>
+
+// One motion of a fitted stroke, ending at (x, y). Arcs carry their centre as
+// an offset (i, j) from the start point, which is what G2/G3 expect in the
+// default incremental IJ mode.
+struct SpiroMove
+{
+    enum class Type { Line, ClockwiseArc, CounterClockwiseArc };
+
+    Type type;
+    double x;
+    double y;
+    double i;
+    double j;
+};
+
+struct SpiroFitSettings
+{
+    // Runs of vertices that stay within this distance of a single segment
+    // become one line; 0 keeps every vertex
+    double mergeTolerance = 0.0;
+    // Runs that stay within this distance of a circle become one arc; 0
+    // disables arc fitting
+    double arcTolerance = 0.0;
+    // Flatter arcs are left to the line merging, both because they gain
+    // little and because controllers handle huge radii poorly
+    double maxArcRadius = 1000.0;
+    // The output step, 10^-decimals. An arc whose end lies within a step of
+    // its start on both axes may be written with its end equal to its start,
+    // which controllers read as a full circle, so such runs are not fitted
+    // as arcs; 0 leaves only the sweep limit
+    double outputQuantum = 0.0;
+};
+
+// Replaces the polyline x[0..count) by as few moves as fit within the
+// tolerances. The tool is assumed to be at point 0 already, so the moves
+// cover points 1 onwards and the last move always ends on the last point.
+// Coordinates are in the output units the tolerances are given in.
+void fitPolyline(const double* x, const double* y, std::size_t count, const SpiroFitSettings& settings,
+                 std::vector<SpiroMove>& moves);
+
+#endif // SPIROARCFIT_H
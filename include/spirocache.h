@@ -0,0 +1,96 @@
+#ifndef SPIROCACHE_H
+#define SPIROCACHE_H
+
+#include <cstddef>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "spirogenerator.h"
+#include "spiropath.h"
+
+// Generated paths, one per pen
+using SpiroGeometry = std::vector<SpiroPolyline>;
+
+// Everything that decides what SpiroGenerator::generate produces, reduced so
+// that settings which cannot change the result compare equal: the pen
+// rotation offset is taken modulo one turn, fixed-step sampling ignores the
+// chord tolerance, and adaptive sampling ignores the step size and only
+// sees the tolerance in pattern units.
+struct SpiroGeometryKey
+{
+    int outerRadius;
+    int innerRadius;
+    int penOffset;
+    int rotations;
+    int numPens;
+    double rotationOffset;
+    int mode;
+    double stepSize;
+    double tolerance;
+    bool rotationRecurrence;
+    bool exploitSymmetry;
+
+    SpiroGeometryKey(const SpiroParameters& params, const SpiroSampling& sampling, int rotations);
+
+    bool operator<(const SpiroGeometryKey& other) const;
+};
+
+// Least recently used store of generated geometry, bounded by the memory its
+// point buffers take. Entries are shared and never modified, so a caller
+// keeps what it got even after it is evicted. All members are thread-safe.
+class SpiroGeometryCache
+{
+public:
+    explicit SpiroGeometryCache(std::size_t budgetBytes = 256 * 1024 * 1024);
+
+    SpiroGeometryCache(const SpiroGeometryCache&) = delete;
+    SpiroGeometryCache& operator=(const SpiroGeometryCache&) = delete;
+
+    // Evicts down to the new budget straight away
+    void setBudget(std::size_t budgetBytes);
+    std::size_t budget() const;
+    std::size_t usedBytes() const;
+    std::size_t entryCount() const;
+    void clear();
+
+    // Null if key is not cached; a hit becomes the most recently used entry
+    std::shared_ptr<const SpiroGeometry> find(const SpiroGeometryKey& key);
+    // Geometry larger than the whole budget is not kept
+    void insert(const SpiroGeometryKey& key, std::shared_ptr<const SpiroGeometry> geometry);
+
+    // generator.generate(rotations), from the cache when possible. Results
+    // of a cancelled generator are returned but not stored.
+    std::shared_ptr<const SpiroGeometry> generate(const SpiroGenerator& generator, int rotations);
+
+    // Binary snapshot in the machine's native layout, for later sessions,
+    // tagged with SpiroGenerator::outputVersion. save writes the most
+    // recently used entries that fit in maxBytes of geometry. load adds the
+    // entries of a file written by save behind those already cached, as far
+    // as the budget allows; if the file cannot be read as a whole, or was
+    // written by another generator version, nothing changes.
+    bool save(const std::string& path, std::size_t maxBytes = static_cast<std::size_t>(-1)) const;
+    bool load(const std::string& path);
+
+    static SpiroGeometryCache& instance();
+
+private:
+    struct Entry
+    {
+        SpiroGeometryKey key;
+        std::shared_ptr<const SpiroGeometry> geometry;
+        std::size_t bytes;
+    };
+
+    void evictToBudget();
+
+    mutable std::mutex m_mutex;
+    std::list<Entry> m_entries;  // Most recently used first
+    std::map<SpiroGeometryKey, std::list<Entry>::iterator> m_index;
+    std::size_t m_budget;
+    std::size_t m_used;
+};
+
+#endif // SPIROCACHE_H
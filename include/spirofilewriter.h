@@ -0,0 +1,56 @@
+#ifndef SPIROFILEWRITER_H
+#define SPIROFILEWRITER_H
+
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Buffered text output for the exporters. Everything is formatted straight
+// into one fixed-size buffer that is handed to the OS whenever it fills, so
+// writing a file of any length allocates nothing per line and keeps memory
+// flat. Errors are sticky: check close() (or ok()) once at the end.
+class SpiroFileWriter
+{
+public:
+    explicit SpiroFileWriter(std::size_t bufferSize = 64 * 1024);
+    ~SpiroFileWriter();
+
+    SpiroFileWriter(const SpiroFileWriter&) = delete;
+    SpiroFileWriter& operator=(const SpiroFileWriter&) = delete;
+
+    // path is in the local 8-bit encoding, as passed to fopen
+    bool open(const std::string& path);
+    bool close();
+    bool isOpen() const { return m_file != nullptr; }
+    bool ok() const { return !m_failed; }
+
+    void write(const char* text, std::size_t length);
+    void write(const char* text);
+    void write(const std::string& text) { write(text.data(), text.size()); }
+    void put(char c)
+    {
+        if (m_used == m_buffer.size()) {
+            flush();
+        }
+        m_buffer[m_used++] = c;
+    }
+
+    void writeInt(long long value);
+    // Fixed-point with the given number of decimals (0-9), like printf("%.*f").
+    // Values that round to zero are written without a sign. trimZeros drops
+    // trailing fraction zeros, and the point if nothing is left after it.
+    void writeFixed(double value, int decimals, bool trimZeros = false);
+
+    void flush();
+
+private:
+    char* reserve(std::size_t length);
+
+    std::FILE* m_file;
+    std::vector<char> m_buffer;
+    std::size_t m_used;
+    bool m_failed;
+};
+
+#endif // SPIROFILEWRITER_H
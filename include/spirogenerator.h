@@ -0,0 +1,133 @@
+#ifndef SPIROGENERATOR_H
+#define SPIROGENERATOR_H
+
+#include "spirokernels.h"
+#include "spiropath.h"
+#include <chrono>
+#include <functional>
+#include <vector>
+
+// Pattern parameters as set from the UI, without any rendering state.
+struct SpiroParameters
+{
+    int outerRadius;
+    int innerRadius;
+    int penOffset;
+    int rotations;
+    int numPens;
+    double rotationOffset;  // degrees
+
+    SpiroParameters();
+};
+
+// Controls how densely the parameter range is sampled.
+struct SpiroSampling
+{
+    enum class Mode {
+        FixedStep,  // uniform steps of stepSize radians
+        Adaptive    // step chosen from local curvature to bound the chord error
+    };
+
+    Mode mode;
+    double stepSize;            // radians, used by FixedStep
+    double chordTolerance;      // max distance between curve and chord, in output millimetres
+    double millimetresPerUnit;  // output scale, used to express the tolerance in pattern units
+    bool rotationRecurrence;    // FixedStep: advance angles by complex rotation instead of trig
+    bool exploitSymmetry;       // evaluate one lobe and build the rest by rotating it
+
+    SpiroSampling();
+};
+
+// Evaluates the trochoid equations into plain point buffers. This has no Qt
+// dependency so it can run on headless machines and worker threads. Pens and
+// chunks of each pen's parameter range are generated in parallel on the
+// shared SpiroTaskPool and stitched back together in order.
+class SpiroGenerator
+{
+public:
+    // Revision of the points generate() produces for given settings. Stored
+    // geometry is only reused at the same revision, so bump this with any
+    // change to the samplers or kernels that moves a point.
+    static constexpr int outputVersion = 1;
+
+    explicit SpiroGenerator(const SpiroParameters& params, const SpiroSampling& sampling = SpiroSampling());
+
+    const SpiroParameters& parameters() const { return m_params; }
+    const SpiroSampling& sampling() const { return m_sampling; }
+
+    // Polled before each chunk of work. Once it returns true the remaining
+    // chunks are skipped and the generated paths are incomplete.
+    void setCancelCheck(std::function<bool()> check);
+    bool isCancelled() const;
+
+    TrochoidCoefficients coefficients(int pen) const;
+
+    // Rotations after which the curve returns to its starting point
+    static int rotationsToClose(int outerRadius, int innerRadius);
+    int rotationsToClose() const;
+
+    // The curve is made of congruent lobes: advancing t by lobeAngle() rotates
+    // the pen position by the same angle about the origin. symmetryOrder()
+    // lobes make up one closed period.
+    double lobeAngle() const;
+    int symmetryOrder() const;
+
+    // Pen position at parameter t (radians of travel around the outer ring)
+    void evaluate(int pen, double t, double& x, double& y) const;
+
+    SpiroPolyline generatePen(int pen, int rotations) const;
+    std::vector<SpiroPolyline> generate() const;
+    std::vector<SpiroPolyline> generate(int rotations) const;
+
+    // Building blocks for callers that extend paths piece by piece.
+    // The fixed-step grid has fixedStepsPerRotation() samples per rotation;
+    // sampleFixed evaluates grid samples firstIndex .. firstIndex + count - 1.
+    std::size_t fixedStepsPerRotation() const;
+    void sampleFixed(int pen, std::size_t firstIndex, std::size_t count, double *x, double *y) const;
+
+    // Appends adaptively spaced samples over [tBegin, tEnd]. The point at
+    // tBegin is only emitted into an empty path; otherwise it is already the
+    // path's last point.
+    void sampleAdaptive(int pen, double tBegin, double tEnd, SpiroPolyline& path) const;
+
+private:
+    double penAngleOffset(int pen) const;
+    void evaluateDerivatives(int pen, double t, double& dx, double& dy, double& ddx, double& ddy) const;
+    double curvatureStep(int pen, double t, double tolerance) const;
+
+    std::vector<SpiroPolyline> generatePens(int firstPen, int penCount, int rotations) const;
+    void generateFixed(int firstPen, double tEnd, std::vector<SpiroPolyline>& paths) const;
+    void generateAdaptive(int firstPen, double tEnd, std::vector<SpiroPolyline>& paths) const;
+    void generateSymmetric(int firstPen, double tEnd, std::vector<SpiroPolyline>& paths) const;
+    void sampleSpan(int pen, double span, double gridStep, SpiroPolyline& path) const;
+    double fixedStepSize() const;
+
+    SpiroParameters m_params;
+    SpiroSampling m_sampling;
+    std::function<bool()> m_cancelCheck;
+};
+
+// Extends caller-owned paths a slice at a time while keeping everything that
+// was already generated, so animating a drawing costs the same per frame no
+// matter how far along it is.
+class SpiroIncrementalGenerator
+{
+public:
+    SpiroIncrementalGenerator(const SpiroParameters& params, const SpiroSampling& sampling);
+
+    const SpiroGenerator& generator() const { return m_generator; }
+    double rotationsDone() const;
+
+    // Appends to paths (one per pen) until targetRotations is reached or the
+    // deadline passes, checked between slices. Returns true at the target.
+    bool advanceTo(double targetRotations, std::chrono::steady_clock::time_point deadline,
+                   std::vector<SpiroPathBuffer>& paths);
+
+private:
+    SpiroGenerator m_generator;
+    std::vector<SpiroPolyline> m_scratch;  // Per-pen slice, reused between calls
+    double m_t;               // Adaptive: parameter value reached
+    std::size_t m_nextIndex;  // FixedStep: next grid sample to evaluate
+};
+
+#endif // SPIROGENERATOR_H
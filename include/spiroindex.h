@@ -0,0 +1,92 @@
+#ifndef SPIROINDEX_H
+#define SPIROINDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "spiropath.h"
+
+// One segment of a pattern: pen, and the vertex it starts at in that pen's
+// path buffer; it ends at the next vertex of the same stroke
+struct SpiroSegmentRef
+{
+    std::uint32_t pen;
+    std::uint32_t vertex;
+};
+
+struct SpiroNearestPoint
+{
+    bool found = false;
+    SpiroSegmentRef segment = SpiroSegmentRef();
+    // Position along the segment, 0 at its start and 1 at its end
+    double t = 0.0;
+    double x = 0.0;
+    double y = 0.0;
+    double distance = 0.0;
+};
+
+// Self-intersections counted into a grid of bins over the pattern bounds
+struct SpiroIntersectionMap
+{
+    SpiroBounds bounds;
+    int columns = 0;
+    int rows = 0;
+    std::vector<std::uint32_t> counts;  // row by row
+    std::uint64_t total = 0;
+
+    double binWidth() const { return columns > 0 ? bounds.width() / columns : 0.0; }
+    double binHeight() const { return rows > 0 ? bounds.height() / rows : 0.0; }
+    // Count of the bin containing the point, 0 outside the bounds
+    std::uint32_t countAt(double x, double y) const;
+};
+
+// Uniform grid over the segments of a pattern. Every cell lists the segments
+// whose bounding box overlaps it, stored contiguously cell after cell, so a
+// query only looks at the few segments near it instead of the whole pattern.
+// Cells are sized for about two segments each. Spirograph segments are short
+// and spread evenly over the ring, which suits a flat grid better than a
+// tree.
+//
+// The index only holds references; queries take the paths it was built from,
+// which must not have changed since.
+class SpiroSegmentIndex
+{
+public:
+    SpiroSegmentIndex();
+
+    void build(const std::vector<SpiroPathBuffer>& paths);
+    void clear();
+
+    bool empty() const { return m_refs.empty(); }
+    std::size_t segmentCount() const { return m_segmentCount; }
+    const SpiroBounds& bounds() const { return m_bounds; }
+
+    // Closest point on any segment within maxDistance of (x, y)
+    SpiroNearestPoint nearest(const std::vector<SpiroPathBuffer>& paths, double x, double y,
+                              double maxDistance) const;
+
+    // Appends every segment that touches rect, each once
+    void segmentsInRect(const std::vector<SpiroPathBuffer>& paths, const SpiroBounds& rect,
+                        std::vector<SpiroSegmentRef>& out) const;
+
+    // Counts the points where segments cross, within and between pens, into
+    // a map of columns x rows bins. Neighbouring segments of a stroke do not
+    // count as crossing at their shared vertex. Runs on the task pool.
+    SpiroIntersectionMap intersections(const std::vector<SpiroPathBuffer>& paths, int columns, int rows) const;
+
+private:
+    int cellX(double x) const;
+    int cellY(double y) const;
+
+    SpiroBounds m_bounds;
+    double m_cellSize;
+    double m_inverseCellSize;
+    int m_columns;
+    int m_rows;
+    std::size_t m_segmentCount;
+    // Segments of cell i are m_refs[m_cellStarts[i]] .. m_refs[m_cellStarts[i + 1] - 1]
+    std::vector<std::uint32_t> m_cellStarts;
+    std::vector<SpiroSegmentRef> m_refs;
+};
+
+#endif // SPIROINDEX_H
@@ -0,0 +1,40 @@
+#ifndef SPIROKERNELS_H
+#define SPIROKERNELS_H
+
+#include <cstddef>
+
+// Coefficients of one pen's trochoid:
+//   x = a cos(t) + b cos(k t + phase)
+//   y = a sin(t) - b sin(k t + phase)
+struct TrochoidCoefficients
+{
+    double a;      // outer radius - inner radius
+    double b;      // pen offset
+    double k;      // (outer radius - inner radius) / inner radius
+    double phase;  // pen angle offset, radians
+};
+
+enum class SpiroKernelIsa {
+    Scalar,
+    SSE2,
+    AVX2
+};
+
+// Best instruction set supported by the running CPU
+SpiroKernelIsa detectKernelIsa();
+const char *kernelIsaName(SpiroKernelIsa isa);
+
+// Evaluates count arbitrary parameter values. The default overload dispatches
+// to the best kernel for this CPU; the explicit one is for benchmarking.
+void evaluateTrochoidBatch(const TrochoidCoefficients& c, const double *t, std::size_t count,
+                           double *x, double *y);
+void evaluateTrochoidBatch(const TrochoidCoefficients& c, const double *t, std::size_t count,
+                           double *x, double *y, SpiroKernelIsa isa);
+
+// Evaluates t0, t0 + dt, ... by advancing both angles with a complex rotation
+// instead of calling trig per point. Re-anchored with exact trig periodically
+// so rounding drift stays far below anything visible or plottable.
+void evaluateTrochoidRecurrence(const TrochoidCoefficients& c, double t0, double dt, std::size_t count,
+                                double *x, double *y);
+
+#endif // SPIROKERNELS_H
@@ -0,0 +1,34 @@
+#ifndef SPIROLOD_H
+#define SPIROLOD_H
+
+#include "spiropath.h"
+#include <vector>
+
+// Douglas-Peucker simplification. Keeps both end points and every vertex
+// needed to stay within tolerance (pattern units) of the original polyline.
+SpiroPolyline simplifyPolyline(const SpiroPolyline& path, double tolerance);
+
+// Display-only level-of-detail pyramid for one pen. Level 0 is the finest;
+// each following level has four times the tolerance and is simplified from
+// the previous one, so building the whole pyramid costs little more than
+// the first level.
+class SpiroLodPyramid
+{
+public:
+    void build(const SpiroPolyline& path, double finestTolerance, int levelCount);
+    void clear();
+
+    int levelCount() const { return static_cast<int>(m_levels.size()); }
+    double tolerance(int level) const { return m_tolerances[level]; }
+    const SpiroPolyline& level(int level) const { return m_levels[level]; }
+
+    // Coarsest level whose tolerance does not exceed maxTolerance, or -1 if
+    // even the finest level is too coarse and the full path should be used
+    int select(double maxTolerance) const;
+
+private:
+    std::vector<SpiroPolyline> m_levels;
+    std::vector<double> m_tolerances;
+};
+
+#endif // SPIROLOD_H
@@ -0,0 +1,86 @@
+#ifndef SPIROPATH_H
+#define SPIROPATH_H
+
+#include <cstddef>
+#include <vector>
+
+// Point buffer for a single pen. Coordinates are in pattern units (the same
+// units as the gear radii) with the fixed ring centred on the origin.
+struct SpiroPolyline
+{
+    std::vector<double> x;
+    std::vector<double> y;
+
+    std::size_t size() const { return x.size(); }
+    bool empty() const { return x.empty(); }
+    void clear() { x.clear(); y.clear(); }
+    void reserve(std::size_t count) { x.reserve(count); y.reserve(count); }
+    void append(double px, double py) { x.push_back(px); y.push_back(py); }
+};
+
+// Compact store for the finished strokes of one pen: single-precision x and
+// y arrays plus the index where each stroke starts. Generators sample into
+// SpiroPolyline in double precision; this is what gets kept, painted and
+// exported, read in place through x() and y().
+class SpiroPathBuffer
+{
+public:
+    std::size_t size() const { return m_x.size(); }
+    bool empty() const { return m_x.empty(); }
+    void clear();
+    void reserve(std::size_t count);
+
+    std::size_t strokeCount() const { return m_strokeStarts.size(); }
+    std::size_t strokeBegin(std::size_t stroke) const { return m_strokeStarts[stroke]; }
+    std::size_t strokeEnd(std::size_t stroke) const;
+
+    const float* x() const { return m_x.data(); }
+    const float* y() const { return m_y.data(); }
+
+    void moveTo(double px, double py);
+    void lineTo(double px, double py);
+
+    // Starts a new stroke with the points of source
+    void appendStroke(const SpiroPolyline& source);
+    // Starts a new stroke with a copy of one stroke of source, optionally
+    // back to front
+    void appendStroke(const SpiroPathBuffer& source, std::size_t stroke, bool reversed = false);
+    // Continues the last stroke (or starts the first one) with the points of
+    // source from index first onwards
+    void extend(const SpiroPolyline& source, std::size_t first = 0);
+
+private:
+    std::vector<float> m_x;
+    std::vector<float> m_y;
+    std::vector<std::size_t> m_strokeStarts;
+};
+
+struct SpiroBounds
+{
+    double minX;
+    double minY;
+    double maxX;
+    double maxY;
+
+    SpiroBounds();
+
+    bool isValid() const { return minX <= maxX && minY <= maxY; }
+    double width() const { return isValid() ? maxX - minX : 0.0; }
+    double height() const { return isValid() ? maxY - minY : 0.0; }
+
+    void include(double px, double py);
+    void unite(const SpiroBounds& other);
+};
+
+SpiroBounds boundsOf(const SpiroPolyline& path);
+SpiroBounds boundsOf(const std::vector<SpiroPolyline>& paths);
+SpiroBounds boundsOf(const SpiroPathBuffer& path);
+SpiroBounds boundsOf(const std::vector<SpiroPathBuffer>& paths);
+
+double pathLength(const SpiroPolyline& path);
+double totalPathLength(const std::vector<SpiroPolyline>& paths);
+// Pen-down length only; the gaps between strokes are not counted
+double pathLength(const SpiroPathBuffer& path);
+double totalPathLength(const std::vector<SpiroPathBuffer>& paths);
+
+#endif // SPIROPATH_H
@@ -0,0 +1,59 @@
+#ifndef SPIROPLANNER_H
+#define SPIROPLANNER_H
+
+#include <cstddef>
+#include <vector>
+#include "spiroarcfit.h"
+
+// One motion of a continuous run, as seen by the planner. Lengths are in mm,
+// speeds in mm/s.
+struct SpiroPlanSegment
+{
+    double length;
+    // Unit direction of travel at either end; they differ only for arcs
+    double startDirX;
+    double startDirY;
+    double endDirX;
+    double endDirY;
+    // Cruise limit for this segment alone
+    double maxSpeed;
+
+    // Filled in by planMotion
+    double entrySpeed;
+    double exitSpeed;
+    // Highest speed reached within the segment
+    double peakSpeed;
+    double time;
+};
+
+struct SpiroMotionLimits
+{
+    double maxAcceleration;          // mm/s²
+    // How far the path may stray from a corner taken at speed, in mm; the
+    // same model Grbl uses to bound junction speeds
+    double junctionDeviation = 0.01;
+};
+
+// The segment from (x0, y0) along move. Arcs are further limited to the
+// speed at which their centripetal acceleration stays within limits. A move
+// that goes nowhere gives a segment of length 0, which should be left out.
+SpiroPlanSegment planSegment(double x0, double y0, const SpiroMove& move, double maxSpeed,
+                             const SpiroMotionLimits& limits);
+
+// Plans a run that starts at entrySpeed and ends at rest with look-ahead
+// across all of it: junction speeds are bounded by the corner between
+// neighbouring segments, then lowered by a backward and a forward pass until
+// every segment can accelerate or brake between them, and each segment gets
+// a trapezoidal (or triangular) profile. Returns the total time in seconds.
+//
+// A long run can be planned a window at a time. Ending each window at rest
+// only slows the segments within braking distance of its end, so those are
+// kept for the next window, which starts at the exit speed of the last
+// segment handed on.
+double planMotion(std::vector<SpiroPlanSegment>& segments, const SpiroMotionLimits& limits,
+                  double entrySpeed = 0.0);
+
+// A single straight move from rest to rest
+double moveTime(double length, double maxSpeed, double maxAcceleration);
+
+#endif // SPIROPLANNER_H
@@ -0,0 +1,55 @@
+#ifndef SPIROPNGWRITER_H
+#define SPIROPNGWRITER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct z_stream_s;
+
+// Writes an 8-bit RGB PNG one row at a time, compressing each row as it
+// arrives, so an image never has to be held in memory as a whole. Rows go
+// through the PNG "up" filter: the blank rows that make up most of a line
+// drawing become zeros, which deflate shrinks to almost nothing even when a
+// row is wider than its 32 KB window.
+class SpiroPngWriter
+{
+public:
+    // compressionLevel as for zlib, 0 (none) to 9 (smallest)
+    explicit SpiroPngWriter(int compressionLevel = 6);
+    ~SpiroPngWriter();
+
+    SpiroPngWriter(const SpiroPngWriter&) = delete;
+    SpiroPngWriter& operator=(const SpiroPngWriter&) = delete;
+
+    // path is in the local 8-bit encoding, as passed to fopen
+    bool open(const std::string& path, std::uint32_t width, std::uint32_t height);
+    // width * 3 bytes of red, green, blue; rows run top to bottom
+    bool writeRow(const unsigned char* rgb);
+    // Fails if not all height rows were written or anything went wrong
+    // before; the file is incomplete then and should be removed
+    bool close();
+
+    bool ok() const { return !m_failed; }
+
+private:
+    bool writeChunk(const char* type, const unsigned char* data, std::size_t length);
+    bool deflateInto(int flush);
+    void release();
+
+    int m_level;
+    std::FILE* m_file;
+    std::unique_ptr<z_stream_s> m_stream;
+    std::uint32_t m_width;
+    std::uint32_t m_height;
+    std::uint32_t m_rowsWritten;
+    std::vector<unsigned char> m_previousRow;
+    std::vector<unsigned char> m_filteredRow;  // filter type byte, then the row
+    std::vector<unsigned char> m_output;
+    bool m_failed;
+};
+
+#endif // SPIROPNGWRITER_H
@@ -0,0 +1,144 @@
+#ifndef SPIROPROFILER_H
+#define SPIROPROFILER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Running totals of the work done by the hot paths, for the performance
+// overlay and traces. Counters are plain relaxed atomics, cheap enough to
+// update from any worker thread.
+enum class SpiroCounter {
+    VerticesGenerated,
+    CacheHits,
+    CacheMisses,
+    ExportBytes,
+    Count
+};
+
+// Timing statistics of one instrumented scope. Sites are created once per
+// SPIRO_PROFILE_SCOPE and live for the rest of the program; updates are
+// lock-free.
+class SpiroProfileSite
+{
+public:
+    explicit SpiroProfileSite(const char* name);
+
+    const char* name() const { return m_name; }
+    void record(std::int64_t nanoseconds);
+    void reset();
+
+    std::uint64_t calls() const { return m_calls.load(std::memory_order_relaxed); }
+    std::int64_t totalNanoseconds() const { return m_total.load(std::memory_order_relaxed); }
+    std::int64_t lastNanoseconds() const { return m_last.load(std::memory_order_relaxed); }
+    std::int64_t maxNanoseconds() const { return m_max.load(std::memory_order_relaxed); }
+
+private:
+    const char* m_name;
+    std::atomic<std::uint64_t> m_calls;
+    std::atomic<std::int64_t> m_total;
+    std::atomic<std::int64_t> m_last;
+    std::atomic<std::int64_t> m_max;
+};
+
+class SpiroProfiler
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct SiteStats
+    {
+        std::string name;
+        std::uint64_t calls;
+        double totalMs;
+        double lastMs;
+        double maxMs;
+    };
+
+    static SpiroProfiler& instance();
+
+    void registerSite(SpiroProfileSite* site);
+    // Sites that have been entered at least once, in order of registration
+    std::vector<SiteStats> sites() const;
+    // Null if no scope of that name has run yet
+    const SpiroProfileSite* site(const std::string& name) const;
+
+    void add(SpiroCounter counter, std::uint64_t amount)
+    {
+        m_counters[static_cast<int>(counter)].fetch_add(amount, std::memory_order_relaxed);
+    }
+    std::uint64_t counter(SpiroCounter counter) const
+    {
+        return m_counters[static_cast<int>(counter)].load(std::memory_order_relaxed);
+    }
+    static const char* counterName(SpiroCounter counter);
+
+    // Zeroes counters and site statistics, but keeps the sites
+    void reset();
+
+    // While tracing, every finished scope is also kept as an event, up to
+    // maxEvents; the rest are dropped and counted
+    void startTrace(std::size_t maxEvents = 1000000);
+    void stopTrace();
+    bool isTracing() const { return m_tracing.load(std::memory_order_relaxed); }
+    void addTraceEvent(const SpiroProfileSite& site, Clock::time_point start, Clock::time_point end);
+    // Chrome trace event format, for chrome://tracing or Perfetto
+    bool writeTrace(const std::string& path) const;
+
+private:
+    SpiroProfiler();
+
+    struct TraceEvent
+    {
+        const char* name;
+        int thread;
+        std::int64_t start;     // ns since startTrace
+        std::int64_t duration;  // ns
+    };
+
+    mutable std::mutex m_mutex;
+    std::vector<SpiroProfileSite*> m_sites;
+    std::atomic<std::uint64_t> m_counters[static_cast<int>(SpiroCounter::Count)];
+
+    std::atomic<bool> m_tracing;
+    Clock::time_point m_traceStart;
+    std::size_t m_maxEvents;
+    std::size_t m_droppedEvents;
+    std::vector<TraceEvent> m_events;
+};
+
+// Times the enclosing scope into site, and into the trace while one runs
+class SpiroScopedTimer
+{
+public:
+    explicit SpiroScopedTimer(SpiroProfileSite& site)
+        : m_site(site), m_start(SpiroProfiler::Clock::now())
+    {
+    }
+    ~SpiroScopedTimer();
+
+    SpiroScopedTimer(const SpiroScopedTimer&) = delete;
+    SpiroScopedTimer& operator=(const SpiroScopedTimer&) = delete;
+
+private:
+    SpiroProfileSite& m_site;
+    SpiroProfiler::Clock::time_point m_start;
+};
+
+// Instrumentation compiles away unless SPIROBOT_PROFILING is defined
+#ifdef SPIROBOT_PROFILING
+#define SPIRO_PROFILE_CONCAT_(a, b) a##b
+#define SPIRO_PROFILE_CONCAT(a, b) SPIRO_PROFILE_CONCAT_(a, b)
+#define SPIRO_PROFILE_SCOPE(name)                                                      \
+    static SpiroProfileSite SPIRO_PROFILE_CONCAT(spiroProfileSite, __LINE__)(name);   \
+    SpiroScopedTimer SPIRO_PROFILE_CONCAT(spiroProfileTimer, __LINE__)(SPIRO_PROFILE_CONCAT(spiroProfileSite, __LINE__))
+#define SPIRO_PROFILE_COUNT(counter, amount) SpiroProfiler::instance().add(SpiroCounter::counter, (amount))
+#else
+#define SPIRO_PROFILE_SCOPE(name) do {} while (0)
+#define SPIRO_PROFILE_COUNT(counter, amount) do { static_cast<void>(sizeof(amount)); } while (0)
+#endif
+
+#endif // SPIROPROFILER_H
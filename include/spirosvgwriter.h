@@ -0,0 +1,57 @@
+#ifndef SPIROSVGWRITER_H
+#define SPIROSVGWRITER_H
+
+#include <cstdint>
+#include <string>
+#include "spirofilewriter.h"
+#include "spiropath.h"
+
+// How patterns are placed in the document and how exactly they are written
+struct SpiroSvgOptions
+{
+    // Document size in SVG user units (pixels)
+    double width = 1000.0;
+    double height = 1000.0;
+    // Pattern coordinates map to x * scale + offsetX, y * scale + offsetY
+    double scale = 1.0;
+    double offsetX = 0.0;
+    double offsetY = 0.0;
+    double strokeWidth = 1.0;
+    // Decimals written per coordinate
+    int precision = 2;
+    // Douglas-Peucker tolerance in user units; 0 keeps every vertex
+    double simplifyTolerance = 0.0;
+    std::string title;
+    std::string description;
+};
+
+// Streams a pattern to SVG without going through a painter: each pen is one
+// <path> in its own Inkscape layer. A stroke starts with an absolute moveto
+// and continues with relative lineto pairs. Positions are rounded to the
+// output precision before the differences are taken, so rounding never
+// accumulates along a path, and points that round onto the previous one are
+// dropped.
+class SpiroSvgWriter
+{
+public:
+    SpiroSvgWriter();
+
+    // path is in the local 8-bit encoding, as passed to fopen
+    bool open(const std::string& path, const SpiroSvgOptions& options);
+    // Adds the pen as the next layer; rgb is 0xRRGGBB
+    void writePen(const SpiroPathBuffer& path, std::uint32_t rgb, const std::string& label);
+    // Fails if anything went wrong since open(); the file is incomplete then
+    bool close();
+
+private:
+    void writeText(const std::string& text);
+    void writeStep(long long steps);
+    void writeLength(double value);
+
+    SpiroFileWriter m_out;
+    SpiroSvgOptions m_options;
+    double m_stepsPerUnit;
+    int m_layers;
+};
+
+#endif // SPIROSVGWRITER_H
@@ -0,0 +1,54 @@
+#ifndef SPIROSWEEP_H
+#define SPIROSWEEP_H
+
+#include <cstddef>
+#include <vector>
+#include "spirogenerator.h"
+
+// The values first, first + step, ... up to and including last. A step of 0
+// or less, or last before first, gives first alone.
+struct SpiroSweepRange
+{
+    double first;
+    double last;
+    double step;
+
+    SpiroSweepRange(double value = 0.0) : first(value), last(value), step(1.0) {}
+    SpiroSweepRange(double first, double last, double step) : first(first), last(last), step(step) {}
+
+    std::vector<double> values() const;
+};
+
+// A grid over the pattern parameters, as passed to DrawingArea::setParameters
+struct SpiroSweep
+{
+    SpiroSweepRange outerRadius = 96;
+    SpiroSweepRange innerRadius = 36;
+    SpiroSweepRange penOffset = 25;
+    SpiroSweepRange rotations = 5;
+    SpiroSweepRange numPens = 1;
+    SpiroSweepRange rotationOffset = 0;  // degrees
+    // Draw every set until its curve closes, ignoring rotations
+    bool closeLoops = false;
+};
+
+struct SpiroSweepEntry
+{
+    SpiroParameters parameters;
+    // Index of the first entry that draws the same curve, up to scale; the
+    // entry's own index if there is none before it
+    std::size_t original;
+};
+
+// The smallest parameters that draw the same curve as params up to scale:
+// the radii and pen offset divided by their common factor, rotations beyond
+// the point where the curve closes dropped, and the pen rotation offset
+// reduced to one turn
+SpiroParameters canonicalParameters(const SpiroParameters& params);
+
+// Every combination of the sweep's values, varying rotationOffset fastest and
+// outerRadius slowest. Sets the generator cannot draw (radii or counts below
+// 1) are left out, and sets equivalent to an earlier one are marked.
+std::vector<SpiroSweepEntry> expandSweep(const SpiroSweep& sweep);
+
+#endif // SPIROSWEEP_H
@@ -0,0 +1,48 @@
+#ifndef SPIROTASKPOOL_H
+#define SPIROTASKPOOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for data-parallel loops. The calling thread
+// works on its own loop too, so nested parallelFor calls from inside a task
+// always make progress instead of deadlocking on a busy pool.
+class SpiroTaskPool
+{
+public:
+    // workerCount of 0 uses one worker per hardware thread, minus the caller
+    explicit SpiroTaskPool(unsigned workerCount = 0);
+    ~SpiroTaskPool();
+
+    SpiroTaskPool(const SpiroTaskPool&) = delete;
+    SpiroTaskPool& operator=(const SpiroTaskPool&) = delete;
+
+    // Number of threads that can run tasks concurrently, including the caller
+    unsigned concurrency() const { return static_cast<unsigned>(m_workers.size()) + 1; }
+
+    // Runs task(0) .. task(count - 1) and returns when all have finished.
+    // The first exception thrown by a task is rethrown here.
+    void parallelFor(std::size_t count, const std::function<void(std::size_t)>& task);
+
+    static SpiroTaskPool& instance();
+
+private:
+    struct Batch;
+
+    void workerLoop();
+    static void runBatch(Batch& batch);
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::deque<std::shared_ptr<Batch>> m_queue;
+    bool m_stopping;
+};
+
+#endif // SPIROTASKPOOL_H
@@ -0,0 +1,24 @@
+#ifndef SPIROTRAVEL_H
+#define SPIROTRAVEL_H
+
+#include "spiropath.h"
+
+// Pen-up distance covered when the strokes of path are drawn in order,
+// starting with the pen at (startX, startY)
+double penUpTravel(const SpiroPathBuffer& path, double startX, double startY);
+
+struct SpiroTravelReport
+{
+    double before;
+    double after;
+};
+
+// Writes the strokes of path to ordered so that the pen-up travel between
+// them is as short as practical: a nearest-neighbour tour, improved by 2-opt
+// moves that reverse runs of strokes together with their drawing direction.
+// Stroke contents are not changed. If nothing shorter is found, the original
+// order is kept.
+SpiroTravelReport optimizeStrokeOrder(const SpiroPathBuffer& path, double startX, double startY,
+                                      SpiroPathBuffer& ordered);
+
+#endif // SPIROTRAVEL_H
@@ -0,0 +1,60 @@
+#ifndef SWEEPRENDERER_H
+#define SWEEPRENDERER_H
+
+#include <QImage>
+#include <QString>
+#include <functional>
+#include <vector>
+#include "spirogenerator.h"
+#include "spirosweep.h"
+
+// Renders a parameter sweep into contact sheets of thumbnails. Each sheet's
+// thumbnails are generated and rasterized in parallel on the shared task
+// pool; parameter sets that draw the same curve as an earlier one are only
+// rendered once. Writes sheet_001.png, sheet_002.png, ... and index.csv, which
+// lists every set with the sheet cell that shows it.
+class SweepRenderer
+{
+public:
+    struct Settings
+    {
+        SpiroSweep sweep;
+        // Adaptive tolerance is in thumbnail pixels here
+        SpiroSampling sampling;
+        double lineThickness = 1.0;
+        int thumbnailSize = 200;
+        int columns = 10;
+        int rows = 10;  // per sheet
+        QString outputDirectory;
+
+        Settings();
+    };
+
+    // Reads a sweep file. Each of outerRadius, innerRadius, penOffset,
+    // rotations, numPens and rotationOffset is a number or [first, last, step];
+    // rotations may also be "close". Further keys: lineThickness, adaptive,
+    // chordTolerance, stepSize, thumbnailSize, columns, rows, and output, the
+    // directory relative to the file.
+    static bool loadSettings(const QString &path, Settings &settings, QString *error);
+
+    explicit SweepRenderer(const Settings &settings);
+
+    // Called on the calling thread after each sheet with the number of
+    // distinct curves rendered so far and in total
+    void setProgressCallback(std::function<void(int, int)> callback);
+
+    bool run(QString *error);
+
+    int entryCount() const { return static_cast<int>(m_entries.size()); }
+    int renderedCount() const { return m_renderedCount; }
+
+private:
+    QImage renderThumbnail(const SpiroParameters &parameters) const;
+
+    Settings m_settings;
+    std::vector<SpiroSweepEntry> m_entries;
+    int m_renderedCount;
+    std::function<void(int, int)> m_progressCallback;
+};
+
+#endif // SWEEPRENDERER_H
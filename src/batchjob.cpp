@@ -0,0 +1,145 @@
+#include "batchjob.h"
+#include "machineprofile.h"
+#include "patternexporter.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+
+namespace {
+
+bool fail(QString *error, const QString &message)
+{
+    if (error) {
+        *error = message;
+    }
+    return false;
+}
+
+// The directory a written file goes into has to exist first
+bool preparePath(const QString &filename)
+{
+    return QDir().mkpath(QFileInfo(filename).absolutePath());
+}
+
+} // namespace
+
+BatchJob::BatchJob()
+    : lineThickness(1.0), size(1000, 1000), svgTolerance(0.0), machine(MachineProfile::defaults())
+{
+}
+
+bool BatchJob::apply(const QJsonObject &json, const QDir &baseDir, QString *error)
+{
+    name = json["name"].toString(name);
+
+    parameters.outerRadius = json["outerRadius"].toInt(parameters.outerRadius);
+    parameters.innerRadius = json["innerRadius"].toInt(parameters.innerRadius);
+    parameters.penOffset = json["penOffset"].toInt(parameters.penOffset);
+    parameters.rotations = json["rotations"].toInt(parameters.rotations);
+    parameters.numPens = json["numPens"].toInt(parameters.numPens);
+    parameters.rotationOffset = json["rotationOffset"].toDouble(parameters.rotationOffset);
+    lineThickness = json["lineThickness"].toDouble(lineThickness);
+
+    if (json.contains("adaptive")) {
+        sampling.mode = json["adaptive"].toBool() ? SpiroSampling::Mode::Adaptive : SpiroSampling::Mode::FixedStep;
+    }
+    sampling.chordTolerance = json["chordTolerance"].toDouble(sampling.chordTolerance);
+    sampling.stepSize = json["stepSize"].toDouble(sampling.stepSize);
+
+    if (json.contains("svg")) {
+        svgFile = baseDir.absoluteFilePath(json["svg"].toString());
+    }
+    if (json.contains("png")) {
+        pngFile = baseDir.absoluteFilePath(json["png"].toString());
+    }
+    if (json.contains("gcode")) {
+        gcodeFile = baseDir.absoluteFilePath(json["gcode"].toString());
+    }
+    size.setWidth(json["width"].toInt(size.width()));
+    size.setHeight(json["height"].toInt(size.height()));
+    svgTolerance = json["svgTolerance"].toDouble(svgTolerance);
+
+    QJsonValue profile = json["machine"];
+    if (profile.isString()) {
+        QString path = baseDir.absoluteFilePath(profile.toString());
+        if (!MachineProfile::load(path, machine)) {
+            return fail(error, QString("cannot read machine profile %1").arg(path));
+        }
+    } else if (profile.isObject()) {
+        MachineProfile::apply(profile.toObject(), machine);
+    }
+
+    if (parameters.outerRadius <= 0 || parameters.innerRadius <= 0) {
+        return fail(error, "radii must be positive");
+    }
+    if (parameters.rotations < 1 || parameters.numPens < 1) {
+        return fail(error, "rotations and numPens must be at least 1");
+    }
+    if (size.width() < 1 || size.height() < 1) {
+        return fail(error, "width and height must be at least 1");
+    }
+    if (sampling.chordTolerance <= 0.0 || sampling.stepSize <= 0.0) {
+        return fail(error, "chordTolerance and stepSize must be positive");
+    }
+    if (svgTolerance < 0.0) {
+        return fail(error, "svgTolerance must not be negative");
+    }
+    return true;
+}
+
+bool BatchJob::run(QString *error) const
+{
+    PatternExporter exporter = PatternExporter::generate(parameters, sampling, parameters.rotations, lineThickness);
+
+    if (!svgFile.isEmpty() && !(preparePath(svgFile) && exporter.exportToSVG(svgFile, size, svgTolerance))) {
+        return fail(error, QString("failed to write %1").arg(svgFile));
+    }
+    if (!pngFile.isEmpty() && !(preparePath(pngFile) && exporter.exportToPNG(pngFile, size))) {
+        return fail(error, QString("failed to write %1").arg(pngFile));
+    }
+    if (!gcodeFile.isEmpty() && !(preparePath(gcodeFile) && exporter.exportToGcode(gcodeFile, machine))) {
+        return fail(error, QString("failed to write the pen files for %1").arg(gcodeFile));
+    }
+    return true;
+}
+
+bool BatchJob::loadFile(const QString &path, const BatchJob &defaults, QVector<BatchJob> &jobs, QString *error)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return fail(error, QString("cannot open %1: %2").arg(path, file.errorString()));
+    }
+
+    QJsonParseError parseError;
+    QJsonDocument document = QJsonDocument::fromJson(file.readAll(), &parseError);
+    if (document.isNull()) {
+        return fail(error, QString("%1: %2").arg(path, parseError.errorString()));
+    }
+
+    QDir baseDir = QFileInfo(path).absoluteDir();
+    BatchJob fileDefaults = defaults;
+    QJsonArray entries;
+    if (document.isArray()) {
+        entries = document.array();
+    } else if (document.object().contains("jobs")) {
+        QString message;
+        if (!fileDefaults.apply(document.object()["defaults"].toObject(), baseDir, &message)) {
+            return fail(error, QString("%1: defaults: %2").arg(path, message));
+        }
+        entries = document.object()["jobs"].toArray();
+    } else {
+        entries.append(document.object());
+    }
+
+    for (int i = 0; i < entries.size(); ++i) {
+        BatchJob job = fileDefaults;
+        job.name = QString("%1 #%2").arg(QFileInfo(path).fileName()).arg(i + 1);
+        QString message;
+        if (!entries[i].isObject() || !job.apply(entries[i].toObject(), baseDir, &message)) {
+            return fail(error, QString("%1: job %2: %3").arg(path).arg(i + 1).arg(message.isEmpty() ? "not an object" : message));
+        }
+        jobs.append(job);
+    }
+    return true;
+}
@@ -0,0 +1,398 @@
+#include "gcodegenerator.h"
+#include "machineprofile.h"
+#include "patternexporter.h"
+#include "spirocache.h"
+#include "spirogenerator.h"
+#include "spiroindex.h"
+#include <QCommandLineParser>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QGuiApplication>
+#include <QImage>
+#include <QPainter>
+#include <QRegularExpression>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <algorithm>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <vector>
+#ifdef SPIROBOT_OPENGL_PREVIEW
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLFramebufferObject>
+#include <QOpenGLFunctions>
+#include "patternglrenderer.h"
+#endif
+
+namespace {
+
+// What one iteration of a benchmark got through, for throughput figures.
+// Items are whatever the benchmark counts: points, lines, pixels.
+struct Work
+{
+    double items = 0.0;
+    double bytes = 0.0;
+};
+
+struct Benchmark
+{
+    QString name;
+    QString itemName;
+    std::function<Work()> body;
+};
+
+struct Result
+{
+    int iterations = 0;
+    double minSeconds = 0.0;
+    double medianSeconds = 0.0;
+    Work work;
+};
+
+// Runs body until minTime has passed and at least three iterations were
+// timed, after one untimed warm-up. The median is reported because a single
+// descheduled iteration would skew the mean.
+Result measure(const Benchmark &benchmark, double minTime)
+{
+    Result result;
+    result.work = benchmark.body();
+
+    std::vector<double> times;
+    QElapsedTimer total;
+    total.start();
+    while (times.size() < 3 || total.nsecsElapsed() < minTime * 1e9) {
+        QElapsedTimer timer;
+        timer.start();
+        benchmark.body();
+        times.push_back(timer.nsecsElapsed() * 1e-9);
+    }
+
+    std::sort(times.begin(), times.end());
+    result.iterations = static_cast<int>(times.size());
+    result.minSeconds = times.front();
+    result.medianSeconds = times[times.size() / 2];
+    return result;
+}
+
+SpiroParameters pattern(int rotations, int numPens)
+{
+    SpiroParameters params;
+    params.outerRadius = 96;
+    params.innerRadius = 37;
+    params.penOffset = 60;
+    params.rotations = rotations;
+    params.numPens = numPens;
+    params.rotationOffset = numPens > 1 ? 360.0 / numPens : 0.0;
+    return params;
+}
+
+SpiroSampling sampling(SpiroSampling::Mode mode)
+{
+    SpiroSampling result;
+    result.mode = mode;
+    return result;
+}
+
+std::size_t pointCount(const std::vector<SpiroPolyline> &polylines)
+{
+    std::size_t count = 0;
+    for (const SpiroPolyline &polyline : polylines) {
+        count += polyline.size();
+    }
+    return count;
+}
+
+std::vector<SpiroPathBuffer> toPathBuffers(const std::vector<SpiroPolyline> &polylines)
+{
+    std::vector<SpiroPathBuffer> paths(polylines.size());
+    for (std::size_t pen = 0; pen < polylines.size(); ++pen) {
+        paths[pen].appendStroke(polylines[pen]);
+    }
+    return paths;
+}
+
+// Lines and bytes of every file in directory
+Work outputSize(const QDir &directory)
+{
+    Work work;
+    for (const QFileInfo &info : directory.entryInfoList(QDir::Files)) {
+        QFile file(info.filePath());
+        if (file.open(QIODevice::ReadOnly)) {
+            QByteArray contents = file.readAll();
+            work.items += contents.count('\n');
+            work.bytes += contents.size();
+        }
+    }
+    return work;
+}
+
+#ifdef SPIROBOT_OPENGL_PREVIEW
+// An offscreen OpenGL 3.3 context with a framebuffer for the renderer to
+// draw into; everything is made and used with the context current
+struct GLTarget
+{
+    QOffscreenSurface surface;
+    QOpenGLContext context;
+    std::unique_ptr<QOpenGLFramebufferObject> framebuffer;
+    PatternGLRenderer renderer;
+
+    ~GLTarget()
+    {
+        if (context.isValid() && context.makeCurrent(&surface)) {
+            renderer.release();
+            framebuffer.reset();
+            context.doneCurrent();
+        }
+    }
+};
+
+// Null if the platform has no OpenGL 3.3, as Qt's offscreen platform may not
+std::shared_ptr<GLTarget> createGLTarget(const QSize &size)
+{
+    QSurfaceFormat format;
+    format.setVersion(3, 3);
+    format.setProfile(QSurfaceFormat::CoreProfile);
+
+    auto target = std::make_shared<GLTarget>();
+    target->surface.setFormat(format);
+    target->surface.create();
+    target->context.setFormat(format);
+    if (!target->context.create() || !target->context.makeCurrent(&target->surface)) {
+        return nullptr;
+    }
+    target->framebuffer.reset(new QOpenGLFramebufferObject(size));
+    if (!target->framebuffer->isValid() || !target->renderer.initialize()) {
+        return nullptr;
+    }
+    return target;
+}
+#endif
+
+QVector<Benchmark> benchmarks(const QDir &outputDir)
+{
+    QVector<Benchmark> list;
+
+    // Generation, bypassing the geometry cache
+    const SpiroSampling::Mode modes[] = { SpiroSampling::Mode::FixedStep, SpiroSampling::Mode::Adaptive };
+    for (SpiroSampling::Mode mode : modes) {
+        QString modeName = mode == SpiroSampling::Mode::FixedStep ? "fixed" : "adaptive";
+        for (int rotations : { 1, 10, 37, 100 }) {
+            list.append({ QString("generate/%1/rotations:%2").arg(modeName).arg(rotations), "points", [=]() {
+                SpiroGenerator generator(pattern(rotations, 1), sampling(mode));
+                return Work{ static_cast<double>(pointCount(generator.generate(rotations))), 0.0 };
+            } });
+        }
+        for (int pens : { 2, 4, 8 }) {
+            list.append({ QString("generate/%1/pens:%2").arg(modeName).arg(pens), "points", [=]() {
+                SpiroGenerator generator(pattern(37, pens), sampling(mode));
+                return Work{ static_cast<double>(pointCount(generator.generate(37))), 0.0 };
+            } });
+        }
+    }
+
+    auto polylines = std::make_shared<const std::vector<SpiroPolyline>>(
+        SpiroGenerator(pattern(37, 4), sampling(SpiroSampling::Mode::FixedStep)).generate(37));
+    auto paths = std::make_shared<const std::vector<SpiroPathBuffer>>(toPathBuffers(*polylines));
+
+    list.append({ "generate/cache-hit", "points", [=]() {
+        SpiroGenerator generator(pattern(37, 4), sampling(SpiroSampling::Mode::FixedStep));
+        return Work{ static_cast<double>(pointCount(*SpiroGeometryCache::instance().generate(generator, 37))), 0.0 };
+    } });
+
+    list.append({ "analysis/path-length", "points", [=]() {
+        volatile double length = totalPathLength(*polylines);
+        (void)length;
+        return Work{ static_cast<double>(pointCount(*polylines)), 0.0 };
+    } });
+    list.append({ "analysis/bounds", "points", [=]() {
+        volatile double width = boundsOf(*polylines).width();
+        (void)width;
+        return Work{ static_cast<double>(pointCount(*polylines)), 0.0 };
+    } });
+
+    list.append({ "analysis/index", "points", [=]() {
+        SpiroSegmentIndex index;
+        index.build(*paths);
+        return Work{ static_cast<double>(pointCount(*polylines)), 0.0 };
+    } });
+    auto index = std::make_shared<SpiroSegmentIndex>();
+    index->build(*paths);
+    list.append({ "analysis/crossings", "points", [=]() {
+        volatile std::uint64_t crossings = index->intersections(*paths, 32, 32).total;
+        (void)crossings;
+        return Work{ static_cast<double>(pointCount(*polylines)), 0.0 };
+    } });
+
+    PatternExporter exporter(pattern(37, 4), sampling(SpiroSampling::Mode::FixedStep), 37, *paths, 1.0);
+    for (int size : { 1000, 4000 }) {
+        QString png = outputDir.filePath(QString("bench_%1.png").arg(size));
+        list.append({ QString("export/png:%1").arg(size), "pixels", [=]() {
+            exporter.exportToPNG(png, QSize(size, size));
+            return Work{ double(size) * size, double(QFileInfo(png).size()) };
+        } });
+    }
+    for (double tolerance : { 0.0, 0.1 }) {
+        QString svg = outputDir.filePath("bench.svg");
+        QString name = tolerance > 0.0 ? QString("export/svg:simplified") : QString("export/svg");
+        list.append({ name, "points", [=]() {
+            exporter.exportToSVG(svg, QSize(1000, 1000), tolerance);
+            return Work{ static_cast<double>(pointCount(*polylines)), double(QFileInfo(svg).size()) };
+        } });
+    }
+
+    // The preview: QPainter's antialiased strokes as DrawingArea rasterizes
+    // them, against the OpenGL renderer drawing the same pattern at the same
+    // size, waiting for the GPU to finish
+    const int renderSize = 1000;
+    SpiroBounds bounds = boundsOf(*paths);
+    double margin = std::max(bounds.width(), bounds.height()) * 0.05;
+    double zoom = renderSize / (std::max(bounds.width(), bounds.height()) + 2 * margin);
+    QPointF center((bounds.minX + bounds.maxX) / 2, (bounds.minY + bounds.maxY) / 2);
+    auto painterPaths = std::make_shared<QVector<QPainterPath>>();
+    for (const SpiroPathBuffer &path : *paths) {
+        painterPaths->append(PatternExporter::toPainterPath(path));
+    }
+    QVector<QColor> colors = PatternExporter::penColors(static_cast<int>(paths->size()));
+    list.append({ QString("render/qpainter:%1").arg(renderSize), "points", [=]() {
+        QImage image(renderSize, renderSize, QImage::Format_ARGB32_Premultiplied);
+        image.fill(Qt::white);
+        QPainter painter(&image);
+        painter.setRenderHint(QPainter::Antialiasing, true);
+        painter.translate(renderSize / 2.0, renderSize / 2.0);
+        painter.scale(zoom, zoom);
+        painter.translate(-center);
+        for (int pen = 0; pen < painterPaths->size(); ++pen) {
+            painter.setPen(QPen(colors[pen], 1.0 / zoom));
+            painter.drawPath((*painterPaths)[pen]);
+        }
+        return Work{ static_cast<double>(pointCount(*polylines)), 0.0 };
+    } });
+#ifdef SPIROBOT_OPENGL_PREVIEW
+    if (std::shared_ptr<GLTarget> gl = createGLTarget(QSize(renderSize, renderSize))) {
+        gl->renderer.setPattern(*paths, colors, 1.0, 1);
+        gl->context.doneCurrent();
+        list.append({ QString("render/gl:%1").arg(renderSize), "points", [=]() {
+            gl->context.makeCurrent(&gl->surface);
+            gl->framebuffer->bind();
+            gl->renderer.render(QSize(renderSize, renderSize), 1.0, Qt::white);
+            gl->context.functions()->glFinish();
+            gl->framebuffer->release();
+            gl->context.doneCurrent();
+            return Work{ static_cast<double>(pointCount(*polylines)), 0.0 };
+        } });
+    } else {
+        std::cerr << "No OpenGL 3.3 context, leaving out render/gl; try QT_QPA_PLATFORM=xcb" << std::endl;
+    }
+#endif
+
+    // G-code into a directory of its own, so its size is what was written
+    for (bool planned : { false, true }) {
+        QString name = planned ? "planned" : "constant-feed";
+        QDir gcodeDir(outputDir.filePath("gcode-" + name));
+        gcodeDir.mkpath(".");
+        GcodeGenerator::Config config = MachineProfile::defaults();
+        config.planFeeds = planned;
+        list.append({ "gcode/" + name, "lines", [=]() {
+            GcodeGenerator generator;
+            generator.generateGcode(*paths, config, gcodeDir.filePath("bench.gcode"));
+            return outputSize(gcodeDir);
+        } });
+    }
+    return list;
+}
+
+QString rate(double amount, double seconds, const QString &unit)
+{
+    if (amount <= 0.0 || seconds <= 0.0) {
+        return QString();
+    }
+    double perSecond = amount / seconds;
+    if (unit == "B") {
+        return QString("%1 MB/s").arg(perSecond / (1024.0 * 1024.0), 0, 'f', 1);
+    }
+    if (perSecond >= 1e6) {
+        return QString("%1 M%2/s").arg(perSecond / 1e6, 0, 'f', 2).arg(unit);
+    }
+    return QString("%1 k%2/s").arg(perSecond / 1e3, 0, 'f', 1).arg(unit);
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QGuiApplication app(argc, argv);
+    QCoreApplication::setApplicationName("spirobot-bench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Times pattern generation, analysis, rendering and export.");
+    parser.addHelpOption();
+    parser.addOptions({
+        { "filter", "Run only benchmarks whose name matches regex.", "regex" },
+        { "min-time", "Seconds to spend on each benchmark (default 0.5).", "seconds", "0.5" },
+        { "list", "List the benchmarks and exit." },
+        { "csv", "Also write the results to file, for comparing builds.", "file" },
+    });
+    parser.process(app);
+
+    QTemporaryDir outputDir;
+    if (!outputDir.isValid()) {
+        std::cerr << "Cannot create a temporary directory" << std::endl;
+        return 2;
+    }
+
+    QRegularExpression filter(parser.value("filter"));
+    if (!filter.isValid()) {
+        std::cerr << "Invalid --filter: " << filter.errorString().toStdString() << std::endl;
+        return 2;
+    }
+    const double minTime = parser.value("min-time").toDouble();
+
+    QVector<Benchmark> selected;
+    for (const Benchmark &benchmark : benchmarks(QDir(outputDir.path()))) {
+        if (filter.match(benchmark.name).hasMatch()) {
+            selected.append(benchmark);
+        }
+    }
+    if (parser.isSet("list")) {
+        for (const Benchmark &benchmark : selected) {
+            std::cout << benchmark.name.toStdString() << std::endl;
+        }
+        return 0;
+    }
+
+    QFile csvFile(parser.value("csv"));
+    QTextStream csv(&csvFile);
+    if (parser.isSet("csv")) {
+        if (!csvFile.open(QIODevice::WriteOnly | QIODevice::Text)) {
+            std::cerr << "Cannot write " << csvFile.fileName().toStdString() << std::endl;
+            return 2;
+        }
+        csv << "name,iterations,median_s,min_s,items,item,bytes\n";
+    }
+
+    std::cout << std::left << std::setw(34) << "benchmark" << std::right << std::setw(8) << "iter"
+              << std::setw(12) << "median ms" << std::setw(12) << "min ms" << std::setw(18) << "items"
+              << std::setw(14) << "bytes" << std::endl;
+    for (const Benchmark &benchmark : selected) {
+        Result result = measure(benchmark, minTime);
+        std::cout << std::left << std::setw(34) << benchmark.name.toStdString() << std::right
+                  << std::setw(8) << result.iterations << std::fixed << std::setprecision(3)
+                  << std::setw(12) << result.medianSeconds * 1e3 << std::setw(12) << result.minSeconds * 1e3
+                  << std::setw(18) << rate(result.work.items, result.medianSeconds, benchmark.itemName).toStdString()
+                  << std::setw(14) << rate(result.work.bytes, result.medianSeconds, "B").toStdString() << std::endl;
+        if (csvFile.isOpen()) {
+            csv << benchmark.name << ',' << result.iterations << ',' << result.medianSeconds << ','
+                << result.minSeconds << ',' << result.work.items << ',' << benchmark.itemName << ','
+                << result.work.bytes << '\n';
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,207 @@
+#include "batchjob.h"
+#include "machineprofile.h"
+#include "spirocache.h"
+#include "spiroprofiler.h"
+#include "sweeprenderer.h"
+#include <QCommandLineParser>
+#include <QGuiApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QRegularExpression>
+#include <iostream>
+
+namespace {
+
+// Pattern options shared by every job that does not set them itself. Output
+// files only make sense for the single job built from the command line.
+bool applyOptions(const QCommandLineParser &parser, bool outputs, BatchJob &defaults, QString *error)
+{
+    QJsonObject json;
+    auto intOption = [&](const QString &option, const QString &key) {
+        if (parser.isSet(option)) {
+            json[key] = parser.value(option).toInt();
+        }
+    };
+    auto doubleOption = [&](const QString &option, const QString &key) {
+        if (parser.isSet(option)) {
+            json[key] = parser.value(option).toDouble();
+        }
+    };
+    intOption("outer-radius", "outerRadius");
+    intOption("inner-radius", "innerRadius");
+    intOption("pen-offset", "penOffset");
+    intOption("rotations", "rotations");
+    intOption("pens", "numPens");
+    doubleOption("rotation-offset", "rotationOffset");
+    doubleOption("line-thickness", "lineThickness");
+    doubleOption("chord-tolerance", "chordTolerance");
+    doubleOption("svg-tolerance", "svgTolerance");
+    if (parser.isSet("fixed-step")) {
+        json["adaptive"] = false;
+    }
+    if (parser.isSet("size")) {
+        QRegularExpressionMatch match = QRegularExpression("^(\\d+)x(\\d+)$").match(parser.value("size"));
+        if (!match.hasMatch()) {
+            *error = "--size expects WIDTHxHEIGHT";
+            return false;
+        }
+        json["width"] = match.captured(1).toInt();
+        json["height"] = match.captured(2).toInt();
+    }
+    for (const QString &output : { QString("svg"), QString("png"), QString("gcode") }) {
+        if (outputs && parser.isSet(output)) {
+            json[output] = parser.value(output);
+        }
+    }
+    return defaults.apply(json, QDir::current(), error);
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    // Nothing is ever shown; render nodes have no display server
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QGuiApplication app(argc, argv);
+    QCoreApplication::setApplicationName("spirobot-cli");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Generates spirograph patterns and writes SVG, PNG and Gcode without a display.\n"
+                                     "Each job file holds one or more jobs, and the pattern options act as defaults\n"
+                                     "for all of them. Without job files a single job is built from the options.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("jobs", "JSON job files to run in order.", "[jobs...]");
+    parser.addOptions({
+        { "outer-radius", "Outer ring radius.", "n" },
+        { "inner-radius", "Gear radius.", "n" },
+        { "pen-offset", "Pen distance from the gear centre.", "n" },
+        { "rotations", "Rotations to draw.", "n" },
+        { "pens", "Number of pens.", "n" },
+        { "rotation-offset", "Rotation between pens in degrees.", "degrees" },
+        { "line-thickness", "Stroke width for SVG and PNG.", "width" },
+        { "fixed-step", "Sample at fixed steps instead of adaptively." },
+        { "chord-tolerance", "Adaptive sampling tolerance.", "mm" },
+        { "config", "Machine profile, instead of the config.json found next to the application.", "file" },
+        { "svg", "Write an SVG file (without job files).", "file" },
+        { "png", "Write a PNG file (without job files).", "file" },
+        { "gcode", "Write Gcode, one file per pen (without job files).", "file" },
+        { "svg-tolerance", "Simplify SVG paths to within this many pixels.", "pixels" },
+        { "size", "Image size for SVG and PNG.", "WIDTHxHEIGHT" },
+        { "sweep", "Render the parameter sweep in file to contact sheets; may be repeated.", "file" },
+        { "cache", "Reuse generated patterns stored in file, and store this run's patterns there.", "file" },
+        { "trace", "Write a Chrome trace of where the time went to file.", "file" },
+    });
+    parser.process(app);
+
+    BatchJob defaults;
+    if (parser.isSet("config")) {
+        if (!MachineProfile::load(parser.value("config"), defaults.machine)) {
+            std::cerr << "Cannot read machine profile " << parser.value("config").toStdString() << std::endl;
+            return 2;
+        }
+    } else {
+        defaults.machine = MachineProfile::load();
+    }
+
+    const QString cacheFile = parser.value("cache");
+    if (!cacheFile.isEmpty() && QFileInfo::exists(cacheFile)
+        && !SpiroGeometryCache::instance().load(QFile::encodeName(cacheFile).toStdString())) {
+        std::cerr << "Ignoring unreadable pattern cache " << cacheFile.toStdString() << std::endl;
+    }
+
+    const QString traceFile = parser.value("trace");
+    if (!traceFile.isEmpty()) {
+#ifdef SPIROBOT_PROFILING
+        SpiroProfiler::instance().startTrace();
+#else
+        std::cerr << "--trace needs a build with SPIROBOT_PROFILING" << std::endl;
+        return 2;
+#endif
+    }
+
+    QString error;
+    const bool jobFiles = !parser.positionalArguments().isEmpty();
+    if (!applyOptions(parser, !jobFiles, defaults, &error)) {
+        std::cerr << error.toStdString() << std::endl;
+        return 2;
+    }
+
+    QVector<BatchJob> jobs;
+    for (const QString &jobFile : parser.positionalArguments()) {
+        if (!BatchJob::loadFile(jobFile, defaults, jobs, &error)) {
+            std::cerr << error.toStdString() << std::endl;
+            return 2;
+        }
+    }
+    const QStringList sweepFiles = parser.values("sweep");
+    if (!jobFiles && (sweepFiles.isEmpty() || defaults.hasOutput())) {
+        defaults.name = "command line";
+        jobs.append(defaults);
+    }
+
+    // Each job already spreads its generation and pens over every core, so
+    // jobs simply run one after another
+    int failed = 0;
+    for (int i = 0; i < jobs.size(); ++i) {
+        const BatchJob &job = jobs[i];
+        std::cout << "[" << i + 1 << "/" << jobs.size() << "] " << job.name.toStdString() << ": " << std::flush;
+        if (!job.hasOutput()) {
+            std::cout << "nothing to write" << std::endl;
+            continue;
+        }
+
+        QElapsedTimer timer;
+        timer.start();
+        if (job.run(&error)) {
+            std::cout << "done in " << timer.elapsed() << " ms" << std::endl;
+        } else {
+            std::cout << "FAILED, " << error.toStdString() << std::endl;
+            ++failed;
+        }
+    }
+
+    // Sweeps run their thumbnails in parallel themselves
+    for (const QString &sweepFile : sweepFiles) {
+        SweepRenderer::Settings settings;
+        settings.lineThickness = defaults.lineThickness;
+        if (!SweepRenderer::loadSettings(sweepFile, settings, &error)) {
+            std::cerr << error.toStdString() << std::endl;
+            ++failed;
+            continue;
+        }
+
+        SweepRenderer renderer(settings);
+        renderer.setProgressCallback([&sweepFile](int done, int total) {
+            std::cout << sweepFile.toStdString() << ": " << done << "/" << total << " curves" << std::endl;
+        });
+        QElapsedTimer timer;
+        timer.start();
+        if (renderer.run(&error)) {
+            std::cout << sweepFile.toStdString() << ": " << renderer.entryCount() << " parameter sets, "
+                      << renderer.renderedCount() << " distinct, written to "
+                      << settings.outputDirectory.toStdString() << " in " << timer.elapsed() << " ms" << std::endl;
+        } else {
+            std::cout << sweepFile.toStdString() << ": FAILED, " << error.toStdString() << std::endl;
+            ++failed;
+        }
+    }
+
+    if (!traceFile.isEmpty()) {
+        SpiroProfiler::instance().stopTrace();
+        if (!SpiroProfiler::instance().writeTrace(QFile::encodeName(traceFile).toStdString())) {
+            std::cerr << "Cannot write trace " << traceFile.toStdString() << std::endl;
+        }
+    }
+    if (!cacheFile.isEmpty() && !SpiroGeometryCache::instance().save(QFile::encodeName(cacheFile).toStdString())) {
+        std::cerr << "Cannot write pattern cache " << cacheFile.toStdString() << std::endl;
+    }
+
+    if (failed > 0) {
+        std::cerr << failed << " of " << jobs.size() + sweepFiles.size() << " jobs failed" << std::endl;
+        return 1;
+    }
+    return 0;
+}
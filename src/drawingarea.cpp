@@ -1,9 +1,14 @@
 #include "drawingarea.h"
 #include "gcodegenerator.h"
+#include "spirocache.h"
+#include "spirogenerator.h"
+#include "spirolod.h"
+#include "spiroprofiler.h"
 #include <QPainter>
+#include <QFontMetrics>
+#include <QCursor>
+#include <QMouseEvent>
 #include <cmath>
-#include <QSvgGenerator>
-#include <QImage>
 #include <QFile>
 #include <QTextStream>
 #include <QLineF>
@@ -11,8 +16,117 @@
 #include <iostream>
 #include <QDebug>
 #include <stdexcept>
+#include <algorithm>
+#include <utility>
+#include <chrono>
+
+namespace {
+
+// Finest display tolerance relative to the pattern extent, and how many
+// 4x coarser levels to build on top of it
+const double lodFinestFraction = 1.0 / 8000.0;
+const int lodLevelCount = 5;
+
+// Hover readout: how far from the curve the mouse may be, and the half size
+// of the square around the point in which passing lines are counted, both
+// in pixels
+const double hoverSnapPixels = 12.0;
+const double hoverPassPixels = 3.0;
+// Bins per side of the crossing density map
+const int crossingMapSize = 32;
+
+QPainterPath toPainterPath(const SpiroPolyline &polyline)
+{
+    QPainterPath path;
+    path.reserve(static_cast<int>(polyline.size()));
+    for (std::size_t i = 0; i < polyline.size(); ++i) {
+        if (i == 0) {
+            path.moveTo(polyline.x[i], polyline.y[i]);
+        } else {
+            path.lineTo(polyline.x[i], polyline.y[i]);
+        }
+    }
+    return path;
+}
+
+// The overlay's text, from the profiler's running totals
+QStringList performanceSummary()
+{
+#ifdef SPIROBOT_PROFILING
+    SpiroProfiler &profiler = SpiroProfiler::instance();
+    auto timing = [&profiler](const char *label, const char *site) {
+        const SpiroProfileSite *stats = profiler.site(site);
+        if (!stats || stats->calls() == 0) {
+            return QString("%1 -").arg(label, -11);
+        }
+        return QString("%1 last %2 ms, max %3 ms, %4 calls").arg(label, -11)
+            .arg(stats->lastNanoseconds() * 1e-6, 0, 'f', 2)
+            .arg(stats->maxNanoseconds() * 1e-6, 0, 'f', 2)
+            .arg(stats->calls());
+    };
+
+    QStringList lines;
+    lines << timing("Paint", "paint") << timing("Rasterize", "paint.rasterize");
+    if (profiler.site("paint.gl")) {
+        lines << timing("Paint GL", "paint.gl") << timing("Upload GL", "paint.gl.upload");
+    }
+    lines << timing("Generate", "generate") << timing("Measure", "pattern.measure") << timing("LOD", "pattern.lod")
+          << timing("Index", "pattern.index");
+    lines << QString("%1 %2 M").arg("Vertices", -11)
+                 .arg(profiler.counter(SpiroCounter::VerticesGenerated) * 1e-6, 0, 'f', 2);
+    lines << QString("%1 %2 hits, %3 misses").arg("Cache", -11)
+                 .arg(profiler.counter(SpiroCounter::CacheHits))
+                 .arg(profiler.counter(SpiroCounter::CacheMisses));
+
+    double exportMs = 0.0;
+    for (const char *site : { "export.svg", "export.png", "export.gcode" }) {
+        if (const SpiroProfileSite *stats = profiler.site(site)) {
+            exportMs += stats->totalNanoseconds() * 1e-6;
+        }
+    }
+    double exportMB = profiler.counter(SpiroCounter::ExportBytes) / (1024.0 * 1024.0);
+    lines << (exportMs > 0.0 ? QString("%1 %2 MB at %3 MB/s").arg("Export", -11)
+                                   .arg(exportMB, 0, 'f', 2).arg(exportMB * 1000.0 / exportMs, 0, 'f', 1)
+                             : QString("%1 -").arg("Export", -11));
+    return lines;
+#else
+    return QStringList() << "Built without SPIROBOT_PROFILING";
+#endif
+}
 
+// White text on a dark box at position, moved inside bounds if given
+void drawTextPanel(QPainter &painter, const QStringList &lines, const QPoint &position, const QRect &bounds = QRect())
+{
+    QFont font("Monospace");
+    font.setStyleHint(QFont::TypeWriter);
+    font.setPointSize(9);
+    painter.setFont(font);
+    QFontMetrics metrics(font);
+
+    int textWidth = 0;
+    for (const QString &line : lines) {
+        textWidth = std::max(textWidth, metrics.horizontalAdvance(line));
+    }
+    const int padding = 6;
+    QRect panel(position, QSize(textWidth + 2 * padding, lines.size() * metrics.lineSpacing() + 2 * padding));
+    if (bounds.isValid()) {
+        panel.moveRight(std::min(panel.right(), bounds.right()));
+        panel.moveBottom(std::min(panel.bottom(), bounds.bottom()));
+        panel.moveLeft(std::max(panel.left(), bounds.left()));
+        panel.moveTop(std::max(panel.top(), bounds.top()));
+    }
+
+    painter.setRenderHint(QPainter::Antialiasing, false);
+    painter.fillRect(panel, QColor(0, 0, 0, 170));
+    painter.setPen(Qt::white);
+    int y = panel.top() + padding + metrics.ascent();
+    for (const QString &line : lines) {
+        painter.drawText(panel.left() + padding, y, line);
+        y += metrics.lineSpacing();
+    }
+}
 
+} // namespace
 
 class DrawingArea::DrawingAreaPrivate
 {
@@ -25,7 +139,10 @@ public:
 
 DrawingArea::DrawingArea(QWidget *parent)
     : QWidget(parent), outerRadius(100), innerRadius(50), penOffset(25), rotations(5),
-      lineThickness(1.0), numPens(1), rotationOffset(0), currentAngle(0), isAnimating(false)
+      lineThickness(1.0), numPens(1), rotationOffset(0), currentPatternId(0), patternRotations(0), patternLength(0),
+      machineConfig(), patternPlotTime(-1.0), regenerationGeneration(0), plotTimeGeneration(0), regenerationRunning(false), regenerationPending(false), zoomFactor(1.0),
+      patternCacheKey(), patternSerial(0), patternAppendOnly(false), performanceOverlayVisible(false),
+      hoverReadoutEnabled(false), hoverActive(false), hoverPasses(0), currentAngle(0), isAnimating(false)
 {
     std::cout << "DrawingArea constructor started" << std::endl;
     qDebug() << "DrawingArea constructor started";
@@ -51,6 +168,14 @@ DrawingArea::DrawingArea(QWidget *parent)
         qDebug() << "Connecting animation timer";
         connect(animationTimer, &QTimer::timeout, this, &DrawingArea::updateAnimation);
 
+        // Coalescing relies on a single regeneration job being in flight
+        regenerationPool.setMaxThreadCount(1);
+
+        // Keeps the overlay current while nothing else repaints
+        performanceOverlayTimer = new QTimer(this);
+        performanceOverlayTimer->setInterval(500);
+        connect(performanceOverlayTimer, &QTimer::timeout, this, QOverload<>::of(&DrawingArea::update));
+
         std::cout << "Creating GcodeGenerator" << std::endl;
         qDebug() << "Creating GcodeGenerator";
         d_ptr = new DrawingAreaPrivate();
@@ -68,6 +193,9 @@ DrawingArea::DrawingArea(QWidget *parent)
 
 DrawingArea::~DrawingArea()
 {
+    // Cancel any in-flight job and wait for it before members go away
+    ++regenerationGeneration;
+    regenerationPool.waitForDone();
     delete d_ptr;
 }
 
@@ -87,85 +215,282 @@ void DrawingArea::setParameters(int outerRadius, int innerRadius, int penOffset,
     }
 }
 
+void DrawingArea::setSampling(const SpiroSampling &sampling)
+{
+    this->sampling = sampling;
+}
+
+SpiroParameters DrawingArea::spiroParameters() const
+{
+    SpiroParameters params;
+    params.outerRadius = outerRadius;
+    params.innerRadius = innerRadius;
+    params.penOffset = penOffset;
+    params.rotations = rotations;
+    params.numPens = numPens;
+    params.rotationOffset = rotationOffset;
+    return params;
+}
+
 void DrawingArea::generateSpirograph()
 {
-    spirographPaths.clear();
-    spirographPaths.resize(numPens);
-
-    double outerRadiusD = static_cast<double>(outerRadius);
-    double innerRadiusD = static_cast<double>(innerRadius);
-    double penOffsetD = static_cast<double>(penOffset);
-    double rotationOffsetRad = rotationOffset * M_PI / 180.0;
-
-    for (int pen = 0; pen < numPens; ++pen) {
-        QPainterPath &path = spirographPaths[pen];
-        path = QPainterPath();
-
-        double t = 0.0;
-        double stepSize = 0.01;
-        int maxSteps = static_cast<int>(2 * M_PI / stepSize) * rotations;
-        
-        double penAngleOffset = 2 * M_PI * pen / numPens + rotationOffsetRad;
-
-        for (int i = 0; i <= maxSteps; ++i) {
-            double x = (outerRadiusD - innerRadiusD) * qCos(t) + 
-                       penOffsetD * qCos(((outerRadiusD - innerRadiusD) * t / innerRadiusD) + penAngleOffset);
-            double y = (outerRadiusD - innerRadiusD) * qSin(t) - 
-                       penOffsetD * qSin(((outerRadiusD - innerRadiusD) * t / innerRadiusD) + penAngleOffset);
-
-            if (i == 0) {
-                path.moveTo(x, y);
-            } else {
-                path.lineTo(x, y);
+    // Supersedes any background job still running
+    ++regenerationGeneration;
+    SpiroGenerator generator(spiroParameters(), sampling);
+    setPattern(buildPattern(generator, rotations, machineConfig));
+}
+
+
+void DrawingArea::generateSpirographStep(int step)
+{
+    ++regenerationGeneration;
+    SpiroGenerator generator(spiroParameters(), sampling);
+    setPattern(buildPattern(generator, step, machineConfig));
+}
+
+void DrawingArea::requestRegeneration()
+{
+    ++regenerationGeneration;
+    if (regenerationRunning) {
+        regenerationPending = true;
+        return;
+    }
+    startRegeneration();
+}
+
+void DrawingArea::startRegeneration()
+{
+    regenerationRunning = true;
+    regenerationPending = false;
+
+    quint64 generation = regenerationGeneration.load();
+    SpiroParameters params = spiroParameters();
+    SpiroSampling jobSampling = sampling;
+    int jobRotations = rotations;
+    GcodeGenerator::Config machine = machineConfig;
+
+    regenerationPool.start([this, generation, params, jobSampling, jobRotations, machine]() {
+        SpiroGenerator generator(params, jobSampling);
+        generator.setCancelCheck([this, generation]() {
+            return regenerationGeneration.load() != generation;
+        });
+
+        std::shared_ptr<GeneratedPattern> pattern = buildPattern(generator, jobRotations, machine);
+        if (generator.isCancelled()) {
+            pattern.reset();
+        }
+
+        QMetaObject::invokeMethod(this, [this, generation, pattern]() {
+            finishRegeneration(generation, pattern);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void DrawingArea::finishRegeneration(quint64 generation, std::shared_ptr<GeneratedPattern> pattern)
+{
+    regenerationRunning = false;
+
+    if (pattern && generation == regenerationGeneration.load()) {
+        setPattern(pattern);
+    }
+    if (regenerationPending) {
+        startRegeneration();
+    }
+}
+
+void DrawingArea::setMachineConfig(const GcodeGenerator::Config &config)
+{
+    machineConfig = config;
+    if (regenerationRunning) {
+        // The running job estimates with the old config
+        requestRegeneration();
+    } else if (!incrementalGenerator && !patternPaths.empty()) {
+        startPlotTimeEstimate();
+    }
+}
+
+void DrawingArea::startPlotTimeEstimate()
+{
+    patternPlotTime = -1.0;
+    quint64 generation = regenerationGeneration.load();
+    quint64 estimate = ++plotTimeGeneration;
+    auto superseded = [this, generation, estimate]() {
+        return regenerationGeneration.load() != generation || plotTimeGeneration.load() != estimate;
+    };
+
+    // Queued behind any regeneration, which would supersede it anyway
+    PatternExporter pattern = exporter();
+    GcodeGenerator::Config machine = machineConfig;
+    regenerationPool.start([this, pattern, machine, superseded]() {
+        double seconds = pattern.estimatePlotTime(machine, superseded);
+        QMetaObject::invokeMethod(this, [this, seconds, superseded]() {
+            if (!superseded() && seconds >= 0.0) {
+                patternPlotTime = seconds;
+                emit plotTimeEstimated();
             }
+        }, Qt::QueuedConnection);
+    });
+    emit plotTimeEstimated();
+}
+
+void DrawingArea::beginIncrementalAnimation()
+{
+    // Drop any background result that would replace the animated pattern
+    ++regenerationGeneration;
+    regenerationPending = false;
+
+    incrementalGenerator.reset(new SpiroIncrementalGenerator(spiroParameters(), sampling));
+    ++currentPatternId;
+    patternPaths.clear();
+    patternParameters = spiroParameters();
+    patternSampling = sampling;
+    patternRotations = 0;
+    patternLength = 0.0;
+    patternBounds = SpiroBounds();
+    // Estimating every step would plan the whole pattern again each time;
+    // it is done once the animation ends
+    patternPlotTime = -1.0;
+    ++plotTimeGeneration;
+    lodPaths.clear();
+    lodTolerances.clear();
+    segmentIndex.clear();
+    crossingMap = SpiroIntersectionMap();
+    updateHover();
+    invalidatePattern(false);
+
+    calculateBoundingBoxAndZoom();
+    update();
+}
+
+bool DrawingArea::advanceIncrementalAnimation(double targetRotations, int budgetMs)
+{
+    if (!incrementalGenerator) {
+        return true;
+    }
+
+    std::vector<std::size_t> previousSizes;
+    for (const auto& path : patternPaths) {
+        previousSizes.push_back(path.size());
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(budgetMs);
+    bool reached = incrementalGenerator->advanceTo(targetRotations, deadline, patternPaths);
 
-            t += stepSize;
+    // Only the newly appended samples are measured; the animation produces a
+    // single stroke per pen
+    for (std::size_t pen = 0; pen < patternPaths.size(); ++pen) {
+        const SpiroPathBuffer &path = patternPaths[pen];
+        const float *x = path.x();
+        const float *y = path.y();
+        std::size_t begin = pen < previousSizes.size() ? previousSizes[pen] : 0;
+
+        for (std::size_t i = begin; i < path.size(); ++i) {
+            if (i > 0) {
+                patternLength += std::hypot(x[i] - x[i - 1], y[i] - y[i - 1]);
+            }
+            patternBounds.include(x[i], y[i]);
         }
     }
+    patternRotations = static_cast<int>(std::ceil(incrementalGenerator->rotationsDone()));
+    invalidatePattern(true);
 
     calculateBoundingBoxAndZoom();
     update();
     emit spirographUpdated();
+    return reached;
 }
 
+void DrawingArea::endIncrementalAnimation()
+{
+    incrementalGenerator.reset();
+
+    // The paths are final again
+    SPIRO_PROFILE_SCOPE("pattern.index");
+    segmentIndex.build(patternPaths);
+    crossingMap = segmentIndex.intersections(patternPaths, crossingMapSize, crossingMapSize);
+    updateHover();
+    startPlotTimeEstimate();
+}
 
-void DrawingArea::generateSpirographStep(int step)
+std::shared_ptr<DrawingArea::GeneratedPattern> DrawingArea::buildPattern(const SpiroGenerator &generator, int rotations,
+                                                                         const GcodeGenerator::Config &machine)
 {
-    spirographPaths.clear();
-    spirographPaths.resize(numPens);
-
-    double outerRadiusD = static_cast<double>(outerRadius);
-    double innerRadiusD = static_cast<double>(innerRadius);
-    double penOffsetD = static_cast<double>(penOffset);
-    double rotationOffsetRad = rotationOffset * M_PI / 180.0;
-
-    for (int pen = 0; pen < numPens; ++pen) {
-        QPainterPath &path = spirographPaths[pen];
-        path = QPainterPath();
-
-        double t = 0.0;
-        double stepSize = 0.01;
-        int maxSteps = static_cast<int>(2 * M_PI / stepSize) * step;
-        
-        double penAngleOffset = 2 * M_PI * pen / numPens + rotationOffsetRad;
-
-        for (int i = 0; i <= maxSteps; ++i) {
-            double x = (outerRadiusD - innerRadiusD) * qCos(t) + 
-                       penOffsetD * qCos((outerRadiusD - innerRadiusD) * t / innerRadiusD + penAngleOffset);
-            double y = (outerRadiusD - innerRadiusD) * qSin(t) - 
-                       penOffsetD * qSin((outerRadiusD - innerRadiusD) * t / innerRadiusD + penAngleOffset);
-
-            if (i == 0) {
-                path.moveTo(x, y);
-            } else {
-                path.lineTo(x, y);
-            }
+    auto pattern = std::make_shared<GeneratedPattern>();
+    // Designs visited before come straight from the cache
+    std::shared_ptr<const SpiroGeometry> geometry = SpiroGeometryCache::instance().generate(generator, rotations);
+    const std::vector<SpiroPolyline> &polylines = *geometry;
+    pattern->parameters = generator.parameters();
+    pattern->sampling = generator.sampling();
+    pattern->rotations = rotations;
+    pattern->pathLength = 0.0;
+    pattern->plotTime = -1.0;
+    if (generator.isCancelled()) {
+        return pattern;
+    }
 
-            t += stepSize;
+    // Measure in double precision, then keep only the compact copy
+    {
+        SPIRO_PROFILE_SCOPE("pattern.measure");
+        pattern->pathLength = totalPathLength(polylines);
+        pattern->bounds = boundsOf(polylines);
+        pattern->paths.resize(polylines.size());
+        for (std::size_t pen = 0; pen < polylines.size(); ++pen) {
+            pattern->paths[pen].appendStroke(polylines[pen]);
+        }
+    }
+
+    double extent = std::max(pattern->bounds.width(), pattern->bounds.height());
+    if (extent > 0.0) {
+        SPIRO_PROFILE_SCOPE("pattern.lod");
+        double finestTolerance = extent * lodFinestFraction;
+        for (const auto& polyline : polylines) {
+            SpiroLodPyramid pyramid;
+            pyramid.build(polyline, finestTolerance, lodLevelCount);
+
+            QVector<QPainterPath> levels;
+            for (int level = 0; level < pyramid.levelCount(); ++level) {
+                levels.append(toPainterPath(pyramid.level(level)));
+                if (pattern->lodTolerances.size() < pyramid.levelCount()) {
+                    pattern->lodTolerances.append(pyramid.tolerance(level));
+                }
+            }
+            pattern->lodPaths.append(levels);
         }
     }
 
+    {
+        SPIRO_PROFILE_SCOPE("pattern.index");
+        pattern->segmentIndex.build(pattern->paths);
+        pattern->crossings = pattern->segmentIndex.intersections(pattern->paths, crossingMapSize, crossingMapSize);
+    }
+
+    // Fits and plans the moves of the whole export, so it belongs here
+    // rather than on the GUI thread
+    PatternExporter exporter(pattern->parameters, pattern->sampling, rotations, pattern->paths, 0.0);
+    pattern->plotTime = exporter.estimatePlotTime(machine, [&generator]() { return generator.isCancelled(); });
+    return pattern;
+}
+
+void DrawingArea::setPattern(std::shared_ptr<GeneratedPattern> pattern)
+{
+    ++currentPatternId;
+    patternPaths = std::move(pattern->paths);
+    patternParameters = pattern->parameters;
+    patternSampling = pattern->sampling;
+    patternRotations = pattern->rotations;
+    patternLength = pattern->pathLength;
+    patternBounds = pattern->bounds;
+    lodPaths = std::move(pattern->lodPaths);
+    lodTolerances = std::move(pattern->lodTolerances);
+    // The index refers to the paths by position, which the moves keep
+    segmentIndex = std::move(pattern->segmentIndex);
+    crossingMap = std::move(pattern->crossings);
+    patternPlotTime = pattern->plotTime;
+    ++plotTimeGeneration;
+    invalidatePattern(false);
+
     calculateBoundingBoxAndZoom();
+    updateHover();
     update();
     emit spirographUpdated();
 }
@@ -173,10 +498,136 @@ void DrawingArea::generateSpirographStep(int step)
 void DrawingArea::paintEvent(QPaintEvent *event)
 {
     Q_UNUSED(event);
+    SPIRO_PROFILE_SCOPE("paint");
+
+    updatePatternCache();
 
     QPainter painter(this);
+    painter.drawPixmap(0, 0, patternCache);
+
     painter.setRenderHint(QPainter::Antialiasing, true);
+    applyPatternTransform(painter);
+
+    // Draw the gears
+    drawGears(painter);
 
+    if (hoverActive) {
+        painter.resetTransform();
+        drawHoverReadout(painter);
+    }
+    if (performanceOverlayVisible) {
+        painter.resetTransform();
+        drawPerformanceOverlay(painter);
+    }
+}
+
+void DrawingArea::setPerformanceOverlayVisible(bool visible)
+{
+    performanceOverlayVisible = visible;
+    if (visible) {
+        performanceOverlayTimer->start();
+    } else {
+        performanceOverlayTimer->stop();
+    }
+    update();
+}
+
+void DrawingArea::drawPerformanceOverlay(QPainter &painter)
+{
+    drawTextPanel(painter, performanceSummary(), QPoint(6, 6));
+}
+
+void DrawingArea::setHoverReadoutEnabled(bool enabled)
+{
+    hoverReadoutEnabled = enabled;
+    setMouseTracking(enabled);
+    hoverPosition = mapFromGlobal(QCursor::pos());
+    updateHover();
+}
+
+void DrawingArea::mouseMoveEvent(QMouseEvent *event)
+{
+    hoverPosition = event->position();
+    updateHover();
+    QWidget::mouseMoveEvent(event);
+}
+
+void DrawingArea::leaveEvent(QEvent *event)
+{
+    if (hoverActive) {
+        hoverActive = false;
+        update();
+    }
+    QWidget::leaveEvent(event);
+}
+
+void DrawingArea::updateHover()
+{
+    bool wasActive = hoverActive;
+    hoverActive = false;
+    if (hoverReadoutEnabled && underMouse() && !segmentIndex.empty() && zoomFactor > 0.0) {
+        // Inverse of applyPatternTransform
+        QPointF point = (hoverPosition - QPointF(width() / 2, height() / 2)) / zoomFactor + boundingBox.center();
+        hoverPoint = segmentIndex.nearest(patternPaths, point.x(), point.y(), hoverSnapPixels / zoomFactor);
+        hoverActive = hoverPoint.found;
+    }
+
+    if (hoverActive) {
+        // Consecutive segments of a pen belong to the same line
+        double half = hoverPassPixels / zoomFactor;
+        SpiroBounds area;
+        area.include(hoverPoint.x - half, hoverPoint.y - half);
+        area.include(hoverPoint.x + half, hoverPoint.y + half);
+        std::vector<SpiroSegmentRef> segments;
+        segmentIndex.segmentsInRect(patternPaths, area, segments);
+        std::sort(segments.begin(), segments.end(), [](const SpiroSegmentRef &a, const SpiroSegmentRef &b) {
+            return a.pen != b.pen ? a.pen < b.pen : a.vertex < b.vertex;
+        });
+        hoverPasses = 0;
+        for (std::size_t i = 0; i < segments.size(); ++i) {
+            if (i == 0 || segments[i].pen != segments[i - 1].pen || segments[i].vertex != segments[i - 1].vertex + 1) {
+                ++hoverPasses;
+            }
+        }
+    }
+
+    if (hoverActive || wasActive) {
+        update();
+    }
+}
+
+void DrawingArea::drawHoverReadout(QPainter &painter)
+{
+    const int pen = static_cast<int>(hoverPoint.segment.pen);
+    QPointF marker = (QPointF(hoverPoint.x, hoverPoint.y) - boundingBox.center()) * zoomFactor
+                     + QPointF(width() / 2, height() / 2);
+    painter.setPen(QPen(palette().color(QPalette::Text), 1.5));
+    painter.setBrush(penColors.value(pen, Qt::black));
+    painter.drawEllipse(marker, 4.0, 4.0);
+    painter.setBrush(Qt::NoBrush);
+
+    QStringList lines;
+    lines << QString("Pen %1 at (%2, %3)").arg(pen + 1).arg(hoverPoint.x, 0, 'f', 1).arg(hoverPoint.y, 0, 'f', 1);
+    lines << (hoverPasses == 1 ? QString("1 line passes here") : QString("%1 lines pass here").arg(hoverPasses));
+    if (crossingMap.total > 0) {
+        double average = static_cast<double>(crossingMap.total) / crossingMap.counts.size();
+        std::uint32_t nearby = crossingMap.countAt(hoverPoint.x, hoverPoint.y);
+        lines << QString("%1 crossings nearby, %2x average").arg(nearby).arg(nearby / average, 0, 'f', 1);
+        lines << QString("%1 crossings in all").arg(static_cast<qulonglong>(crossingMap.total));
+    } else {
+        lines << "No crossings";
+    }
+    drawTextPanel(painter, lines, hoverPosition.toPoint() + QPoint(16, 16), rect());
+}
+
+void DrawingArea::resizeEvent(QResizeEvent *event)
+{
+    QWidget::resizeEvent(event);
+    calculateBoundingBoxAndZoom();
+}
+
+void DrawingArea::applyPatternTransform(QPainter &painter) const
+{
     // Center the spirograph
     painter.translate(width() / 2, height() / 2);
 
@@ -185,53 +636,97 @@ void DrawingArea::paintEvent(QPaintEvent *event)
 
     // Center the spirograph within its bounding box
     painter.translate(-boundingBox.center());
+}
 
-    // Draw the spirograph
-    for (int i = 0; i < spirographPaths.size(); ++i) {
-        painter.setPen(QPen(penColors[i], lineThickness / zoomFactor));
-        painter.drawPath(spirographPaths[i]);
-    }
-
-    // Draw the gears
-    drawGears(painter);
+bool DrawingArea::PatternCacheKey::sameView(const PatternCacheKey &other) const
+{
+    return size == other.size && devicePixelRatio == other.devicePixelRatio && zoomFactor == other.zoomFactor
+        && center == other.center && lineThickness == other.lineThickness;
 }
 
-void DrawingArea::generatePenColors()
+void DrawingArea::invalidatePattern(bool appendOnly)
 {
-    penColors.clear();
-    for (int i = 0; i < numPens; ++i) {
-        penColors.append(QColor::fromHsv(i * 360 / numPens, 255, 255));
+    ++patternSerial;
+    // Stays append-only only if every change since the last rasterization was
+    if (!appendOnly) {
+        patternAppendOnly = false;
     }
 }
 
-bool DrawingArea::exportToSVG(const QString &filename) const
+QPainterPath DrawingArea::displayPath(int pen) const
 {
-    QSvgGenerator generator;
-    generator.setFileName(filename);
-    generator.setSize(QSize(width(), height()));
-    generator.setViewBox(QRect(0, 0, width(), height()));
-    generator.setTitle("SpiroBot SVG Export");
-    generator.setDescription("Spirograph pattern generated by SpiroBot");
+    // Coarsest level that stays within half a device pixel at this zoom
+    double maxTolerance = 0.5 / (zoomFactor * devicePixelRatioF());
+    if (pen < lodPaths.size()) {
+        for (int level = lodTolerances.size() - 1; level >= 0; --level) {
+            if (lodTolerances[level] <= maxTolerance && level < lodPaths[pen].size()) {
+                return lodPaths[pen][level];
+            }
+        }
+    }
+    return PatternExporter::toPainterPath(patternPaths[pen]);
+}
 
-    QPainter painter;
-    if (!painter.begin(&generator)) {
-        return false;  // Failed to start painting
+void DrawingArea::updatePatternCache()
+{
+    PatternCacheKey key;
+    key.serial = patternSerial;
+    key.size = size();
+    key.devicePixelRatio = devicePixelRatioF();
+    key.zoomFactor = zoomFactor;
+    key.center = boundingBox.center();
+    key.lineThickness = lineThickness;
+
+    bool sameView = !patternCache.isNull() && key.sameView(patternCacheKey);
+    if (sameView && key.serial == patternCacheKey.serial) {
+        return;
+    }
+    SPIRO_PROFILE_SCOPE("paint.rasterize");
+
+    bool append = sameView && patternAppendOnly && cachedVertexCounts.size() == patternPaths.size();
+    if (!append) {
+        patternCache = QPixmap(key.size * key.devicePixelRatio);
+        patternCache.setDevicePixelRatio(key.devicePixelRatio);
+        patternCache.fill(Qt::transparent);
+        cachedVertexCounts.assign(patternPaths.size(), 0);
     }
 
-    // Set up the painter similar to the paintEvent
+    QPainter painter(&patternCache);
     painter.setRenderHint(QPainter::Antialiasing, true);
-    painter.translate(width() / 2, height() / 2);
-    double scale = std::min(width(), height()) / (2.0 * outerRadius);
-    painter.scale(scale, scale);
+    applyPatternTransform(painter);
 
     // Draw the spirograph
-    for (int i = 0; i < spirographPaths.size(); ++i) {
-        painter.setPen(QPen(penColors[i], lineThickness / scale));
-        painter.drawPath(spirographPaths[i]);
+    for (int i = 0; i < static_cast<int>(patternPaths.size()); ++i) {
+        painter.setPen(QPen(penColors.value(i, Qt::black), lineThickness / zoomFactor));
+
+        const SpiroPathBuffer &path = patternPaths[i];
+        std::size_t begin = cachedVertexCounts[i];
+        if (begin == 0) {
+            painter.drawPath(displayPath(i));
+        } else if (begin < path.size()) {
+            painter.drawPath(PatternExporter::toPainterPath(path, begin));
+        }
+        cachedVertexCounts[i] = path.size();
     }
-
     painter.end();
-    return true;
+
+    patternCacheKey = key;
+    patternAppendOnly = true;
+}
+
+void DrawingArea::generatePenColors()
+{
+    penColors = PatternExporter::penColors(numPens);
+}
+
+PatternExporter DrawingArea::exporter() const
+{
+    return PatternExporter(patternParameters, patternSampling, patternRotations, patternPaths, lineThickness);
+}
+
+bool DrawingArea::exportToSVG(const QString &filename) const
+{
+    return exporter().exportToSVG(filename, size());
 }
 
 bool DrawingArea::exportToPNG(const QString &filename, int width, int height) const
@@ -240,56 +735,37 @@ bool DrawingArea::exportToPNG(const QString &filename, int width, int height) co
     if (width <= 0) width = this->width();
     if (height <= 0) height = this->height();
 
-    QImage image(width, height, QImage::Format_ARGB32);
-    image.fill(Qt::white);  // Fill with white background
-
-    QPainter painter(&image);
-    painter.setRenderHint(QPainter::Antialiasing, true);
-    painter.translate(width / 2, height / 2);
-    double scale = std::min(width, height) / (2.0 * outerRadius);
-    painter.scale(scale, scale);
-
-    // Draw the spirograph
-    for (int i = 0; i < spirographPaths.size(); ++i) {
-        painter.setPen(QPen(penColors[i], lineThickness / scale));
-        painter.drawPath(spirographPaths[i]);
-    }
-
-    painter.end();
-
-    return image.save(filename, "PNG");
+    return exporter().exportToPNG(filename, QSize(width, height));
 }
 
 bool DrawingArea::exportToGcode(const QString &filename, const GcodeGenerator::Config& config) const
 {
-    return d_ptr->gcodeGenerator->generateGcode(spirographPaths, config, filename);
+    return exporter().exportToGcode(filename, config);
+}
+
+std::function<bool()> DrawingArea::prepareGcodeExport(const QString &filename, const GcodeGenerator::Config& config,
+                                                      std::function<void(double)> progress,
+                                                      std::function<bool()> cancelCheck,
+                                                      GcodeExportStats *stats) const
+{
+    return exporter().prepareGcodeExport(filename, config, std::move(progress), std::move(cancelCheck), stats);
 }
 
 double DrawingArea::calculateTotalPathLength() const
 {
-    double totalLength = 0.0;
-    for (const auto& path : spirographPaths) {
-        for (int i = 1; i < path.elementCount(); ++i) {
-            QPointF p1 = path.elementAt(i - 1);
-            QPointF p2 = path.elementAt(i);
-            totalLength += QLineF(p1, p2).length();
-        }
-    }
-    return totalLength;
+    return patternLength;
 }
 
 void DrawingArea::calculateBoundingBoxAndZoom()
 {
-    if (spirographPaths.isEmpty()) {
+    if (!patternBounds.isValid()) {
         boundingBox = QRectF();
         zoomFactor = 1.0;
         return;
     }
 
-    boundingBox = spirographPaths[0].boundingRect();
-    for (int i = 1; i < spirographPaths.size(); ++i) {
-        boundingBox = boundingBox.united(spirographPaths[i].boundingRect());
-    }
+    boundingBox = QRectF(QPointF(patternBounds.minX, patternBounds.minY),
+                         QPointF(patternBounds.maxX, patternBounds.maxY));
 
     // Add a small margin (5% on each side)
     double margin = std::max(boundingBox.width(), boundingBox.height()) * 0.05;
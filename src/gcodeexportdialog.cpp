@@ -1,22 +1,19 @@
 #include "gcodeexportdialog.h"
 #include "gcodegenerator.h"
+#include "machineprofile.h"
 
 #include <QVBoxLayout>
 #include <QFormLayout>
 #include <QDoubleSpinBox>
+#include <QSpinBox>
+#include <QCheckBox>
+#include <QHBoxLayout>
 #include <QDialogButtonBox>
 #include <QPushButton>
 #include <QLabel>
 #include <QComboBox>
 #include <QPlainTextEdit>
-#include <QJsonDocument>
-#include <QJsonObject>
-#include <QJsonArray>
-#include <QFile>
-#include <QDir>
-#include <QCoreApplication>
 #include <QDebug>
-#include <QStandardPaths>
 
 GcodeExportDialog::GcodeExportDialog(QWidget *parent)
     : QDialog(parent)
@@ -92,6 +89,66 @@ GcodeExportDialog::GcodeExportDialog(QWidget *parent)
     originComboBox->addItem(tr("Center"), static_cast<int>(GcodeGenerator::Origin::Center));
     formLayout->addRow(tr("Origin:"), originComboBox);
 
+    // Merge Tolerance
+    mergeToleranceSpinBox = new QDoubleSpinBox(this);
+    mergeToleranceSpinBox->setRange(0, 1);
+    mergeToleranceSpinBox->setDecimals(3);
+    mergeToleranceSpinBox->setSingleStep(0.005);
+    mergeToleranceSpinBox->setValue(0.01);
+    mergeToleranceSpinBox->setSuffix(" mm");
+    mergeToleranceSpinBox->setSpecialValueText(tr("Off"));
+    formLayout->addRow(tr("Merge Tolerance:"), mergeToleranceSpinBox);
+
+    // Arc Fit Tolerance
+    arcToleranceSpinBox = new QDoubleSpinBox(this);
+    arcToleranceSpinBox->setRange(0, 1);
+    arcToleranceSpinBox->setDecimals(3);
+    arcToleranceSpinBox->setSingleStep(0.005);
+    arcToleranceSpinBox->setValue(0.01);
+    arcToleranceSpinBox->setSuffix(" mm");
+    arcToleranceSpinBox->setSpecialValueText(tr("Off"));
+    formLayout->addRow(tr("Arc Fit Tolerance:"), arcToleranceSpinBox);
+
+    // Stroke ordering
+    optimizeTravelCheckBox = new QCheckBox(tr("Minimize pen-up travel"), this);
+    optimizeTravelCheckBox->setChecked(true);
+    formLayout->addRow(tr("Stroke Order:"), optimizeTravelCheckBox);
+
+    // Modal compression
+    modalCompressionCheckBox = new QCheckBox(tr("Omit repeated words"), this);
+    modalCompressionCheckBox->setChecked(true);
+    formLayout->addRow(tr("Compact Output:"), modalCompressionCheckBox);
+
+    // Feed planning
+    planFeedsCheckBox = new QCheckBox(tr("Limit feeds to reachable speeds"), this);
+    planFeedsCheckBox->setChecked(true);
+    formLayout->addRow(tr("Feed Planning:"), planFeedsCheckBox);
+
+    // Junction Deviation
+    junctionDeviationSpinBox = new QDoubleSpinBox(this);
+    junctionDeviationSpinBox->setRange(0.001, 1);
+    junctionDeviationSpinBox->setDecimals(3);
+    junctionDeviationSpinBox->setSingleStep(0.005);
+    junctionDeviationSpinBox->setValue(0.01);
+    junctionDeviationSpinBox->setSuffix(" mm");
+    formLayout->addRow(tr("Junction Deviation:"), junctionDeviationSpinBox);
+    connect(planFeedsCheckBox, &QCheckBox::toggled, junctionDeviationSpinBox, &QWidget::setEnabled);
+
+    // Decimals per axis
+    QHBoxLayout *precisionLayout = new QHBoxLayout();
+    xPrecisionSpinBox = new QSpinBox(this);
+    yPrecisionSpinBox = new QSpinBox(this);
+    zPrecisionSpinBox = new QSpinBox(this);
+    for (QSpinBox *spinBox : { xPrecisionSpinBox, yPrecisionSpinBox, zPrecisionSpinBox }) {
+        spinBox->setRange(0, 6);
+        spinBox->setValue(3);
+        precisionLayout->addWidget(spinBox);
+    }
+    xPrecisionSpinBox->setPrefix("X ");
+    yPrecisionSpinBox->setPrefix("Y ");
+    zPrecisionSpinBox->setPrefix("Z ");
+    formLayout->addRow(tr("Decimals:"), precisionLayout);
+
     mainLayout->addLayout(formLayout);
 
     // Start Gcode
@@ -126,111 +183,8 @@ GcodeExportDialog::GcodeExportDialog(QWidget *parent)
 void GcodeExportDialog::loadConfigurationFromFile()
 {
     qDebug() << "Attempting to load configuration file...";
+    setConfig(MachineProfile::load());
 
-    // Try to find the config file in multiple locations
-    QStringList searchPaths = {
-        QCoreApplication::applicationDirPath() + "/../config.json",
-        QCoreApplication::applicationDirPath() + "/config.json",
-        QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/config.json"
-    };
-
-    QString configPath;
-    for (const auto &path : searchPaths) {
-        qDebug() << "Checking for config file at:" << path;
-        if (QFile::exists(path)) {
-            configPath = path;
-            break;
-        }
-    }
-
-    if (configPath.isEmpty()) {
-        qWarning() << "Configuration file not found in any of the search paths";
-        return;
-    }
-
-    qDebug() << "Found config file at:" << configPath;
-
-    QFile configFile(configPath);
-    if (!configFile.open(QIODevice::ReadOnly)) {
-        qWarning() << "Couldn't open configuration file:" << configFile.errorString();
-        return;
-    }
-
-    qDebug() << "Config file opened successfully";
-
-    QByteArray saveData = configFile.readAll();
-    qDebug() << "Read" << saveData.size() << "bytes from config file";
-
-    QJsonParseError parseError;
-    QJsonDocument loadDoc = QJsonDocument::fromJson(saveData, &parseError);
-    
-    if (loadDoc.isNull()) {
-        qWarning() << "Failed to parse JSON from config file:" << parseError.errorString();
-        return;
-    }
-
-    qDebug() << "JSON parsed successfully";
-
-    QJsonObject json = loadDoc.object();
-
-    qDebug() << "JSON object created, keys:" << json.keys().join(", ");
-
-    // Load default values with error checking
-    if (json.contains("defaultDrawingAreaWidth")) {
-        qDebug() << "Setting defaultDrawingAreaWidth";
-        drawingAreaWidthSpinBox->setValue(json["defaultDrawingAreaWidth"].toDouble(200));
-    }
-    if (json.contains("defaultDrawingAreaHeight")) {
-        qDebug() << "Setting defaultDrawingAreaHeight";
-        drawingAreaHeightSpinBox->setValue(json["defaultDrawingAreaHeight"].toDouble(200));
-    }
-    if (json.contains("defaultMaxSpeed")) {
-        qDebug() << "Setting defaultMaxSpeed";
-        maxSpeedSpinBox->setValue(json["defaultMaxSpeed"].toDouble(3000));
-    }
-    if (json.contains("defaultMaxAcceleration")) {
-        qDebug() << "Setting defaultMaxAcceleration";
-        maxAccelerationSpinBox->setValue(json["defaultMaxAcceleration"].toDouble(500));
-    }
-    if (json.contains("defaultPenUpPosition")) {
-        qDebug() << "Setting defaultPenUpPosition";
-        penUpPositionSpinBox->setValue(json["defaultPenUpPosition"].toDouble(5));
-    }
-    if (json.contains("defaultPenDownPosition")) {
-        qDebug() << "Setting defaultPenDownPosition";
-        penDownPositionSpinBox->setValue(json["defaultPenDownPosition"].toDouble(-1));
-    }
-    if (json.contains("defaultTravelSpeed")) {
-        qDebug() << "Setting defaultTravelSpeed";
-        travelSpeedSpinBox->setValue(json["defaultTravelSpeed"].toDouble(3000));
-    }
-    if (json.contains("defaultDrawingSpeed")) {
-        qDebug() << "Setting defaultDrawingSpeed";
-        drawingSpeedSpinBox->setValue(json["defaultDrawingSpeed"].toDouble(1500));
-    }
-
-    // Load default Gcodes
-    if (json.contains("defaultStartGcode")) {
-        qDebug() << "Setting defaultStartGcode";
-        QJsonArray startGcodeArray = json["defaultStartGcode"].toArray();
-        QString startGcode;
-        for (const auto &line : startGcodeArray) {
-            startGcode += line.toString() + "\n";
-        }
-        startGcodeEdit->setPlainText(startGcode);
-    }
-
-    if (json.contains("defaultEndGcode")) {
-        qDebug() << "Setting defaultEndGcode";
-        QJsonArray endGcodeArray = json["defaultEndGcode"].toArray();
-        QString endGcode;
-        for (const auto &line : endGcodeArray) {
-            endGcode += line.toString() + "\n";
-        }
-        endGcodeEdit->setPlainText(endGcode);
-    }
-
-    qDebug() << "Configuration loaded successfully from:" << configPath;
     qDebug() << "Loaded values:";
     qDebug() << "  Drawing Area Width:" << drawingAreaWidthSpinBox->value();
     qDebug() << "  Drawing Area Height:" << drawingAreaHeightSpinBox->value();
@@ -240,6 +194,13 @@ void GcodeExportDialog::loadConfigurationFromFile()
     qDebug() << "  Pen Down Position:" << penDownPositionSpinBox->value();
     qDebug() << "  Travel Speed:" << travelSpeedSpinBox->value();
     qDebug() << "  Drawing Speed:" << drawingSpeedSpinBox->value();
+    qDebug() << "  Merge Tolerance:" << mergeToleranceSpinBox->value();
+    qDebug() << "  Arc Tolerance:" << arcToleranceSpinBox->value();
+    qDebug() << "  Optimize Travel:" << optimizeTravelCheckBox->isChecked();
+    qDebug() << "  Modal Compression:" << modalCompressionCheckBox->isChecked();
+    qDebug() << "  Decimals X/Y/Z:" << xPrecisionSpinBox->value() << yPrecisionSpinBox->value() << zPrecisionSpinBox->value();
+    qDebug() << "  Plan Feeds:" << planFeedsCheckBox->isChecked();
+    qDebug() << "  Junction Deviation:" << junctionDeviationSpinBox->value();
     qDebug() << "  Start Gcode:" << startGcodeEdit->toPlainText();
     qDebug() << "  End Gcode:" << endGcodeEdit->toPlainText();
 }
@@ -258,5 +219,38 @@ GcodeGenerator::Config GcodeExportDialog::getConfig() const
     config.origin = static_cast<GcodeGenerator::Origin>(originComboBox->currentData().toInt());
     config.startGcode = startGcodeEdit->toPlainText();
     config.endGcode = endGcodeEdit->toPlainText();
+    config.mergeTolerance = mergeToleranceSpinBox->value();
+    config.arcTolerance = arcToleranceSpinBox->value();
+    config.optimizeTravel = optimizeTravelCheckBox->isChecked();
+    config.modalCompression = modalCompressionCheckBox->isChecked();
+    config.xPrecision = xPrecisionSpinBox->value();
+    config.yPrecision = yPrecisionSpinBox->value();
+    config.zPrecision = zPrecisionSpinBox->value();
+    config.planFeeds = planFeedsCheckBox->isChecked();
+    config.junctionDeviation = junctionDeviationSpinBox->value();
     return config;
+}
+
+void GcodeExportDialog::setConfig(const GcodeGenerator::Config& config)
+{
+    drawingAreaWidthSpinBox->setValue(config.drawingAreaWidth);
+    drawingAreaHeightSpinBox->setValue(config.drawingAreaHeight);
+    maxSpeedSpinBox->setValue(config.maxSpeed);
+    maxAccelerationSpinBox->setValue(config.maxAcceleration);
+    penUpPositionSpinBox->setValue(config.penUpPosition);
+    penDownPositionSpinBox->setValue(config.penDownPosition);
+    travelSpeedSpinBox->setValue(config.travelSpeed);
+    drawingSpeedSpinBox->setValue(config.drawingSpeed);
+    originComboBox->setCurrentIndex(originComboBox->findData(static_cast<int>(config.origin)));
+    startGcodeEdit->setPlainText(config.startGcode);
+    endGcodeEdit->setPlainText(config.endGcode);
+    mergeToleranceSpinBox->setValue(config.mergeTolerance);
+    arcToleranceSpinBox->setValue(config.arcTolerance);
+    optimizeTravelCheckBox->setChecked(config.optimizeTravel);
+    modalCompressionCheckBox->setChecked(config.modalCompression);
+    xPrecisionSpinBox->setValue(config.xPrecision);
+    yPrecisionSpinBox->setValue(config.yPrecision);
+    zPrecisionSpinBox->setValue(config.zPrecision);
+    planFeedsCheckBox->setChecked(config.planFeeds);
+    junctionDeviationSpinBox->setValue(config.junctionDeviation);
 }
\ No newline at end of file
@@ -1,74 +1,140 @@
 #include "gcodegenerator.h"
-#include <QTextStream>
+#include <QDir>
 #include <QFile>
 #include <QFileInfo>  // Add this line
 #include <QRectF>
 #include <QtMath>
+#include <QDebug>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <mutex>
+#include "spiroplanner.h"
+#include "spiroprofiler.h"
+#include "spirotaskpool.h"
 
-GcodeGenerator::GcodeGenerator() : m_currentPenState(false) {}
+namespace {
+
+// Vertices written between progress reports and cancellation checks
+const std::size_t progressBlockSize = 16384;
+
+// A coordinate as the integer number of output steps it is written as
+long long toSteps(double value, int decimals)
+{
+    static const double powersOfTen[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 };
+    decimals = std::max(0, std::min(decimals, 9));
+    return std::llround(value * powersOfTen[decimals]);
+}
+
+// Controllers reject an arc whose start and end are not the same distance
+// from its centre, allowing only a few micrometres (Grbl: 0.005 mm). With
+// fewer decimals than this, rounding the end point and I/J alone can break
+// that, so arcs raise the XY precision to it
+const int minArcPrecision = 3;
+
+// Fitted moves the feed planner looks ahead over. Braking from drawing speed
+// takes a few millimetres at most, far less than this many moves cover.
+const std::size_t planWindowSize = 4096;
+
+// Planned feeds are rounded down to a multiple of this, in mm/min, so that
+// runs of nearly equal speeds share one F word
+const double feedStep = 10.0;
+
+// Feed in mm/min for a planned peak speed in mm/s, never above limit
+double plannedFeed(double speed, double limit)
+{
+    double feed = std::floor(speed * 60.0 / feedStep + 1e-6) * feedStep;
+    return std::min(limit, std::max(feedStep, feed));
+}
+
+} // namespace
+
+struct GcodeGenerator::ExportProgress
+{
+    std::size_t totalVertices;
+    std::atomic<std::size_t> writtenVertices;
+    std::mutex callbackMutex;
+
+    explicit ExportProgress(std::size_t totalVertices) : totalVertices(totalVertices), writtenVertices(0) {}
+};
+
+GcodeGenerator::GcodeGenerator() {}
+
+void GcodeGenerator::setProgressCallback(std::function<void(double)> callback)
+{
+    m_progressCallback = std::move(callback);
+}
+
+void GcodeGenerator::setCancelCheck(std::function<bool()> check)
+{
+    m_cancelCheck = std::move(check);
+}
+
+bool GcodeGenerator::isCancelled() const
+{
+    return m_cancelCheck && m_cancelCheck();
+}
 
 bool GcodeGenerator::generateGcode(const QVector<QPainterPath>& paths, const Config& config, const QString& filename)
 {
-    try {
-        // Calculate bounding box of all paths
-        QRectF boundingBox;
-        for (const auto& path : paths) {
-            boundingBox = boundingBox.united(path.boundingRect());
+    std::vector<SpiroPathBuffer> buffers(paths.size());
+    for (int penNumber = 0; penNumber < paths.size(); ++penNumber) {
+        const QPainterPath& path = paths[penNumber];
+        SpiroPathBuffer& buffer = buffers[penNumber];
+        buffer.reserve(path.elementCount());
+        for (int i = 0; i < path.elementCount(); ++i) {
+            QPainterPath::Element el = path.elementAt(i);
+            if (el.isMoveTo()) {
+                buffer.moveTo(el.x, el.y);
+            } else if (el.isLineTo()) {
+                buffer.lineTo(el.x, el.y);
+            }
         }
+    }
+    return generateGcode(buffers, config, filename);
+}
 
-        // Calculate scaling factors
-        double scaleX = config.drawingAreaWidth / boundingBox.width();
-        double scaleY = config.drawingAreaHeight / boundingBox.height();
-        double scale = qMin(scaleX, scaleY);
-
-        // Calculate offsets to shift the drawing into positive space
-        double offsetX = -boundingBox.left() * scale;
-        double offsetY = -boundingBox.top() * scale;
-
-        // Generate Gcode for each pen
-        for (int penNumber = 0; penNumber < paths.size(); ++penNumber) {
-            QString penGcode;
-            QTextStream stream(&penGcode);
-
-            // Custom start Gcode
-            stream << config.startGcode << "\n";
-            
-            // Set default feed rate
-            stream << QString("F%1 ; Set default feed rate\n").arg(config.travelSpeed);
-            
-            // Initialize pen to up position
-            stream << setPenPosition(false, config);
-            m_currentPenState = false;
-
-            // Convert path to Gcode
-            if (penNumber < paths.size()) {
-                stream << convertPathToGcode(paths[penNumber], config, boundingBox, scale, offsetX, offsetY);
-            } else {
-                qWarning() << "Attempted to access out-of-bounds path";
-                return false;
-            }
+bool GcodeGenerator::generateGcode(const std::vector<SpiroPathBuffer>& paths, const Config& requestedConfig, const QString& filename)
+{
+    Config config = requestedConfig;
+    if (config.arcTolerance > 0.0) {
+        config.xPrecision = std::max(config.xPrecision, minArcPrecision);
+        config.yPrecision = std::max(config.yPrecision, minArcPrecision);
+    }
 
-            // Custom end Gcode
-            stream << config.endGcode << "\n";
+    try {
+        Placement placement = placementOf(paths, config);
 
-            // Generate filename for this pen
-            QFileInfo fileInfo(filename);
-            QString penFilename = QString("%1_pen%2%3")
+        // One file per pen, named after and placed next to the requested
+        // file. Each depends only on the shared bounding box and scale, so
+        // they are all written at the same time
+        QFileInfo fileInfo(filename);
+        QVector<QString> penFilenames;
+        std::size_t totalVertices = 0;
+        for (int penNumber = 0; penNumber < static_cast<int>(paths.size()); ++penNumber) {
+            penFilenames.append(fileInfo.dir().filePath(QString("%1_pen%2%3")
                                     .arg(fileInfo.completeBaseName())
                                     .arg(penNumber + 1)
-                                    .arg(fileInfo.suffix().isEmpty() ? "" : "." + fileInfo.suffix());
+                                    .arg(fileInfo.suffix().isEmpty() ? "" : "." + fileInfo.suffix())));
+            totalVertices += paths[penNumber].size();
+        }
 
-            // Write to file
-            QFile file(penFilename);
-            if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
-                return false;
+        ExportProgress progress(totalVertices);
+        std::atomic<bool> failed(false);
+        SpiroTaskPool::instance().parallelFor(paths.size(), [&](std::size_t pen) {
+            if (!writePenFile(penFilenames[static_cast<int>(pen)], paths[pen], config, placement, progress)) {
+                failed = true;
             }
+        });
 
-            QTextStream fileStream(&file);
-            fileStream << penGcode;
-            file.close();
+        // Leave no partial set of pen files behind
+        if (failed || isCancelled()) {
+            for (const QString& penFilename : penFilenames) {
+                QFile::remove(penFilename);
+            }
+            return false;
         }
-        
+
         return true;
     } catch (const std::exception& e) {
         qCritical() << "Exception in generateGcode:" << e.what();
@@ -79,53 +145,405 @@ bool GcodeGenerator::generateGcode(const QVector<QPainterPath>& paths, const Con
     }
 }
 
-QString GcodeGenerator::convertPathToGcode(const QPainterPath& path, const Config& config, const QRectF& boundingBox, double scale, double offsetX, double offsetY)
+GcodeGenerator::Placement GcodeGenerator::placementOf(const std::vector<SpiroPathBuffer>& paths, const Config& config)
 {
-    QString gcode;
-    QTextStream stream(&gcode);
+    // Calculate bounding box of all paths
+    SpiroBounds bounds = boundsOf(paths);
+    Placement placement;
+    if (bounds.isValid()) {
+        placement.boundingBox = QRectF(QPointF(bounds.minX, bounds.minY), QPointF(bounds.maxX, bounds.maxY));
+    }
+
+    // Calculate scaling factors
+    double scaleX = config.drawingAreaWidth / placement.boundingBox.width();
+    double scaleY = config.drawingAreaHeight / placement.boundingBox.height();
+    placement.scale = qMin(scaleX, scaleY);
+
+    // Calculate offsets to shift the drawing into positive space
+    placement.offsetX = -placement.boundingBox.left() * placement.scale;
+    placement.offsetY = -placement.boundingBox.top() * placement.scale;
+    return placement;
+}
+
+template <typename TravelFunction, typename DrawFunction>
+bool GcodeGenerator::planPath(const SpiroPathBuffer& path, const Config& config, bool plan, const Placement& placement, ExportProgress& progress,
+                              TravelFunction travel, DrawFunction draw) const
+{
+    SpiroFitSettings fit;
+    fit.mergeTolerance = config.mergeTolerance;
+    fit.arcTolerance = config.arcTolerance;
+    // Arcs are written with at least minArcPrecision decimals, as in
+    // generateGcode; the coarser axis decides
+    const int arcDecimals = std::min(std::max(std::min(config.xPrecision, config.yPrecision), minArcPrecision), 9);
+    fit.outputQuantum = std::pow(10.0, -arcDecimals);
+
+    SpiroMotionLimits limits;
+    limits.maxAcceleration = config.maxAcceleration;
+    limits.junctionDeviation = config.junctionDeviation;
+    const double drawingSpeed = std::min(config.drawingSpeed, config.maxSpeed) / 60.0;
+    const double travelSpeed = std::min(config.travelSpeed, config.maxSpeed) / 60.0;
+
+    // Read the coordinate arrays in place; the first point of each stroke is
+    // a pen-up travel move, the rest are drawn
+    const float *x = path.x();
+    const float *y = path.y();
+    const double scale = placement.scale;
+    auto machinePoint = [&](std::size_t i) {
+        QPointF scaledPoint(x[i] * scale + placement.offsetX, y[i] * scale + placement.offsetY);
+        return applyOriginTransform(scaledPoint, config, placement.boundingBox, scale);
+    };
 
-    for (int i = 0; i < path.elementCount(); ++i) {
-        QPainterPath::Element el = path.elementAt(i);
-        QPointF scaledPoint(el.x * scale + offsetX, el.y * scale + offsetY);
-        QPointF transformedPoint = applyOriginTransform(scaledPoint, config, boundingBox, scale);
-        
-        if (el.isMoveTo()) {
-            stream << moveToPoint(transformedPoint, false, config);
-        } else if (el.isLineTo()) {
-            stream << moveToPoint(transformedPoint, true, config);
+    // A stroke is fitted a block of vertices at a time and planned over a
+    // window of the fitted moves, so memory stays flat however long it is.
+    // The moves at the front of the window are handed on once the rest of it
+    // is long enough to brake to a stop from drawing speed; a stricter end
+    // further on could not slow them any more.
+    const double brakingDistance = plan ? drawingSpeed * drawingSpeed / (2.0 * config.maxAcceleration) : 0.0;
+    std::vector<double> blockX, blockY;
+    std::vector<SpiroMove> fitted;
+    std::vector<SpiroMove> moves;
+    std::vector<SpiroPlanSegment> segments;
+    std::vector<SpiroPlanSegment> travelPlan(1);
+    double entrySpeed = 0.0;
+
+    auto flushWindow = [&](bool strokeEnd) {
+        planMotion(segments, limits, entrySpeed);
+        std::size_t count = segments.size();
+        if (!strokeEnd) {
+            // Keep the braking distance for the next window, but never more
+            // than half of it so that every window makes progress
+            double tail = 0.0;
+            std::size_t keep = 0;
+            while (keep < count / 2 && tail < brakingDistance) {
+                tail += segments[count - 1 - keep].length;
+                ++keep;
+            }
+            count -= keep;
+        }
+        for (std::size_t m = 0; m < count; ++m) {
+            draw(moves[m], plannedFeed(segments[m].peakSpeed, config.drawingSpeed), segments[m].time);
+        }
+        entrySpeed = count > 0 && !strokeEnd ? segments[count - 1].exitSpeed : 0.0;
+        moves.erase(moves.begin(), moves.begin() + count);
+        segments.erase(segments.begin(), segments.begin() + count);
+    };
+
+    bool havePosition = false;
+    QPointF position;
+    std::size_t sinceReport = 0;
+    for (std::size_t stroke = 0; stroke < path.strokeCount(); ++stroke) {
+        std::size_t begin = path.strokeBegin(stroke);
+        std::size_t end = path.strokeEnd(stroke);
+
+        // Where the previous stroke ended is known, so the travel gets the
+        // speed it can reach over its length from rest to rest
+        QPointF start = machinePoint(begin);
+        double travelFeed = config.travelSpeed;
+        double travelTime = 0.0;
+        if (plan && havePosition) {
+            SpiroMove move = { SpiroMove::Type::Line, start.x(), start.y(), 0.0, 0.0 };
+            travelPlan[0] = planSegment(position.x(), position.y(), move, travelSpeed, limits);
+            travelTime = planMotion(travelPlan, limits);
+            travelFeed = plannedFeed(travelPlan[0].peakSpeed, config.travelSpeed);
+        }
+        travel(start, travelFeed, travelTime);
+        position = start;
+        havePosition = true;
+        ++sinceReport;
+
+        // Fitting works on machine coordinates, where the tolerances are
+        // defined and arc directions are final. Each block starts where the
+        // previous one ended.
+        entrySpeed = 0.0;
+        std::size_t first = begin;
+        while (first + 1 < end) {
+            std::size_t last = std::min(end, first + progressBlockSize + 1);
+            blockX.clear();
+            blockY.clear();
+            for (std::size_t i = first; i < last; ++i) {
+                QPointF point = machinePoint(i);
+                blockX.push_back(point.x());
+                blockY.push_back(point.y());
+            }
+            fitted.clear();
+            fitPolyline(blockX.data(), blockY.data(), blockX.size(), fit, fitted);
+
+            for (const SpiroMove& move : fitted) {
+                if (!plan) {
+                    draw(move, config.drawingSpeed, 0.0);
+                    position = QPointF(move.x, move.y);
+                    continue;
+                }
+
+                // Moves too short to plan are left out; they would not move
+                // the machine by a written step anyway
+                SpiroPlanSegment segment = planSegment(position.x(), position.y(), move, drawingSpeed, limits);
+                if (segment.length > 0.0) {
+                    segments.push_back(segment);
+                    moves.push_back(move);
+                    position = QPointF(move.x, move.y);
+                    if (segments.size() >= planWindowSize) {
+                        flushWindow(false);
+                    }
+                }
+            }
+
+            sinceReport += last - 1 - first;
+            first = last - 1;
+            if (sinceReport >= progressBlockSize) {
+                if (!reportProgress(progress, sinceReport)) {
+                    return false;
+                }
+                sinceReport = 0;
+            }
         }
-        // Handle curve elements if needed
+        if (!segments.empty()) {
+            flushWindow(true);
+        }
+    }
+    return reportProgress(progress, sinceReport);
+}
+
+double GcodeGenerator::estimatePlotTime(const std::vector<SpiroPathBuffer>& paths, const Config& config) const
+{
+    if (config.maxAcceleration <= 0.0 || config.drawingSpeed <= 0.0) {
+        return 0.0;
+    }
+    Placement placement = placementOf(paths, config);
+    const double penTime = moveTime(std::fabs(config.penUpPosition - config.penDownPosition),
+                                    config.maxSpeed / 60.0, config.maxAcceleration);
+
+    std::size_t totalVertices = 0;
+    for (const SpiroPathBuffer& path : paths) {
+        totalVertices += path.size();
     }
+    ExportProgress progress(totalVertices);
 
-    return gcode;
+    // The moves of every pen file, planned as the controller runs them even
+    // if the feeds are not, and timed instead of written. The pen is lowered
+    // before each stroke and raised after it.
+    std::vector<double> seconds(paths.size(), 0.0);
+    SpiroTaskPool::instance().parallelFor(paths.size(), [&](std::size_t pen) {
+        double total = 0.0;
+        bool penDown = false;
+        bool completed = planPath(paths[pen], config, true, placement, progress,
+            [&](const QPointF&, double, double time) {
+                if (penDown) {
+                    total += penTime;
+                    penDown = false;
+                }
+                total += time;
+            },
+            [&](const SpiroMove&, double, double time) {
+                if (!penDown) {
+                    total += penTime;
+                    penDown = true;
+                }
+                total += time;
+            });
+        if (penDown) {
+            total += penTime;
+        }
+        seconds[pen] = completed ? total : -1.0;
+    });
+
+    double total = 0.0;
+    for (double penSeconds : seconds) {
+        if (penSeconds < 0.0) {
+            return -1.0;
+        }
+        total += penSeconds;
+    }
+    return total;
 }
-QString GcodeGenerator::moveToPoint(const QPointF& point, bool penDown, const Config& config)
+
+bool GcodeGenerator::writePenFile(const QString& penFilename, const SpiroPathBuffer& path, const Config& config, const Placement& placement, ExportProgress& progress) const
 {
-    QString gcode;
-    QTextStream stream(&gcode);
+    SPIRO_PROFILE_SCOPE("export.gcode.pen");
+    SpiroFileWriter out;
+    if (!out.open(QFile::encodeName(penFilename).toStdString())) {
+        return false;
+    }
+
+    // Custom start Gcode
+    out.write(config.startGcode.toStdString());
+    out.put('\n');
 
+    // Set default feed rate
+    out.write(QString("F%1 ; Set default feed rate\n").arg(config.travelSpeed).toStdString());
+
+    // Nothing is known about the position or motion mode after the start
+    // Gcode, only the feed rate that was just set
+    PenState state;
+    state.penDown = false;
+    state.motion = -1;
+    state.feed = std::llround(config.travelSpeed);
+    state.x = state.y = state.z = 0;
+    state.knownX = state.knownY = state.knownZ = false;
+
+    // Initialize pen to up position
+    writePenPosition(out, state, false, config);
+
+    // The moves go straight into the file buffer as they are planned
+    const bool plan = config.planFeeds && config.maxAcceleration > 0.0;
+    bool completed = planPath(path, config, plan, placement, progress,
+        [&](const QPointF& point, double feed, double) {
+            writeMove(out, state, point, false, feed, config);
+        },
+        [&](const SpiroMove& move, double feed, double) {
+            if (move.type == SpiroMove::Type::Line) {
+                writeMove(out, state, QPointF(move.x, move.y), true, feed, config);
+            } else {
+                writeArc(out, state, move, feed, config);
+            }
+        });
+    if (!completed) {
+        return false;
+    }
+
+    // Custom end Gcode
+    out.write(config.endGcode.toStdString());
+    out.put('\n');
+
+    return out.close();
+}
+
+bool GcodeGenerator::reportProgress(ExportProgress& progress, std::size_t vertices) const
+{
+    std::size_t written = progress.writtenVertices += vertices;
+    if (isCancelled()) {
+        return false;
+    }
+    if (m_progressCallback && progress.totalVertices > 0 && progress.callbackMutex.try_lock()) {
+        m_progressCallback(static_cast<double>(written) / progress.totalVertices);
+        progress.callbackMutex.unlock();
+    }
+    return true;
+}
+
+void GcodeGenerator::writeMove(SpiroFileWriter& out, PenState& state, const QPointF& point, bool penDown, double feed, const Config& config) const
+{
     // Only change pen position if it's different from the current state
-    if (penDown != m_currentPenState) {
-        stream << setPenPosition(penDown, config);
-        m_currentPenState = penDown;
+    if (penDown != state.penDown) {
+        writePenPosition(out, state, penDown, config);
+    }
+
+    Motion motion = {};
+    motion.g = 1;
+    motion.hasXY = true;
+    motion.x = point.x();
+    motion.y = point.y();
+    motion.feed = feed;
+    writeMotion(out, state, motion, config);
+}
+
+void GcodeGenerator::writeArc(SpiroFileWriter& out, PenState& state, const SpiroMove& move, double feed, const Config& config) const
+{
+    if (!state.penDown) {
+        writePenPosition(out, state, true, config);
     }
 
-    stream << QString("G1 X%1 Y%2 F%3\n")
-        .arg(point.x(), 0, 'f', 3)
-        .arg(point.y(), 0, 'f', 3)
-        .arg(penDown ? config.drawingSpeed : config.travelSpeed, 0, 'f', 0);
+    Motion motion = {};
+    motion.g = move.type == SpiroMove::Type::ClockwiseArc ? 2 : 3;
+    motion.hasXY = true;
+    motion.x = move.x;
+    motion.y = move.y;
+    motion.hasIJ = true;
+    motion.i = move.i;
+    motion.j = move.j;
+    motion.feed = feed;
+    writeMotion(out, state, motion, config);
+}
 
-    return gcode;
+void GcodeGenerator::writePenPosition(SpiroFileWriter& out, PenState& state, bool down, const Config& config) const
+{
+    Motion motion = {};
+    motion.g = 1;
+    motion.hasZ = true;
+    motion.z = down ? config.penDownPosition : config.penUpPosition;
+    motion.feed = config.maxSpeed;
+    writeMotion(out, state, motion, config);
+    state.penDown = down;
 }
 
-QString GcodeGenerator::setPenPosition(bool down, const Config& config)
+void GcodeGenerator::writeMotion(SpiroFileWriter& out, PenState& state, const Motion& motion, const Config& config) const
 {
-    return QString("G1 Z%1 F%2\n")
-        .arg(down ? config.penDownPosition : config.penUpPosition, 0, 'f', 3)
-        .arg(config.maxSpeed, 0, 'f', 0);
+    const bool compress = config.modalCompression;
+    const bool isArc = motion.g == 2 || motion.g == 3;
+
+    long long x = 0, y = 0, z = 0;
+    bool writeX = false, writeY = false, writeZ = false;
+    if (motion.hasXY) {
+        x = toSteps(motion.x, config.xPrecision);
+        y = toSteps(motion.y, config.yPrecision);
+        // An arc always restates its end point; without one it is a full circle
+        writeX = !compress || isArc || !state.knownX || x != state.x;
+        writeY = !compress || isArc || !state.knownY || y != state.y;
+    }
+    if (motion.hasZ) {
+        z = toSteps(motion.z, config.zPrecision);
+        writeZ = !compress || !state.knownZ || z != state.z;
+    }
+    if (!writeX && !writeY && !writeZ) {
+        // Would not move the machine at all
+        return;
+    }
+
+    long long feed = std::llround(motion.feed);
+    bool writeG = !compress || motion.g != state.motion;
+    bool writeF = !compress || feed != state.feed;
+
+    bool firstWord = true;
+    auto word = [&](char letter) {
+        if (!firstWord) {
+            out.put(' ');
+        }
+        out.put(letter);
+        firstWord = false;
+    };
+
+    if (writeG) {
+        word('G');
+        out.writeInt(motion.g);
+    }
+    if (writeX) {
+        word('X');
+        out.writeFixed(motion.x, config.xPrecision, compress);
+    }
+    if (writeY) {
+        word('Y');
+        out.writeFixed(motion.y, config.yPrecision, compress);
+    }
+    if (motion.hasIJ) {
+        word('I');
+        out.writeFixed(motion.i, config.xPrecision, compress);
+        word('J');
+        out.writeFixed(motion.j, config.yPrecision, compress);
+    }
+    if (writeZ) {
+        word('Z');
+        out.writeFixed(motion.z, config.zPrecision, compress);
+    }
+    if (writeF) {
+        word('F');
+        out.writeFixed(motion.feed, 0);
+    }
+    out.put('\n');
+
+    state.motion = motion.g;
+    state.feed = feed;
+    if (motion.hasXY) {
+        state.x = x;
+        state.y = y;
+        state.knownX = state.knownY = true;
+    }
+    if (motion.hasZ) {
+        state.z = z;
+        state.knownZ = true;
+    }
 }
 
-QPointF GcodeGenerator::applyOriginTransform(const QPointF& point, const Config& config, const QRectF& boundingBox, double scale)
+QPointF GcodeGenerator::applyOriginTransform(const QPointF& point, const Config& config, const QRectF& boundingBox, double scale) const
 {
     QPointF transformedPoint = point;
     double scaledWidth = boundingBox.width() * scale;
@@ -0,0 +1,118 @@
+#include "machineprofile.h"
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QStandardPaths>
+#include <QStringList>
+#include <QDebug>
+
+namespace {
+
+// Gcode blocks are stored one line per array element
+QString joinLines(const QJsonValue& value)
+{
+    QString text;
+    for (const auto &line : value.toArray()) {
+        text += line.toString() + "\n";
+    }
+    return text;
+}
+
+} // namespace
+
+QString MachineProfile::locate()
+{
+    // Try to find the config file in multiple locations
+    QStringList searchPaths = {
+        QCoreApplication::applicationDirPath() + "/../config.json",
+        QCoreApplication::applicationDirPath() + "/config.json",
+        QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/config.json"
+    };
+
+    for (const auto &path : searchPaths) {
+        if (QFile::exists(path)) {
+            return path;
+        }
+    }
+    return QString();
+}
+
+GcodeGenerator::Config MachineProfile::defaults()
+{
+    GcodeGenerator::Config config;
+    config.drawingAreaWidth = 200;
+    config.drawingAreaHeight = 200;
+    config.maxSpeed = 3000;
+    config.maxAcceleration = 500;
+    config.penUpPosition = 5;
+    config.penDownPosition = -1;
+    config.travelSpeed = 3000;
+    config.drawingSpeed = 1500;
+    config.origin = GcodeGenerator::Origin::BottomLeft;
+    // The export dialog's own defaults, unlike a bare Config which merges
+    // nothing and fits no arcs; the CLI follows the dialog
+    config.mergeTolerance = 0.01;
+    config.arcTolerance = 0.01;
+    return config;
+}
+
+void MachineProfile::apply(const QJsonObject& json, GcodeGenerator::Config& config)
+{
+    config.drawingAreaWidth = json["defaultDrawingAreaWidth"].toDouble(config.drawingAreaWidth);
+    config.drawingAreaHeight = json["defaultDrawingAreaHeight"].toDouble(config.drawingAreaHeight);
+    config.maxSpeed = json["defaultMaxSpeed"].toDouble(config.maxSpeed);
+    config.maxAcceleration = json["defaultMaxAcceleration"].toDouble(config.maxAcceleration);
+    config.penUpPosition = json["defaultPenUpPosition"].toDouble(config.penUpPosition);
+    config.penDownPosition = json["defaultPenDownPosition"].toDouble(config.penDownPosition);
+    config.travelSpeed = json["defaultTravelSpeed"].toDouble(config.travelSpeed);
+    config.drawingSpeed = json["defaultDrawingSpeed"].toDouble(config.drawingSpeed);
+    config.mergeTolerance = json["defaultMergeTolerance"].toDouble(config.mergeTolerance);
+    config.arcTolerance = json["defaultArcTolerance"].toDouble(config.arcTolerance);
+    config.optimizeTravel = json["defaultOptimizeTravel"].toBool(config.optimizeTravel);
+    config.modalCompression = json["defaultModalCompression"].toBool(config.modalCompression);
+    config.xPrecision = json["defaultXPrecision"].toInt(config.xPrecision);
+    config.yPrecision = json["defaultYPrecision"].toInt(config.yPrecision);
+    config.zPrecision = json["defaultZPrecision"].toInt(config.zPrecision);
+    config.planFeeds = json["defaultPlanFeeds"].toBool(config.planFeeds);
+    config.junctionDeviation = json["defaultJunctionDeviation"].toDouble(config.junctionDeviation);
+
+    // Load default Gcodes
+    if (json.contains("defaultStartGcode")) {
+        config.startGcode = joinLines(json["defaultStartGcode"]);
+    }
+    if (json.contains("defaultEndGcode")) {
+        config.endGcode = joinLines(json["defaultEndGcode"]);
+    }
+}
+
+bool MachineProfile::load(const QString& path, GcodeGenerator::Config& config)
+{
+    QFile configFile(path);
+    if (!configFile.open(QIODevice::ReadOnly)) {
+        qWarning() << "Couldn't open configuration file:" << configFile.errorString();
+        return false;
+    }
+
+    QJsonParseError parseError;
+    QJsonDocument loadDoc = QJsonDocument::fromJson(configFile.readAll(), &parseError);
+    if (loadDoc.isNull()) {
+        qWarning() << "Failed to parse JSON from config file:" << parseError.errorString();
+        return false;
+    }
+
+    apply(loadDoc.object(), config);
+    return true;
+}
+
+GcodeGenerator::Config MachineProfile::load()
+{
+    GcodeGenerator::Config config = defaults();
+    // Without a config.json the defaults stand; that is not an error
+    QString path = locate();
+    if (!path.isEmpty()) {
+        load(path, config);
+    }
+    return config;
+}
@@ -1,9 +1,15 @@
 #include "mainwindow.h"
 #include "drawingarea.h"
 #include "gcodeexportdialog.h"
+#include "machineprofile.h"
+#ifdef SPIROBOT_OPENGL_PREVIEW
+#include "patternglview.h"
+#endif
+#include "spirocache.h"
 #include <QVBoxLayout>
 #include <QHBoxLayout>
 #include <QGroupBox>
+#include <QStackedWidget>
 #include <QMenuBar>
 #include <QMenu>
 #include <QAction>
@@ -11,13 +17,61 @@
 #include <QMessageBox>
 #include <QInputDialog>
 #include <QTimer>
+#include <QProgressDialog>
+#include <QEventLoop>
+#include <QThreadPool>
+#include <QDir>
+#include <QFile>
+#include <QSettings>
+#include <QStandardPaths>
+#include <algorithm>
+#include <atomic>
 #include <cmath>
-#include <numeric>
 #include <iostream>
 #include <QDebug>
 
+namespace {
+
+// Large enough for A1 at 600 dpi; PNGs are written in strips, so size is
+// limited by disk space rather than memory
+const int maxPngSize = 30000;
+
+// "1h 05m 12s", "5m 12s" or "12s"
+QString formatDuration(double seconds)
+{
+    long long total = std::llround(seconds);
+    long long hours = total / 3600;
+    long long minutes = total / 60 % 60;
+    long long secs = total % 60;
+    if (hours > 0) {
+        return QString("%1h %2m %3s").arg(hours).arg(minutes, 2, 10, QChar('0')).arg(secs, 2, 10, QChar('0'));
+    }
+    if (minutes > 0) {
+        return QString("%1m %2s").arg(minutes).arg(secs, 2, 10, QChar('0'));
+    }
+    return QString("%1s").arg(secs);
+}
+
+// Most that is written to disk of the pattern cache on exit, whatever the
+// in-memory budget; the most recently used patterns are kept
+const std::size_t maxSavedCacheBytes = 64 * 1024 * 1024;
+
+// Generated geometry can be kept between sessions so designs visited before
+// show up without regenerating
+QString geometryCachePath()
+{
+    QString directory = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    if (directory.isEmpty() || !QDir().mkpath(directory)) {
+        return QString();
+    }
+    return QDir(directory).filePath("geometry.cache");
+}
+
+} // namespace
+
 MainWindow::MainWindow(QWidget *parent)
-    : QMainWindow(parent), currentStep(0), totalRotations(0)
+    : QMainWindow(parent), currentStep(0), totalRotations(0), machineProfile(MachineProfile::load()),
+      keepPatternCache(false)
 {
     qDebug() << "MainWindow constructor started";
 
@@ -34,6 +88,12 @@ MainWindow::MainWindow(QWidget *parent)
         qDebug() << "Connecting animation timer";
         connect(animationTimer, &QTimer::timeout, this, &MainWindow::updateAnimation);
 
+        keepPatternCache = QSettings("SpiroBot", "SpiroBot").value("keepPatternCache", false).toBool();
+        QString cachePath = keepPatternCache ? geometryCachePath() : QString();
+        if (!cachePath.isEmpty() && SpiroGeometryCache::instance().load(QFile::encodeName(cachePath).toStdString())) {
+            qDebug() << "Loaded" << SpiroGeometryCache::instance().entryCount() << "cached patterns from" << cachePath;
+        }
+
         qDebug() << "Calling setupUI";
         setupUI();
 
@@ -45,6 +105,11 @@ MainWindow::MainWindow(QWidget *parent)
 
 MainWindow::~MainWindow()
 {
+    QString cachePath = keepPatternCache ? geometryCachePath() : QString();
+    if (!cachePath.isEmpty()
+        && !SpiroGeometryCache::instance().save(QFile::encodeName(cachePath).toStdString(), maxSavedCacheBytes)) {
+        qWarning() << "Failed to save the pattern cache to" << cachePath;
+    }
 }
 
 void MainWindow::setupUI()
@@ -54,7 +119,18 @@ void MainWindow::setupUI()
 
     // Drawing area
     drawingArea = new DrawingArea(this);
+    drawingArea->setMachineConfig(machineProfile);
+    patternGLView = nullptr;
+#ifdef SPIROBOT_OPENGL_PREVIEW
+    // The OpenGL preview takes the drawing area's place while it is selected
+    QStackedWidget *previewStack = new QStackedWidget(this);
+    patternGLView = new PatternGLView(this);
+    previewStack->addWidget(drawingArea);
+    previewStack->addWidget(patternGLView);
+    mainLayout->addWidget(previewStack, 1);
+#else
     mainLayout->addWidget(drawingArea, 1);
+#endif
 
     // Controls
     QGroupBox *controlsGroup = new QGroupBox("Controls", this);
@@ -126,6 +202,22 @@ void MainWindow::setupUI()
     rotationOffsetLayout->addWidget(rotationOffsetSpinBox);
     controlsLayout->addLayout(rotationOffsetLayout);
 
+    // Sampling
+    adaptiveSamplingCheckBox = new QCheckBox("Adaptive Sampling", this);
+    adaptiveSamplingCheckBox->setChecked(true);
+    controlsLayout->addWidget(adaptiveSamplingCheckBox);
+
+    QHBoxLayout *chordToleranceLayout = new QHBoxLayout();
+    chordToleranceSpinBox = new QDoubleSpinBox(this);
+    chordToleranceSpinBox->setRange(0.001, 1.0);
+    chordToleranceSpinBox->setDecimals(3);
+    chordToleranceSpinBox->setSingleStep(0.01);
+    chordToleranceSpinBox->setValue(0.05);
+    chordToleranceSpinBox->setSuffix(" mm");
+    chordToleranceLayout->addWidget(new QLabel("Chord Tolerance:"));
+    chordToleranceLayout->addWidget(chordToleranceSpinBox);
+    controlsLayout->addLayout(chordToleranceLayout);
+
     // Add "Close the Loop" button
     closeLoopButton = new QPushButton("Close the Loop", this);
     controlsLayout->addWidget(closeLoopButton);
@@ -136,6 +228,17 @@ void MainWindow::setupUI()
     controlsLayout->addWidget(animateButton);
     connect(animateButton, &QPushButton::clicked, this, &MainWindow::on_animateButton_clicked);
 
+    // Time the animation may spend generating per tick; work that does not
+    // fit carries over to the next tick
+    QHBoxLayout *animationBudgetLayout = new QHBoxLayout();
+    animationBudgetSpinBox = new QSpinBox(this);
+    animationBudgetSpinBox->setRange(1, 50);
+    animationBudgetSpinBox->setValue(20);
+    animationBudgetSpinBox->setSuffix(" ms");
+    animationBudgetLayout->addWidget(new QLabel("Animation Frame Budget:"));
+    animationBudgetLayout->addWidget(animationBudgetSpinBox);
+    controlsLayout->addLayout(animationBudgetLayout);
+
     // Add "Animate Gears" button
     animateGearsButton = new QPushButton("Animate Gears", this);
     controlsLayout->addWidget(animateGearsButton);
@@ -144,6 +247,9 @@ void MainWindow::setupUI()
     pathLengthLabel = new QLabel("Path Length: N/A", this);
     controlsLayout->addWidget(pathLengthLabel);
 
+    plotTimeLabel = new QLabel("Estimated Plot Time: N/A", this);
+    controlsLayout->addWidget(plotTimeLabel);
+
     statusLabel = new QLabel("Ready", this);
     controlsLayout->addWidget(statusLabel);
 
@@ -161,8 +267,13 @@ void MainWindow::setupUI()
     connect(lineThicknessSpinBox, &QDoubleSpinBox::valueChanged, this, &MainWindow::updateSpirograph);
     connect(numPensSpinBox, &QSpinBox::valueChanged, this, &MainWindow::updateSpirograph);
     connect(rotationOffsetSpinBox, &QDoubleSpinBox::valueChanged, this, &MainWindow::updateSpirograph);
+    connect(adaptiveSamplingCheckBox, &QCheckBox::toggled, this, &MainWindow::updateSpirograph);
+    connect(chordToleranceSpinBox, &QDoubleSpinBox::valueChanged, this, &MainWindow::updateSpirograph);
+    connect(adaptiveSamplingCheckBox, &QCheckBox::toggled, chordToleranceSpinBox, &QWidget::setEnabled);
 
     connect(drawingArea, &DrawingArea::spirographUpdated, this, &MainWindow::updateAnalysis);
+    connect(drawingArea, &DrawingArea::spirographUpdated, this, &MainWindow::updatePreview);
+    connect(drawingArea, &DrawingArea::plotTimeEstimated, this, &MainWindow::updateAnalysis);
 
     // Connect value change signals to updateValueLabels
     connect(outerRadiusSlider, &QSlider::valueChanged, this, &MainWindow::updateValueLabels);
@@ -186,6 +297,48 @@ void MainWindow::setupUI()
     connect(exportGcodeAction, &QAction::triggered, this, &MainWindow::exportToGcode);
     exportMenu->addAction(exportGcodeAction);
 
+    QMenu *optionsMenu = menuBar()->addMenu(tr("&Options"));
+    QAction *keepPatternCacheAction = new QAction(tr("&Keep Patterns Between Sessions"), this);
+    keepPatternCacheAction->setCheckable(true);
+    keepPatternCacheAction->setChecked(keepPatternCache);
+    connect(keepPatternCacheAction, &QAction::toggled, this, [this](bool keep) {
+        keepPatternCache = keep;
+        QSettings("SpiroBot", "SpiroBot").setValue("keepPatternCache", keep);
+        // A cache that is no longer kept should not linger on disk
+        QString cachePath = geometryCachePath();
+        if (!keep && !cachePath.isEmpty()) {
+            QFile::remove(cachePath);
+        }
+    });
+    optionsMenu->addAction(keepPatternCacheAction);
+
+    QMenu *viewMenu = menuBar()->addMenu(tr("&View"));
+    QAction *performanceOverlayAction = new QAction(tr("Performance &Overlay"), this);
+    performanceOverlayAction->setCheckable(true);
+    performanceOverlayAction->setShortcut(QKeySequence(Qt::Key_F12));
+    connect(performanceOverlayAction, &QAction::toggled, this, [this](bool visible) {
+        drawingArea->setPerformanceOverlayVisible(visible);
+#ifdef SPIROBOT_OPENGL_PREVIEW
+        patternGLView->setPerformanceOverlayVisible(visible);
+#endif
+    });
+    viewMenu->addAction(performanceOverlayAction);
+
+    QAction *hoverReadoutAction = new QAction(tr("Hover &Readout"), this);
+    hoverReadoutAction->setCheckable(true);
+    connect(hoverReadoutAction, &QAction::toggled, drawingArea, &DrawingArea::setHoverReadoutEnabled);
+    viewMenu->addAction(hoverReadoutAction);
+
+#ifdef SPIROBOT_OPENGL_PREVIEW
+    QAction *openGLPreviewAction = new QAction(tr("Open&GL Preview"), this);
+    openGLPreviewAction->setCheckable(true);
+    connect(openGLPreviewAction, &QAction::toggled, this, [this, previewStack](bool enabled) {
+        previewStack->setCurrentWidget(enabled ? static_cast<QWidget *>(patternGLView) : drawingArea);
+        updatePreview();
+    });
+    viewMenu->addAction(openGLPreviewAction);
+#endif
+
     // Initial update
     updateValueLabels();
     updateSpirograph();
@@ -221,11 +374,11 @@ void MainWindow::exportToPNG()
 
     bool ok;
     int width = QInputDialog::getInt(this, tr("PNG Width"),
-                                     tr("Enter PNG width:"), drawingArea->width(), 1, 10000, 1, &ok);
+                                     tr("Enter PNG width:"), drawingArea->width(), 1, maxPngSize, 1, &ok);
     if (!ok) return;
 
     int height = QInputDialog::getInt(this, tr("PNG Height"),
-                                      tr("Enter PNG height:"), drawingArea->height(), 1, 10000, 1, &ok);
+                                      tr("Enter PNG height:"), drawingArea->height(), 1, maxPngSize, 1, &ok);
     if (!ok) return;
 
     if (drawingArea->exportToPNG(filename, width, height)) {
@@ -249,8 +402,51 @@ void MainWindow::exportToGcode()
     GcodeExportDialog dialog(this);
     if (dialog.exec() == QDialog::Accepted) {
         GcodeGenerator::Config config = dialog.getConfig();
-        if (drawingArea->exportToGcode(filename, config)) {
+        machineProfile = config;
+        drawingArea->setMachineConfig(config);
+
+        QProgressDialog progressDialog(tr("Exporting Gcode..."), tr("Cancel"), 0, 1000, this);
+        progressDialog.setWindowModality(Qt::WindowModal);
+        progressDialog.setMinimumDuration(300);
+
+        std::atomic<int> progress(0);
+        std::atomic<bool> cancelled(false);
+        DrawingArea::GcodeExportStats stats;
+        std::function<bool()> job = drawingArea->prepareGcodeExport(filename, config,
+            [&progress](double fraction) { progress = static_cast<int>(fraction * 1000); },
+            [&cancelled]() { return cancelled.load(); },
+            &stats);
+
+        // The pens are written on worker threads; the GUI thread only polls
+        // the progress and keeps the window responsive until the job is done
+        QEventLoop loop;
+        QTimer progressTimer;
+        connect(&progressTimer, &QTimer::timeout, this, [&]() {
+            if (progressDialog.wasCanceled()) {
+                cancelled = true;
+            } else {
+                progressDialog.setValue(std::min(progress.load(), 999));
+            }
+        });
+        progressTimer.start(50);
+
+        bool exported = false;
+        QThreadPool::globalInstance()->start([&]() {
+            exported = job();
+            QMetaObject::invokeMethod(&loop, &QEventLoop::quit, Qt::QueuedConnection);
+        });
+        loop.exec();
+        progressTimer.stop();
+        progressDialog.reset();
+
+        if (exported && config.optimizeTravel) {
+            statusLabel->setText(QString("Gcode exported successfully, pen-up travel %1 mm (was %2 mm)")
+                                     .arg(stats.travelAfter, 0, 'f', 1)
+                                     .arg(stats.travelBefore, 0, 'f', 1));
+        } else if (exported) {
            statusLabel->setText("Gcode exported successfully");
+        } else if (cancelled) {
+            statusLabel->setText("Gcode export cancelled");
         } else {
             QMessageBox::critical(this, tr("Export Failed"),
                 tr("Failed to export the Gcode file."));
@@ -262,6 +458,12 @@ void MainWindow::updateAnalysis()
 {
     double pathLength = drawingArea->calculateTotalPathLength();
     pathLengthLabel->setText(QString("Path Length: %1").arg(pathLength, 0, 'f', 2));
+    double plotTime = drawingArea->plotTime();
+    plotTimeLabel->setText(plotTime < 0.0 ? QString("Estimated Plot Time: calculating...")
+                                          : QString("Estimated Plot Time: %1").arg(formatDuration(plotTime)));
+    if (!drawingArea->isRegenerating()) {
+        statusLabel->setText("Spirograph updated");
+    }
 }
 
 void MainWindow::updateValueLabels()
@@ -287,26 +489,44 @@ void MainWindow::on_animateButton_clicked()
 {
     currentStep = 0;
     totalRotations = rotationsSpinBox->value();
+    drawingArea->beginIncrementalAnimation();
     animationTimer->start(50);  // 20 FPS
     statusLabel->setText("Animation started");
 }
 
 void MainWindow::updateAnimation()
 {
+    // One more rotation per tick; if the budget runs out the drawing lags
+    // behind and catches up on later ticks
     if (currentStep < totalRotations) {
-        rotationsSpinBox->setValue(currentStep + 1);
-        updateSpirograph();
         currentStep++;
-    } else {
+    }
+
+    bool reached = drawingArea->advanceIncrementalAnimation(currentStep, animationBudgetSpinBox->value());
+    if (reached && currentStep >= totalRotations) {
         animationTimer->stop();
+        drawingArea->endIncrementalAnimation();
         statusLabel->setText("Animation complete!");
+    } else {
+        statusLabel->setText(QString("Animating rotation %1 of %2").arg(currentStep).arg(totalRotations));
     }
 }
 
 int MainWindow::calculateRotationsToCloseLoop(int outerRadius, int innerRadius)
 {
-    int radiusDifference = outerRadius - innerRadius;
-    return std::lcm(radiusDifference, innerRadius) / radiusDifference;
+    return SpiroGenerator::rotationsToClose(outerRadius, innerRadius);
+}
+
+void MainWindow::updatePreview()
+{
+#ifdef SPIROBOT_OPENGL_PREVIEW
+    // Only the view on screen gets the pattern; switching views sends it.
+    // During the incremental animation only the new points are copied.
+    if (!patternGLView->isHidden()) {
+        patternGLView->setPattern(drawingArea->patternPathBuffers(), drawingArea->patternPenColors(),
+                                  drawingArea->patternLineThickness(), drawingArea->patternId());
+    }
+#endif
 }
 
 void MainWindow::updateSpirograph()
@@ -320,15 +540,25 @@ void MainWindow::updateSpirograph()
         numPensSpinBox->value(),
         rotationOffsetSpinBox->value()
     );
+
+    SpiroSampling sampling;
+    sampling.mode = adaptiveSamplingCheckBox->isChecked() ? SpiroSampling::Mode::Adaptive
+                                                          : SpiroSampling::Mode::FixedStep;
+    sampling.chordTolerance = chordToleranceSpinBox->value();
+    drawingArea->setSampling(sampling);
     
     if (animationTimer->isActive()) {
-        drawingArea->generateSpirographStep(rotationsSpinBox->value());
+        // Restart the drawing with the new parameters; the next tick catches
+        // up to the current rotation
+        totalRotations = rotationsSpinBox->value();
+        currentStep = std::min(currentStep, totalRotations);
+        drawingArea->beginIncrementalAnimation();
     } else {
-        drawingArea->generateSpirograph();
+        drawingArea->requestRegeneration();
+        statusLabel->setText("Regenerating...");
     }
     
     drawingArea->update();
-    statusLabel->setText("Spirograph updated");
 }
 
 void MainWindow::on_animateGearsButton_clicked()
@@ -0,0 +1,401 @@
+#include "patternexporter.h"
+#include "spirocache.h"
+#include "spiropngwriter.h"
+#include "spiroprofiler.h"
+#include "spirosvgwriter.h"
+#include "spirotaskpool.h"
+#include "spirotravel.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QPainter>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+#ifdef SPIROBOT_HAVE_ZLIB
+// PNG export renders square tiles of this size; a row of them makes one
+// strip of rows for the encoder
+const int pngTileSize = 512;
+// Pixels of tiles rendered at the same time, at most
+const qint64 maxPngBatchPixels = 32LL * 1024 * 1024;
+// Vertices per bounding box when culling paths against tiles
+const std::size_t cullChunkSize = 256;
+
+// A run of vertices with its bounds. Consecutive chunks of a stroke share
+// their end vertex, so a run of them can be drawn as one line.
+struct PathChunk
+{
+    std::size_t begin;
+    std::size_t end;
+    SpiroBounds bounds;
+};
+
+std::vector<PathChunk> cullingChunks(const SpiroPathBuffer &path)
+{
+    std::vector<PathChunk> chunks;
+    const float *x = path.x();
+    const float *y = path.y();
+    for (std::size_t stroke = 0; stroke < path.strokeCount(); ++stroke) {
+        std::size_t end = path.strokeEnd(stroke);
+        for (std::size_t first = path.strokeBegin(stroke); first + 1 < end; first += cullChunkSize) {
+            PathChunk chunk;
+            chunk.begin = first;
+            chunk.end = std::min(first + cullChunkSize + 1, end);
+            for (std::size_t i = chunk.begin; i < chunk.end; ++i) {
+                chunk.bounds.include(x[i], y[i]);
+            }
+            chunks.push_back(chunk);
+        }
+    }
+    return chunks;
+}
+
+// The part of path that can reach into area
+QPainterPath culledPath(const SpiroPathBuffer &path, const std::vector<PathChunk> &chunks, const QRectF &area)
+{
+    QPainterPath result;
+    const float *x = path.x();
+    const float *y = path.y();
+    std::size_t previousEnd = 0;
+    for (const PathChunk &chunk : chunks) {
+        if (chunk.bounds.maxX < area.left() || chunk.bounds.minX > area.right()
+            || chunk.bounds.maxY < area.top() || chunk.bounds.minY > area.bottom()) {
+            previousEnd = 0;
+            continue;
+        }
+        // Continue the line if the previous chunk was drawn and leads here
+        if (previousEnd != chunk.begin + 1) {
+            result.moveTo(x[chunk.begin], y[chunk.begin]);
+        }
+        for (std::size_t i = chunk.begin + 1; i < chunk.end; ++i) {
+            result.lineTo(x[i], y[i]);
+        }
+        previousEnd = chunk.end;
+    }
+    return result;
+}
+
+// Renders the same picture as PatternExporter::paint on a white background,
+// a batch of tile rows at a time on the task pool, and streams each finished
+// strip to the PNG encoder. Memory stays at a few strips however large the
+// image is.
+bool writeTiledPNG(const QString &filename, const QSize &size, const std::vector<SpiroPathBuffer> &paths,
+                   int outerRadius, double lineThickness)
+{
+    const int width = size.width();
+    const int height = size.height();
+    const double scale = std::min(width, height) / (2.0 * outerRadius);
+    const QPoint origin(width / 2, height / 2);
+    const QVector<QColor> colors = PatternExporter::penColors(static_cast<int>(paths.size()));
+
+    std::vector<std::vector<PathChunk>> chunks(paths.size());
+    SpiroTaskPool::instance().parallelFor(paths.size(), [&](std::size_t pen) {
+        chunks[pen] = cullingChunks(paths[pen]);
+    });
+
+    SpiroPngWriter writer;
+    if (!writer.open(QFile::encodeName(filename).toStdString(), width, height)) {
+        return false;
+    }
+
+    const int columns = (width + pngTileSize - 1) / pngTileSize;
+    const int tileRows = (height + pngTileSize - 1) / pngTileSize;
+    const qint64 stripPixels = static_cast<qint64>(width) * pngTileSize;
+    int stripsPerBatch = static_cast<int>(std::ceil(2.0 * SpiroTaskPool::instance().concurrency() / columns));
+    stripsPerBatch = std::max(1, std::min<int>(stripsPerBatch, static_cast<int>(maxPngBatchPixels / stripPixels)));
+    const std::size_t rowBytes = static_cast<std::size_t>(width) * 3;
+    std::vector<unsigned char> strips(rowBytes * pngTileSize * stripsPerBatch);
+
+    // How far, in pattern units, a stroke can reach from its centre line:
+    // half the width, its square caps, and a pixel of antialiasing
+    const double reach = (lineThickness * 0.75 + 1.0) / scale;
+    const QPen basePen(Qt::black, lineThickness / scale);
+
+    for (int firstRow = 0; firstRow < tileRows && writer.ok(); firstRow += stripsPerBatch) {
+        const int rows = std::min(stripsPerBatch, tileRows - firstRow);
+        SpiroTaskPool::instance().parallelFor(static_cast<std::size_t>(rows) * columns, [&](std::size_t index) {
+            const int row = firstRow + static_cast<int>(index / columns);
+            const int column = static_cast<int>(index % columns);
+            const QRect tileRect(column * pngTileSize, row * pngTileSize, std::min(pngTileSize, width - column * pngTileSize),
+                                 std::min(pngTileSize, height - row * pngTileSize));
+            const QRectF area(QPointF((tileRect.left() - origin.x()) / scale - reach,
+                                      (tileRect.top() - origin.y()) / scale - reach),
+                              QPointF((tileRect.left() + tileRect.width() - origin.x()) / scale + reach,
+                                      (tileRect.top() + tileRect.height() - origin.y()) / scale + reach));
+
+            QImage tile(tileRect.size(), QImage::Format_RGB32);
+            tile.fill(Qt::white);
+            QPainter painter(&tile);
+            painter.setRenderHint(QPainter::Antialiasing, true);
+            painter.translate(origin - tileRect.topLeft());
+            painter.scale(scale, scale);
+            for (std::size_t pen = 0; pen < paths.size(); ++pen) {
+                QPainterPath path = culledPath(paths[pen], chunks[pen], area);
+                if (!path.isEmpty()) {
+                    QPen strokePen = basePen;
+                    strokePen.setColor(colors.value(static_cast<int>(pen), Qt::black));
+                    painter.setPen(strokePen);
+                    painter.drawPath(path);
+                }
+            }
+            painter.end();
+
+            unsigned char *target = strips.data()
+                + (static_cast<std::size_t>(row - firstRow) * pngTileSize * width + tileRect.left()) * 3;
+            for (int y = 0; y < tile.height(); ++y) {
+                const QRgb *source = reinterpret_cast<const QRgb *>(tile.constScanLine(y));
+                unsigned char *out = target + y * rowBytes;
+                for (int x = 0; x < tile.width(); ++x) {
+                    out[3 * x] = static_cast<unsigned char>(qRed(source[x]));
+                    out[3 * x + 1] = static_cast<unsigned char>(qGreen(source[x]));
+                    out[3 * x + 2] = static_cast<unsigned char>(qBlue(source[x]));
+                }
+            }
+        });
+
+        const int batchHeight = std::min(rows * pngTileSize, height - firstRow * pngTileSize);
+        for (int y = 0; y < batchHeight; ++y) {
+            if (!writer.writeRow(strips.data() + y * rowBytes)) {
+                break;
+            }
+        }
+    }
+
+    if (!writer.close()) {
+        QFile::remove(filename);
+        return false;
+    }
+    return true;
+}
+#endif
+
+} // namespace
+
+PatternExporter::PatternExporter(const SpiroParameters &parameters, const SpiroSampling &sampling, int rotations,
+                                 std::vector<SpiroPathBuffer> paths, double lineThickness)
+    : m_parameters(parameters), m_sampling(sampling), m_rotations(rotations), m_lineThickness(lineThickness)
+{
+    m_bounds = boundsOf(paths);
+    m_paths = std::make_shared<const std::vector<SpiroPathBuffer>>(std::move(paths));
+}
+
+PatternExporter PatternExporter::generate(const SpiroParameters &parameters, const SpiroSampling &sampling,
+                                          int rotations, double lineThickness)
+{
+    SpiroGenerator generator(parameters, sampling);
+    std::shared_ptr<const SpiroGeometry> geometry = SpiroGeometryCache::instance().generate(generator, rotations);
+    const std::vector<SpiroPolyline> &polylines = *geometry;
+
+    std::vector<SpiroPathBuffer> paths(polylines.size());
+    for (std::size_t pen = 0; pen < polylines.size(); ++pen) {
+        paths[pen].appendStroke(polylines[pen]);
+    }
+    return PatternExporter(parameters, sampling, rotations, std::move(paths), lineThickness);
+}
+
+QVector<QColor> PatternExporter::penColors(int numPens)
+{
+    QVector<QColor> colors;
+    for (int i = 0; i < numPens; ++i) {
+        colors.append(QColor::fromHsv(i * 360 / numPens, 255, 255));
+    }
+    return colors;
+}
+
+QPainterPath PatternExporter::toPainterPath(const SpiroPathBuffer &buffer, std::size_t from)
+{
+    QPainterPath path;
+    const float *x = buffer.x();
+    const float *y = buffer.y();
+    for (std::size_t stroke = 0; stroke < buffer.strokeCount(); ++stroke) {
+        std::size_t begin = buffer.strokeBegin(stroke);
+        std::size_t end = buffer.strokeEnd(stroke);
+        if (end <= from) {
+            continue;
+        }
+        if (begin < from) {
+            begin = from - 1;
+        }
+
+        path.moveTo(x[begin], y[begin]);
+        for (std::size_t i = begin + 1; i < end; ++i) {
+            path.lineTo(x[i], y[i]);
+        }
+    }
+    return path;
+}
+
+void PatternExporter::paint(QPainter &painter, const QSize &size) const
+{
+    painter.setRenderHint(QPainter::Antialiasing, true);
+    painter.translate(size.width() / 2, size.height() / 2);
+    double scale = std::min(size.width(), size.height()) / (2.0 * m_parameters.outerRadius);
+    painter.scale(scale, scale);
+
+    // Draw the spirograph
+    QVector<QColor> colors = penColors(static_cast<int>(m_paths->size()));
+    for (int i = 0; i < static_cast<int>(m_paths->size()); ++i) {
+        painter.setPen(QPen(colors.value(i, Qt::black), m_lineThickness / scale));
+        painter.drawPath(toPainterPath((*m_paths)[i]));
+    }
+}
+
+bool PatternExporter::exportToSVG(const QString &filename, const QSize &size, double simplifyTolerance) const
+{
+    SPIRO_PROFILE_SCOPE("export.svg");
+    if (size.isEmpty()) {
+        return false;
+    }
+
+    // Same placement as paint()
+    SpiroSvgOptions options;
+    options.width = size.width();
+    options.height = size.height();
+    options.scale = std::min(size.width(), size.height()) / (2.0 * m_parameters.outerRadius);
+    options.offsetX = size.width() / 2;
+    options.offsetY = size.height() / 2;
+    options.strokeWidth = m_lineThickness;
+    options.simplifyTolerance = simplifyTolerance;
+    options.title = "SpiroBot SVG Export";
+    options.description = "Spirograph pattern generated by SpiroBot";
+
+    SpiroSvgWriter writer;
+    if (!writer.open(QFile::encodeName(filename).toStdString(), options)) {
+        return false;
+    }
+    QVector<QColor> colors = penColors(static_cast<int>(m_paths->size()));
+    for (int i = 0; i < static_cast<int>(m_paths->size()); ++i) {
+        QColor color = colors.value(i, Qt::black);
+        writer.writePen((*m_paths)[i], color.rgb() & 0xffffff, QString("Pen %1").arg(i + 1).toStdString());
+    }
+    if (!writer.close()) {
+        QFile::remove(filename);
+        return false;
+    }
+    return true;
+}
+
+bool PatternExporter::exportToPNG(const QString &filename, const QSize &size) const
+{
+    SPIRO_PROFILE_SCOPE("export.png");
+    if (size.isEmpty()) {
+        return false;
+    }
+#ifdef SPIROBOT_HAVE_ZLIB
+    if (!writeTiledPNG(filename, size, *m_paths, m_parameters.outerRadius, m_lineThickness)) {
+        return false;
+    }
+#else
+    QImage image(size, QImage::Format_ARGB32);
+    if (image.isNull()) {
+        return false;
+    }
+    image.fill(Qt::white);  // Fill with white background
+
+    QPainter painter(&image);
+    paint(painter, size);
+    painter.end();
+
+    if (!image.save(filename, "PNG")) {
+        return false;
+    }
+#endif
+    SPIRO_PROFILE_COUNT(ExportBytes, QFileInfo(filename).size());
+    return true;
+}
+
+bool PatternExporter::exportToGcode(const QString &filename, const GcodeGenerator::Config &config, GcodeStats *stats) const
+{
+    return prepareGcodeExport(filename, config, std::function<void(double)>(), std::function<bool()>(), stats)();
+}
+
+std::function<bool()> PatternExporter::prepareGcodeExport(const QString &filename, const GcodeGenerator::Config &config,
+                                                          std::function<void(double)> progress,
+                                                          std::function<bool()> cancelCheck,
+                                                          GcodeStats *stats) const
+{
+    PatternExporter pattern = *this;
+    return [=]() {
+        SPIRO_PROFILE_SCOPE("export.gcode");
+        std::shared_ptr<const std::vector<SpiroPathBuffer>> paths = pattern.gcodePaths(config, cancelCheck, stats);
+        if (!paths) {
+            return false;
+        }
+
+        GcodeGenerator gcodeGenerator;
+        gcodeGenerator.setProgressCallback(progress);
+        gcodeGenerator.setCancelCheck(cancelCheck);
+        return gcodeGenerator.generateGcode(*paths, config, filename);
+    };
+}
+
+double PatternExporter::estimatePlotTime(const GcodeGenerator::Config &config, std::function<bool()> cancelCheck) const
+{
+    SPIRO_PROFILE_SCOPE("export.estimate");
+    std::shared_ptr<const std::vector<SpiroPathBuffer>> paths = gcodePaths(config, cancelCheck, nullptr);
+    if (!paths) {
+        return -1.0;
+    }
+
+    GcodeGenerator gcodeGenerator;
+    gcodeGenerator.setCancelCheck(cancelCheck);
+    return gcodeGenerator.estimatePlotTime(*paths, config);
+}
+
+std::shared_ptr<const std::vector<SpiroPathBuffer>> PatternExporter::gcodePaths(const GcodeGenerator::Config &config,
+                                                                                const std::function<bool()> &cancelCheck,
+                                                                                GcodeStats *stats) const
+{
+    std::shared_ptr<const std::vector<SpiroPathBuffer>> paths = m_paths;
+
+    // The chord tolerance is given in output millimetres, so resample at the
+    // scale the G-code generator is going to apply to the pattern
+    if (m_sampling.mode == SpiroSampling::Mode::Adaptive && m_bounds.width() > 0 && m_bounds.height() > 0) {
+        SpiroSampling exportSampling = m_sampling;
+        exportSampling.millimetresPerUnit = std::min(config.drawingAreaWidth / m_bounds.width(),
+                                                     config.drawingAreaHeight / m_bounds.height());
+        SpiroGenerator generator(m_parameters, exportSampling);
+        generator.setCancelCheck(cancelCheck);
+        std::shared_ptr<const SpiroGeometry> geometry = SpiroGeometryCache::instance().generate(generator, m_rotations);
+        if (generator.isCancelled()) {
+            return nullptr;
+        }
+
+        auto resampled = std::make_shared<std::vector<SpiroPathBuffer>>(geometry->size());
+        for (std::size_t pen = 0; pen < geometry->size(); ++pen) {
+            (*resampled)[pen].appendStroke((*geometry)[pen]);
+        }
+        paths = resampled;
+    }
+
+    // Stroke order and direction only affect pen-up moves, so they are
+    // settled here, per pen, before the G-code generator sees the paths
+    if (config.optimizeTravel) {
+        SPIRO_PROFILE_SCOPE("export.gcode.travel");
+        auto ordered = std::make_shared<std::vector<SpiroPathBuffer>>(paths->size());
+        std::vector<SpiroTravelReport> reports(paths->size());
+        SpiroTaskPool::instance().parallelFor(paths->size(), [&](std::size_t pen) {
+            const SpiroPathBuffer &path = (*paths)[pen];
+            double startX = path.empty() ? 0.0 : path.x()[0];
+            double startY = path.empty() ? 0.0 : path.y()[0];
+            reports[pen] = optimizeStrokeOrder(path, startX, startY, (*ordered)[pen]);
+        });
+        paths = ordered;
+
+        if (stats) {
+            SpiroBounds exportBounds = boundsOf(*paths);
+            double scale = exportBounds.width() > 0 && exportBounds.height() > 0
+                ? std::min(config.drawingAreaWidth / exportBounds.width(), config.drawingAreaHeight / exportBounds.height())
+                : 1.0;
+            stats->travelBefore = 0.0;
+            stats->travelAfter = 0.0;
+            for (const auto& report : reports) {
+                stats->travelBefore += report.before * scale;
+                stats->travelAfter += report.after * scale;
+            }
+        }
+    }
+    return paths;
+}
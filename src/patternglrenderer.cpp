@@ -0,0 +1,272 @@
+#include "patternglrenderer.h"
+#include "spiroprofiler.h"
+#include <QOpenGLContext>
+#include <QSurfaceFormat>
+#include <QVector2D>
+#include <QVector4D>
+#include <QDebug>
+#include <algorithm>
+
+namespace {
+
+// Attribute locations shared by the shaders and the vertex array setup
+const GLuint cornerLocation = 0;
+const GLuint startLocation = 1;
+const GLuint endLocation = 2;
+
+// corner.x runs along the segment from 0 to 1, corner.y across it from -1
+// to 1. Both ends are pushed out by half the width so consecutive segments
+// overlap at the joints instead of leaving notches on the outside of bends,
+// and the sides by one more pixel for the feathered edge.
+const char *vertexShaderSource = R"(#version 330 core
+layout(location = 0) in vec2 corner;
+layout(location = 1) in vec2 start;
+layout(location = 2) in vec2 end;
+uniform vec2 center;
+uniform vec2 scale;
+uniform vec2 viewport;
+uniform float halfWidth;
+out float across;
+
+void main()
+{
+    vec2 a = (start - center) * scale;
+    vec2 b = (end - center) * scale;
+    vec2 delta = b - a;
+    float len = length(delta);
+    vec2 direction = len > 1e-6 ? delta / len : vec2(1.0, 0.0);
+    vec2 normal = vec2(-direction.y, direction.x);
+    float reach = halfWidth + 1.0;
+
+    vec2 position = mix(a, b, corner.x) + direction * (corner.x * 2.0 - 1.0) * halfWidth + normal * corner.y * reach;
+    across = corner.y * reach;
+    gl_Position = vec4(position * 2.0 / viewport, 0.0, 1.0);
+}
+)";
+
+const char *fragmentShaderSource = R"(#version 330 core
+in float across;
+uniform vec4 color;
+uniform float halfWidth;
+out vec4 fragColor;
+
+void main()
+{
+    float coverage = clamp(halfWidth + 0.5 - abs(across), 0.0, 1.0);
+    fragColor = vec4(color.rgb, color.a * coverage);
+}
+)";
+
+// Lines thinner than a pixel are drawn a pixel wide and faded instead
+const float minimumHalfWidth = 0.5f;
+
+} // namespace
+
+PatternGLRenderer::PatternGLRenderer()
+    : m_program(nullptr), m_cornerBuffer(QOpenGLBuffer::VertexBuffer), m_pointBuffer(QOpenGLBuffer::VertexBuffer),
+      m_ready(false), m_lineThickness(1.0), m_patternId(0), m_uploadedFloats(0), m_bufferFloats(0)
+{
+}
+
+void PatternGLRenderer::setPattern(const std::vector<SpiroPathBuffer> &paths, const QVector<QColor> &colors,
+                                   double lineThickness, quint64 patternId)
+{
+    m_lineThickness = lineThickness;
+    m_penColors = colors;
+
+    bool extend = patternId == m_patternId && m_takenVertices.size() == paths.size();
+    for (std::size_t pen = 0; extend && pen < paths.size(); ++pen) {
+        extend = paths[pen].size() >= m_takenVertices[pen];
+    }
+    if (!extend) {
+        std::size_t total = 0;
+        for (const SpiroPathBuffer &path : paths) {
+            total += path.size();
+        }
+        m_points.clear();
+        m_points.reserve(2 * total);
+        m_strokes.clear();
+        m_bounds = SpiroBounds();
+        m_takenVertices.assign(paths.size(), 0);
+        m_uploadedFloats = 0;
+        m_bufferFloats = 0;
+    }
+    m_patternId = patternId;
+
+    for (std::size_t pen = 0; pen < paths.size(); ++pen) {
+        appendVertices(static_cast<int>(pen), paths[pen], m_takenVertices[pen]);
+        m_takenVertices[pen] = paths[pen].size();
+    }
+
+    // Same framing as DrawingArea: the pattern plus 5% on each side
+    m_boundingBox = QRectF();
+    if (m_bounds.isValid()) {
+        m_boundingBox = QRectF(QPointF(m_bounds.minX, m_bounds.minY), QPointF(m_bounds.maxX, m_bounds.maxY));
+        double margin = std::max(m_boundingBox.width(), m_boundingBox.height()) * 0.05;
+        m_boundingBox.adjust(-margin, -margin, margin, margin);
+    }
+}
+
+// Copies the vertices of path from index from on. A stroke that was already
+// partly copied goes on in a new run that repeats its last copied vertex,
+// so the segment joining the two is drawn too.
+void PatternGLRenderer::appendVertices(int pen, const SpiroPathBuffer &path, std::size_t from)
+{
+    const float *x = path.x();
+    const float *y = path.y();
+    for (std::size_t stroke = 0; stroke < path.strokeCount(); ++stroke) {
+        std::size_t begin = path.strokeBegin(stroke);
+        std::size_t end = path.strokeEnd(stroke);
+        if (end <= from) {
+            continue;
+        }
+        std::size_t first = begin < from ? from - 1 : begin;
+        if (end - first >= 2) {
+            m_strokes.push_back(Stroke{ pen, static_cast<int>(m_points.size() / 2), static_cast<int>(end - first) });
+        }
+        for (std::size_t i = first; i < end; ++i) {
+            m_points.push_back(x[i]);
+            m_points.push_back(y[i]);
+            m_bounds.include(x[i], y[i]);
+        }
+    }
+}
+
+bool PatternGLRenderer::initialize()
+{
+    initializeOpenGLFunctions();
+
+    QSurfaceFormat actual = QOpenGLContext::currentContext()->format();
+    if (actual.version() < qMakePair(3, 3)) {
+        m_error = QString("OpenGL 3.3 is needed, the context has %1.%2")
+                      .arg(actual.majorVersion()).arg(actual.minorVersion());
+        qWarning() << m_error;
+        return false;
+    }
+    m_ready = buildProgram();
+    // A new context has none of the pattern yet
+    m_uploadedFloats = 0;
+    m_bufferFloats = 0;
+    return m_ready;
+}
+
+bool PatternGLRenderer::buildProgram()
+{
+    m_program = new QOpenGLShaderProgram();
+    if (!m_program->addShaderFromSourceCode(QOpenGLShader::Vertex, vertexShaderSource)
+        || !m_program->addShaderFromSourceCode(QOpenGLShader::Fragment, fragmentShaderSource)
+        || !m_program->link()) {
+        m_error = "Shader build failed: " + m_program->log();
+        qWarning() << m_error;
+        return false;
+    }
+
+    m_vertexArray.create();
+    QOpenGLVertexArrayObject::Binder binder(&m_vertexArray);
+
+    const GLfloat corners[] = { 0.0f, -1.0f, 0.0f, 1.0f, 1.0f, -1.0f, 1.0f, 1.0f };
+    m_cornerBuffer.create();
+    m_cornerBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
+    m_cornerBuffer.bind();
+    m_cornerBuffer.allocate(corners, sizeof(corners));
+    glEnableVertexAttribArray(cornerLocation);
+    glVertexAttribPointer(cornerLocation, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+    m_cornerBuffer.release();
+
+    // Both ends of a segment come from the same buffer, one vertex apart,
+    // and advance once per instance
+    m_pointBuffer.create();
+    glEnableVertexAttribArray(startLocation);
+    glEnableVertexAttribArray(endLocation);
+    glVertexAttribDivisor(startLocation, 1);
+    glVertexAttribDivisor(endLocation, 1);
+    return true;
+}
+
+void PatternGLRenderer::release()
+{
+    if (!m_program) {
+        return;
+    }
+    m_vertexArray.destroy();
+    m_cornerBuffer.destroy();
+    m_pointBuffer.destroy();
+    delete m_program;
+    m_program = nullptr;
+    m_ready = false;
+}
+
+// A new pattern is written in full into a buffer of just its size. Points
+// the animation appends are written behind the uploaded ones
+// (glBufferSubData); when they no longer fit, the buffer is reallocated with
+// room for as many again, so a growing pattern is copied whole only a
+// logarithmic number of times.
+void PatternGLRenderer::upload()
+{
+    SPIRO_PROFILE_SCOPE("paint.gl.upload");
+    m_pointBuffer.bind();
+    if (m_bufferFloats == 0 || m_points.size() > m_bufferFloats) {
+        bool growing = m_bufferFloats > 0;
+        m_bufferFloats = growing ? 2 * m_points.size() : m_points.size();
+        m_pointBuffer.setUsagePattern(growing ? QOpenGLBuffer::DynamicDraw : QOpenGLBuffer::StaticDraw);
+        m_pointBuffer.allocate(static_cast<int>(m_bufferFloats * sizeof(float)));
+        m_uploadedFloats = 0;
+    }
+    m_pointBuffer.write(static_cast<int>(m_uploadedFloats * sizeof(float)), m_points.data() + m_uploadedFloats,
+                        static_cast<int>((m_points.size() - m_uploadedFloats) * sizeof(float)));
+    m_pointBuffer.release();
+    m_uploadedFloats = m_points.size();
+}
+
+void PatternGLRenderer::render(const QSize &pixels, qreal devicePixelRatio, const QColor &background)
+{
+    glViewport(0, 0, pixels.width(), pixels.height());
+    glClearColor(background.redF(), background.greenF(), background.blueF(), 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    if (!m_ready) {
+        return;
+    }
+    if (m_uploadedFloats != m_points.size()) {
+        upload();
+    }
+    if (m_strokes.empty() || !m_boundingBox.isValid()) {
+        return;
+    }
+
+    double zoom = std::min(pixels.width() / m_boundingBox.width(), pixels.height() / m_boundingBox.height());
+    float halfWidth = static_cast<float>(m_lineThickness * devicePixelRatio / 2.0);
+    float opacity = halfWidth < minimumHalfWidth ? halfWidth / minimumHalfWidth : 1.0f;
+    halfWidth = std::max(halfWidth, minimumHalfWidth);
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    m_program->bind();
+    m_program->setUniformValue("center", QVector2D(m_boundingBox.center()));
+    // Pattern y grows downwards, like QPainter's
+    m_program->setUniformValue("scale", QVector2D(zoom, -zoom));
+    m_program->setUniformValue("viewport", QVector2D(pixels.width(), pixels.height()));
+    m_program->setUniformValue("halfWidth", halfWidth);
+
+    QOpenGLVertexArrayObject::Binder binder(&m_vertexArray);
+    m_pointBuffer.bind();
+    int currentPen = -1;
+    for (const Stroke &stroke : m_strokes) {
+        if (stroke.pen != currentPen) {
+            currentPen = stroke.pen;
+            QColor color = m_penColors.value(currentPen, Qt::black);
+            m_program->setUniformValue("color", QVector4D(color.redF(), color.greenF(), color.blueF(),
+                                                          color.alphaF() * opacity));
+        }
+        const std::size_t offset = static_cast<std::size_t>(stroke.first) * 2 * sizeof(float);
+        glVertexAttribPointer(startLocation, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float),
+                              reinterpret_cast<const void *>(offset));
+        glVertexAttribPointer(endLocation, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float),
+                              reinterpret_cast<const void *>(offset + 2 * sizeof(float)));
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, stroke.count - 1);
+    }
+    m_pointBuffer.release();
+    m_program->release();
+    glDisable(GL_BLEND);
+}
@@ -0,0 +1,77 @@
+#include "patternglview.h"
+#include "drawingarea.h"
+#include "spiroprofiler.h"
+#include <QOpenGLContext>
+#include <QPainter>
+#include <QSurfaceFormat>
+
+PatternGLView::PatternGLView(QWidget *parent)
+    : QOpenGLWidget(parent), performanceOverlayVisible(false)
+{
+    QSurfaceFormat format = QSurfaceFormat::defaultFormat();
+    format.setVersion(3, 3);
+    format.setProfile(QSurfaceFormat::CoreProfile);
+    setFormat(format);
+
+    performanceOverlayTimer = new QTimer(this);
+    performanceOverlayTimer->setInterval(500);
+    connect(performanceOverlayTimer, &QTimer::timeout, this, QOverload<>::of(&PatternGLView::update));
+}
+
+PatternGLView::~PatternGLView()
+{
+    releaseGL();
+}
+
+void PatternGLView::setPattern(const std::vector<SpiroPathBuffer> &paths, const QVector<QColor> &colors,
+                               double lineThickness, quint64 patternId)
+{
+    renderer.setPattern(paths, colors, lineThickness, patternId);
+    update();
+}
+
+void PatternGLView::setPerformanceOverlayVisible(bool visible)
+{
+    performanceOverlayVisible = visible;
+    if (visible) {
+        performanceOverlayTimer->start();
+    } else {
+        performanceOverlayTimer->stop();
+    }
+    update();
+}
+
+void PatternGLView::initializeGL()
+{
+    // Moving the widget to another window replaces the context; everything
+    // is then rebuilt and uploaded again here
+    connect(context(), &QOpenGLContext::aboutToBeDestroyed, this, &PatternGLView::releaseGL, Qt::UniqueConnection);
+    renderer.initialize();
+}
+
+void PatternGLView::releaseGL()
+{
+    if (!context()) {
+        return;
+    }
+    makeCurrent();
+    renderer.release();
+    doneCurrent();
+}
+
+void PatternGLView::paintGL()
+{
+    SPIRO_PROFILE_SCOPE("paint.gl");
+    const qreal ratio = devicePixelRatioF();
+    renderer.render(size() * ratio, ratio, palette().color(QPalette::Base));
+
+    if (!renderer.isReady() || performanceOverlayVisible) {
+        QPainter painter(this);
+        if (!renderer.isReady()) {
+            painter.drawText(rect(), Qt::AlignCenter, renderer.error());
+        }
+        if (performanceOverlayVisible) {
+            DrawingArea::drawPerformanceOverlay(painter);
+        }
+    }
+}
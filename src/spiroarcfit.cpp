@@ -0,0 +1,201 @@
+#include "spiroarcfit.h"
+#include <cmath>
+
+namespace {
+
+// A full turn cannot be told apart from no turn at all by its end points.
+// Small loops can come back closer than this to their start; fitsArc also
+// checks the end points against the output step.
+const double maxArcSweep = 2 * M_PI - 1e-3;
+
+struct Circle
+{
+    double cx;
+    double cy;
+    double r;
+};
+
+// Vertices s..e all lie within tolerance of the segment from s to e, in order
+bool fitsLine(const double* x, const double* y, std::size_t s, std::size_t e, double tolerance)
+{
+    double dx = x[e] - x[s], dy = y[e] - y[s];
+    double lengthSquared = dx * dx + dy * dy;
+    if (lengthSquared <= 0.0) {
+        return false;
+    }
+
+    double length = std::sqrt(lengthSquared);
+    double slack = tolerance / length;
+    double previous = 0.0;
+    for (std::size_t i = s + 1; i < e; ++i) {
+        double px = x[i] - x[s], py = y[i] - y[s];
+        if (std::fabs(dx * py - dy * px) > tolerance * length) {
+            return false;
+        }
+        // Doubling back along the line would be dropped by the merge
+        double along = (dx * px + dy * py) / lengthSquared;
+        if (along < previous - slack || along > 1.0 + slack) {
+            return false;
+        }
+        previous = along;
+    }
+    return true;
+}
+
+bool circleThrough(double x1, double y1, double x2, double y2, double x3, double y3, Circle& circle)
+{
+    double bx = x2 - x1, by = y2 - y1;
+    double cx = x3 - x1, cy = y3 - y1;
+    double d = 2.0 * (bx * cy - by * cx);
+    if (std::fabs(d) < 1e-12) {
+        return false;
+    }
+
+    double b2 = bx * bx + by * by;
+    double c2 = cx * cx + cy * cy;
+    double ux = (cy * b2 - by * c2) / d;
+    double uy = (bx * c2 - cx * b2) / d;
+    circle.cx = x1 + ux;
+    circle.cy = y1 + uy;
+    circle.r = std::hypot(ux, uy);
+    return true;
+}
+
+// Vertices s..e, and the chords between them, lie within tolerance of the
+// circle through s, the middle vertex and e, turning one way only
+bool fitsArc(const double* x, const double* y, std::size_t s, std::size_t e, const SpiroFitSettings& settings,
+             Circle& circle, bool& clockwise)
+{
+    if (e < s + 3) {
+        return false;
+    }
+    // Rounding moves each coordinate by at most half a step, so ends more
+    // than a step apart on either axis are still apart once written
+    if (std::fabs(x[e] - x[s]) <= settings.outputQuantum && std::fabs(y[e] - y[s]) <= settings.outputQuantum) {
+        return false;
+    }
+
+    std::size_t m = s + (e - s) / 2;
+    if (!circleThrough(x[s], y[s], x[m], y[m], x[e], y[e], circle) || circle.r > settings.maxArcRadius) {
+        return false;
+    }
+
+    double turn = (x[m] - x[s]) * (y[e] - y[m]) - (y[m] - y[s]) * (x[e] - x[m]);
+    clockwise = turn < 0.0;
+
+    double tolerance = settings.arcTolerance;
+    double swept = 0.0;
+    double ax = x[s] - circle.cx, ay = y[s] - circle.cy;
+    for (std::size_t i = s + 1; i <= e; ++i) {
+        double bx = x[i] - circle.cx, by = y[i] - circle.cy;
+        if (std::fabs(std::hypot(bx, by) - circle.r) > tolerance) {
+            return false;
+        }
+        double mx = 0.5 * (ax + bx), my = 0.5 * (ay + by);
+        if (std::fabs(std::hypot(mx, my) - circle.r) > tolerance) {
+            return false;
+        }
+
+        double step = std::atan2(ax * by - ay * bx, ax * bx + ay * by);
+        if (clockwise ? step >= 0.0 : step <= 0.0) {
+            return false;
+        }
+        swept += std::fabs(step);
+        if (swept > maxArcSweep) {
+            return false;
+        }
+
+        ax = bx;
+        ay = by;
+    }
+    return true;
+}
+
+// Furthest end in [minEnd, last] for which fits(end) holds, found by doubling
+// the run and then bisecting, or s if not even minEnd fits. Fitting is not
+// strictly monotonic in the run length, so this is a good end, not
+// necessarily the best one.
+template <typename Fits>
+std::size_t longestRun(std::size_t s, std::size_t minEnd, std::size_t last, Fits fits)
+{
+    if (minEnd > last || !fits(minEnd)) {
+        return s;
+    }
+
+    std::size_t good = minEnd;
+    std::size_t bad = last + 1;
+    std::size_t step = 1;
+    while (good < last) {
+        std::size_t probe = good + step < last ? good + step : last;
+        if (!fits(probe)) {
+            bad = probe;
+            break;
+        }
+        good = probe;
+        step *= 2;
+    }
+    while (bad - good > 1 && good < last) {
+        std::size_t probe = good + (bad - good) / 2;
+        if (fits(probe)) {
+            good = probe;
+        } else {
+            bad = probe;
+        }
+    }
+    return good;
+}
+
+} // namespace
+
+void fitPolyline(const double* x, const double* y, std::size_t count, const SpiroFitSettings& settings,
+                 std::vector<SpiroMove>& moves)
+{
+    if (count < 2) {
+        return;
+    }
+
+    const std::size_t last = count - 1;
+    std::size_t s = 0;
+    while (s < last) {
+        std::size_t lineEnd = s + 1;
+        if (settings.mergeTolerance > 0.0) {
+            std::size_t run = longestRun(s, s + 2, last, [&](std::size_t e) {
+                return fitsLine(x, y, s, e, settings.mergeTolerance);
+            });
+            if (run > s) {
+                lineEnd = run;
+            }
+        }
+
+        std::size_t arcEnd = s;
+        if (settings.arcTolerance > 0.0) {
+            Circle circle;
+            bool clockwise;
+            arcEnd = longestRun(s, s + 3, last, [&](std::size_t e) {
+                return fitsArc(x, y, s, e, settings, circle, clockwise);
+            });
+        }
+
+        Circle circle;
+        bool clockwise = false;
+        if (arcEnd > lineEnd && fitsArc(x, y, s, arcEnd, settings, circle, clockwise)) {
+            SpiroMove move;
+            move.type = clockwise ? SpiroMove::Type::ClockwiseArc : SpiroMove::Type::CounterClockwiseArc;
+            move.x = x[arcEnd];
+            move.y = y[arcEnd];
+            move.i = circle.cx - x[s];
+            move.j = circle.cy - y[s];
+            moves.push_back(move);
+            s = arcEnd;
+        } else {
+            SpiroMove move;
+            move.type = SpiroMove::Type::Line;
+            move.x = x[lineEnd];
+            move.y = y[lineEnd];
+            move.i = 0.0;
+            move.j = 0.0;
+            moves.push_back(move);
+            s = lineEnd;
+        }
+    }
+}
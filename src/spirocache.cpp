@@ -0,0 +1,314 @@
+#include "spirocache.h"
+#include "spiroprofiler.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <iterator>
+#include <tuple>
+
+namespace {
+
+// File layout revision; the generator's output version follows it
+const char cacheMagic[8] = { 'S', 'P', 'I', 'R', 'O', 'G', 'C', '2' };
+
+std::size_t geometryBytes(const SpiroGeometry& geometry)
+{
+    std::size_t bytes = sizeof(SpiroGeometry);
+    for (const SpiroPolyline& polyline : geometry) {
+        bytes += sizeof(SpiroPolyline) + (polyline.x.capacity() + polyline.y.capacity()) * sizeof(double);
+    }
+    return bytes;
+}
+
+template <typename T>
+bool writeValue(std::FILE* file, const T& value)
+{
+    return std::fwrite(&value, sizeof(T), 1, file) == 1;
+}
+
+template <typename T>
+bool readValue(std::FILE* file, T& value)
+{
+    return std::fread(&value, sizeof(T), 1, file) == 1;
+}
+
+// Fixed-width fields, so the layout does not depend on the compiler's padding
+bool writeKey(std::FILE* file, const SpiroGeometryKey& key)
+{
+    return writeValue<std::int32_t>(file, key.outerRadius) && writeValue<std::int32_t>(file, key.innerRadius)
+        && writeValue<std::int32_t>(file, key.penOffset) && writeValue<std::int32_t>(file, key.rotations)
+        && writeValue<std::int32_t>(file, key.numPens) && writeValue(file, key.rotationOffset)
+        && writeValue<std::int32_t>(file, key.mode) && writeValue(file, key.stepSize)
+        && writeValue(file, key.tolerance) && writeValue<std::uint8_t>(file, key.rotationRecurrence)
+        && writeValue<std::uint8_t>(file, key.exploitSymmetry);
+}
+
+bool readKey(std::FILE* file, SpiroGeometryKey& key)
+{
+    std::int32_t outerRadius, innerRadius, penOffset, rotations, numPens, mode;
+    std::uint8_t rotationRecurrence, exploitSymmetry;
+    if (!(readValue(file, outerRadius) && readValue(file, innerRadius) && readValue(file, penOffset)
+          && readValue(file, rotations) && readValue(file, numPens) && readValue(file, key.rotationOffset)
+          && readValue(file, mode) && readValue(file, key.stepSize) && readValue(file, key.tolerance)
+          && readValue(file, rotationRecurrence) && readValue(file, exploitSymmetry))) {
+        return false;
+    }
+    key.outerRadius = outerRadius;
+    key.innerRadius = innerRadius;
+    key.penOffset = penOffset;
+    key.rotations = rotations;
+    key.numPens = numPens;
+    key.mode = mode;
+    key.rotationRecurrence = rotationRecurrence != 0;
+    key.exploitSymmetry = exploitSymmetry != 0;
+    return true;
+}
+
+} // namespace
+
+SpiroGeometryKey::SpiroGeometryKey(const SpiroParameters& params, const SpiroSampling& sampling, int rotations)
+    : outerRadius(params.outerRadius), innerRadius(params.innerRadius), penOffset(params.penOffset),
+      rotations(rotations), numPens(params.numPens), rotationOffset(std::fmod(params.rotationOffset, 360.0)),
+      mode(static_cast<int>(sampling.mode)), stepSize(0.0), tolerance(0.0), rotationRecurrence(false),
+      exploitSymmetry(sampling.exploitSymmetry)
+{
+    if (rotationOffset < 0.0) {
+        rotationOffset += 360.0;
+    }
+    if (sampling.mode == SpiroSampling::Mode::FixedStep) {
+        stepSize = sampling.stepSize;
+        rotationRecurrence = sampling.rotationRecurrence;
+    } else {
+        tolerance = sampling.chordTolerance / sampling.millimetresPerUnit;
+    }
+}
+
+bool SpiroGeometryKey::operator<(const SpiroGeometryKey& other) const
+{
+    return std::tie(outerRadius, innerRadius, penOffset, rotations, numPens, rotationOffset, mode, stepSize,
+                    tolerance, rotationRecurrence, exploitSymmetry)
+         < std::tie(other.outerRadius, other.innerRadius, other.penOffset, other.rotations, other.numPens,
+                    other.rotationOffset, other.mode, other.stepSize, other.tolerance, other.rotationRecurrence,
+                    other.exploitSymmetry);
+}
+
+SpiroGeometryCache::SpiroGeometryCache(std::size_t budgetBytes)
+    : m_budget(budgetBytes), m_used(0)
+{
+}
+
+SpiroGeometryCache& SpiroGeometryCache::instance()
+{
+    static SpiroGeometryCache cache;
+    return cache;
+}
+
+void SpiroGeometryCache::setBudget(std::size_t budgetBytes)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_budget = budgetBytes;
+    evictToBudget();
+}
+
+std::size_t SpiroGeometryCache::budget() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_budget;
+}
+
+std::size_t SpiroGeometryCache::usedBytes() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_used;
+}
+
+std::size_t SpiroGeometryCache::entryCount() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_entries.size();
+}
+
+void SpiroGeometryCache::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries.clear();
+    m_index.clear();
+    m_used = 0;
+}
+
+std::shared_ptr<const SpiroGeometry> SpiroGeometryCache::find(const SpiroGeometryKey& key)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_index.find(key);
+    if (it == m_index.end()) {
+        return nullptr;
+    }
+    m_entries.splice(m_entries.begin(), m_entries, it->second);
+    return it->second->geometry;
+}
+
+void SpiroGeometryCache::insert(const SpiroGeometryKey& key, std::shared_ptr<const SpiroGeometry> geometry)
+{
+    if (!geometry) {
+        return;
+    }
+    std::size_t bytes = geometryBytes(*geometry);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_index.find(key);
+    if (it != m_index.end()) {
+        m_used -= it->second->bytes;
+        m_entries.erase(it->second);
+        m_index.erase(it);
+    }
+    if (bytes > m_budget) {
+        return;
+    }
+
+    m_entries.push_front(Entry{ key, std::move(geometry), bytes });
+    m_index.emplace(key, m_entries.begin());
+    m_used += bytes;
+    evictToBudget();
+}
+
+void SpiroGeometryCache::evictToBudget()
+{
+    while (m_used > m_budget && !m_entries.empty()) {
+        const Entry& oldest = m_entries.back();
+        m_used -= oldest.bytes;
+        m_index.erase(oldest.key);
+        m_entries.pop_back();
+    }
+}
+
+std::shared_ptr<const SpiroGeometry> SpiroGeometryCache::generate(const SpiroGenerator& generator, int rotations)
+{
+    SpiroGeometryKey key(generator.parameters(), generator.sampling(), rotations);
+    if (auto cached = find(key)) {
+        SPIRO_PROFILE_COUNT(CacheHits, 1);
+        return cached;
+    }
+    SPIRO_PROFILE_COUNT(CacheMisses, 1);
+
+    auto geometry = std::make_shared<const SpiroGeometry>(generator.generate(rotations));
+    if (!generator.isCancelled()) {
+        insert(key, geometry);
+    }
+    return geometry;
+}
+
+bool SpiroGeometryCache::save(const std::string& path, std::size_t maxBytes) const
+{
+    // Written under a temporary name first, so an interrupted save never
+    // leaves a truncated cache behind
+    std::string temporaryPath = path + ".tmp";
+    std::FILE* file = std::fopen(temporaryPath.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+
+    bool ok;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        // Most recently used first, skipping whatever no longer fits
+        std::vector<const Entry*> kept;
+        std::size_t bytes = 0;
+        for (const Entry& entry : m_entries) {
+            if (bytes + entry.bytes <= maxBytes) {
+                kept.push_back(&entry);
+                bytes += entry.bytes;
+            }
+        }
+        ok = std::fwrite(cacheMagic, sizeof(cacheMagic), 1, file) == 1
+            && writeValue<std::int32_t>(file, SpiroGenerator::outputVersion)
+            && writeValue<std::uint64_t>(file, kept.size());
+        for (auto it = kept.begin(); ok && it != kept.end(); ++it) {
+            ok = writeKey(file, (*it)->key) && writeValue<std::uint64_t>(file, (*it)->geometry->size());
+            for (const SpiroPolyline& polyline : *(*it)->geometry) {
+                std::size_t count = polyline.size();
+                ok = ok && writeValue<std::uint64_t>(file, count)
+                    && std::fwrite(polyline.x.data(), sizeof(double), count, file) == count
+                    && std::fwrite(polyline.y.data(), sizeof(double), count, file) == count;
+            }
+        }
+    }
+
+    ok = std::fclose(file) == 0 && ok;
+    if (ok && std::rename(temporaryPath.c_str(), path.c_str()) != 0) {
+        // Not every platform renames over an existing file
+        std::remove(path.c_str());
+        ok = std::rename(temporaryPath.c_str(), path.c_str()) == 0;
+    }
+    if (!ok) {
+        std::remove(temporaryPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool SpiroGeometryCache::load(const std::string& path)
+{
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+
+    // No count in the file can be trusted beyond what the file could hold
+    std::fseek(file, 0, SEEK_END);
+    long fileSize = std::ftell(file);
+    std::fseek(file, 0, SEEK_SET);
+    const std::uint64_t maxCount = fileSize > 0 ? static_cast<std::uint64_t>(fileSize) : 0;
+
+    std::vector<std::pair<SpiroGeometryKey, std::shared_ptr<const SpiroGeometry>>> loaded;
+    char magic[sizeof(cacheMagic)];
+    std::int32_t version = 0;
+    std::uint64_t entryCount = 0;
+    // Geometry from another generator version would silently differ from
+    // what this build generates
+    bool ok = std::fread(magic, sizeof(magic), 1, file) == 1
+        && std::equal(magic, magic + sizeof(magic), cacheMagic)
+        && readValue(file, version) && version == SpiroGenerator::outputVersion
+        && readValue(file, entryCount) && entryCount <= maxCount;
+    for (std::uint64_t entry = 0; ok && entry < entryCount; ++entry) {
+        SpiroGeometryKey key(SpiroParameters(), SpiroSampling(), 0);
+        std::uint64_t penCount = 0;
+        ok = readKey(file, key) && readValue(file, penCount) && penCount <= maxCount;
+
+        auto geometry = std::make_shared<SpiroGeometry>();
+        for (std::uint64_t pen = 0; ok && pen < penCount; ++pen) {
+            std::uint64_t count = 0;
+            ok = readValue(file, count) && count <= maxCount / (2 * sizeof(double));
+            if (ok) {
+                SpiroPolyline polyline;
+                polyline.x.resize(count);
+                polyline.y.resize(count);
+                ok = std::fread(polyline.x.data(), sizeof(double), count, file) == count
+                    && std::fread(polyline.y.data(), sizeof(double), count, file) == count;
+                geometry->push_back(std::move(polyline));
+            }
+        }
+        if (ok) {
+            loaded.emplace_back(key, std::move(geometry));
+        }
+    }
+    std::fclose(file);
+    if (!ok) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& item : loaded) {
+        std::size_t bytes = geometryBytes(*item.second);
+        if (m_used + bytes > m_budget) {
+            break;
+        }
+        if (m_index.count(item.first) != 0) {
+            continue;
+        }
+        m_entries.push_back(Entry{ item.first, std::move(item.second), bytes });
+        m_index.emplace(item.first, std::prev(m_entries.end()));
+        m_used += bytes;
+    }
+    return true;
+}
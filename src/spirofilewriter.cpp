@@ -0,0 +1,160 @@
+#include "spirofilewriter.h"
+#include "spiroprofiler.h"
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+const long long powersOfTen[] = {
+    1LL, 10LL, 100LL, 1000LL, 10000LL, 100000LL, 1000000LL, 10000000LL, 100000000LL, 1000000000LL
+};
+
+// Largest scaled magnitude that still fits the integer fast path exactly
+const double maxScaledValue = 9.0e15;
+
+// Writes the decimal digits of value backwards, ending just before end
+char* formatDigits(unsigned long long value, char* end)
+{
+    do {
+        *--end = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    return end;
+}
+
+} // namespace
+
+SpiroFileWriter::SpiroFileWriter(std::size_t bufferSize)
+    : m_file(nullptr), m_buffer(bufferSize < 64 ? 64 : bufferSize), m_used(0), m_failed(false)
+{
+}
+
+SpiroFileWriter::~SpiroFileWriter()
+{
+    close();
+}
+
+bool SpiroFileWriter::open(const std::string& path)
+{
+    close();
+    m_failed = false;
+    m_used = 0;
+
+    m_file = std::fopen(path.c_str(), "w");
+    if (!m_file) {
+        m_failed = true;
+        return false;
+    }
+    // Our own buffer already batches the writes
+    std::setvbuf(m_file, nullptr, _IONBF, 0);
+    return true;
+}
+
+bool SpiroFileWriter::close()
+{
+    if (m_file) {
+        flush();
+        if (std::fclose(m_file) != 0) {
+            m_failed = true;
+        }
+        m_file = nullptr;
+    }
+    return !m_failed;
+}
+
+void SpiroFileWriter::flush()
+{
+    if (m_used == 0) {
+        return;
+    }
+    if (!m_file || std::fwrite(m_buffer.data(), 1, m_used, m_file) != m_used) {
+        m_failed = true;
+    } else {
+        SPIRO_PROFILE_COUNT(ExportBytes, m_used);
+    }
+    m_used = 0;
+}
+
+char* SpiroFileWriter::reserve(std::size_t length)
+{
+    if (m_buffer.size() - m_used < length) {
+        flush();
+    }
+    return m_buffer.data() + m_used;
+}
+
+void SpiroFileWriter::write(const char* text, std::size_t length)
+{
+    if (length > m_buffer.size()) {
+        flush();
+        if (!m_file || std::fwrite(text, 1, length, m_file) != length) {
+            m_failed = true;
+        }
+        return;
+    }
+
+    std::memcpy(reserve(length), text, length);
+    m_used += length;
+}
+
+void SpiroFileWriter::write(const char* text)
+{
+    write(text, std::strlen(text));
+}
+
+void SpiroFileWriter::writeInt(long long value)
+{
+    char digits[24];
+    char* end = digits + sizeof(digits);
+    unsigned long long magnitude = value < 0 ? 0ULL - static_cast<unsigned long long>(value)
+                                             : static_cast<unsigned long long>(value);
+    char* begin = formatDigits(magnitude, end);
+    if (value < 0) {
+        *--begin = '-';
+    }
+    write(begin, end - begin);
+}
+
+void SpiroFileWriter::writeFixed(double value, int decimals, bool trimZeros)
+{
+    decimals = decimals < 0 ? 0 : (decimals > 9 ? 9 : decimals);
+
+    double scaled = value * powersOfTen[decimals];
+    if (!std::isfinite(scaled) || std::fabs(scaled) >= maxScaledValue) {
+        // Out of the exact integer range; rare enough to go through printf
+        char text[64];
+        int length = std::snprintf(text, sizeof(text), "%.*f", decimals, value);
+        if (length > 0) {
+            write(text, static_cast<std::size_t>(length) < sizeof(text) ? length : sizeof(text) - 1);
+        }
+        return;
+    }
+
+    long long rounded = std::llround(scaled);
+    unsigned long long magnitude = static_cast<unsigned long long>(rounded < 0 ? -rounded : rounded);
+    unsigned long long whole = magnitude / powersOfTen[decimals];
+    unsigned long long fraction = magnitude % powersOfTen[decimals];
+
+    if (trimZeros) {
+        while (decimals > 0 && fraction % 10 == 0) {
+            fraction /= 10;
+            --decimals;
+        }
+    }
+
+    char text[48];
+    char* end = text + sizeof(text);
+    char* begin = end;
+    if (decimals > 0) {
+        for (int i = 0; i < decimals; ++i) {
+            *--begin = static_cast<char>('0' + fraction % 10);
+            fraction /= 10;
+        }
+        *--begin = '.';
+    }
+    begin = formatDigits(whole, begin);
+    if (rounded < 0) {
+        *--begin = '-';
+    }
+    write(begin, end - begin);
+}
@@ -0,0 +1,512 @@
+#include "spirogenerator.h"
+#include "spiroprofiler.h"
+#include "spirotaskpool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <numeric>
+#include <utility>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+namespace {
+
+// Bounds for the adaptive step, in radians of t
+const double minAdaptiveStep = 1e-5;
+const double maxAdaptiveAngle = M_PI / 16;
+
+// Work split for the task pool: fixed-step chunks are counted in samples,
+// adaptive chunks in radians of t
+const std::size_t fixedChunkSamples = 8192;
+const double adaptiveChunkAngle = M_PI / 2;
+
+// Points rotated per task when replicating lobes
+const std::size_t replicationChunkSamples = 16384;
+
+double distanceToChord(double px, double py, double ax, double ay, double bx, double by)
+{
+    double cx = bx - ax;
+    double cy = by - ay;
+    double length = std::hypot(cx, cy);
+    if (length < 1e-12) {
+        return std::hypot(px - ax, py - ay);
+    }
+    return std::fabs(cx * (py - ay) - cy * (px - ax)) / length;
+}
+
+} // namespace
+
+SpiroParameters::SpiroParameters()
+    : outerRadius(100), innerRadius(50), penOffset(25), rotations(5), numPens(1), rotationOffset(0)
+{
+}
+
+SpiroSampling::SpiroSampling()
+    : mode(Mode::Adaptive), stepSize(0.01), chordTolerance(0.05), millimetresPerUnit(1.0),
+      rotationRecurrence(true), exploitSymmetry(true)
+{
+}
+
+SpiroGenerator::SpiroGenerator(const SpiroParameters& params, const SpiroSampling& sampling)
+    : m_params(params), m_sampling(sampling)
+{
+}
+
+void SpiroGenerator::setCancelCheck(std::function<bool()> check)
+{
+    m_cancelCheck = std::move(check);
+}
+
+bool SpiroGenerator::isCancelled() const
+{
+    return m_cancelCheck && m_cancelCheck();
+}
+
+double SpiroGenerator::penAngleOffset(int pen) const
+{
+    double rotationOffsetRad = m_params.rotationOffset * M_PI / 180.0;
+    return 2 * M_PI * pen / m_params.numPens + rotationOffsetRad;
+}
+
+TrochoidCoefficients SpiroGenerator::coefficients(int pen) const
+{
+    TrochoidCoefficients c;
+    c.a = static_cast<double>(m_params.outerRadius - m_params.innerRadius);
+    c.b = static_cast<double>(m_params.penOffset);
+    c.k = c.a / m_params.innerRadius;
+    c.phase = penAngleOffset(pen);
+    return c;
+}
+
+int SpiroGenerator::rotationsToClose(int outerRadius, int innerRadius)
+{
+    if (innerRadius == 0) {
+        return 1;
+    }
+    // The inner gear's angle k t with k = (R - r) / r must also be a multiple
+    // of 2 pi, which first happens after r / gcd(R - r, r) rotations
+    int divisor = std::gcd(std::abs(outerRadius - innerRadius), std::abs(innerRadius));
+    return std::abs(innerRadius) / divisor;
+}
+
+int SpiroGenerator::rotationsToClose() const
+{
+    return rotationsToClose(m_params.outerRadius, m_params.innerRadius);
+}
+
+double SpiroGenerator::lobeAngle() const
+{
+    // z(t + d) = e^(i d) z(t) requires (k + 1) d to be a multiple of 2 pi,
+    // and k + 1 = R / r
+    return 2 * M_PI * m_params.innerRadius / m_params.outerRadius;
+}
+
+int SpiroGenerator::symmetryOrder() const
+{
+    return std::abs(m_params.outerRadius) / std::gcd(std::abs(m_params.outerRadius), std::abs(m_params.innerRadius));
+}
+
+void SpiroGenerator::evaluate(int pen, double t, double& x, double& y) const
+{
+    TrochoidCoefficients c = coefficients(pen);
+    double innerAngle = c.k * t + c.phase;
+
+    x = c.a * std::cos(t) + c.b * std::cos(innerAngle);
+    y = c.a * std::sin(t) - c.b * std::sin(innerAngle);
+}
+
+void SpiroGenerator::evaluateDerivatives(int pen, double t, double& dx, double& dy, double& ddx, double& ddy) const
+{
+    TrochoidCoefficients c = coefficients(pen);
+    double innerAngle = c.k * t + c.phase;
+
+    double cosT = std::cos(t), sinT = std::sin(t);
+    double cosI = std::cos(innerAngle), sinI = std::sin(innerAngle);
+
+    dx = -c.a * sinT - c.b * c.k * sinI;
+    dy = c.a * cosT - c.b * c.k * cosI;
+    ddx = -c.a * cosT - c.b * c.k * c.k * cosI;
+    ddy = -c.a * sinT + c.b * c.k * c.k * sinI;
+}
+
+double SpiroGenerator::curvatureStep(int pen, double t, double tolerance) const
+{
+    double dx, dy, ddx, ddy;
+    evaluateDerivatives(pen, t, dx, dy, ddx, ddy);
+
+    // The sagitta of a chord spanning dt is roughly an * dt^2 / 8, where an is
+    // the normal acceleration. Near cusps the speed vanishes and the normal
+    // direction is undefined, so fall back to the full acceleration there.
+    double speed = std::hypot(dx, dy);
+    double accel = std::hypot(ddx, ddy);
+    double normalAccel = speed > 1e-9 ? std::fabs(dx * ddy - dy * ddx) / speed : accel;
+    normalAccel = std::max(normalAccel, 1e-9);
+
+    return std::sqrt(8.0 * tolerance / normalAccel);
+}
+
+SpiroPolyline SpiroGenerator::generatePen(int pen, int rotations) const
+{
+    if (pen < 0 || pen >= m_params.numPens || m_params.innerRadius == 0) {
+        return SpiroPolyline();
+    }
+    return std::move(generatePens(pen, 1, rotations).front());
+}
+
+std::vector<SpiroPolyline> SpiroGenerator::generatePens(int firstPen, int penCount, int rotations) const
+{
+    SPIRO_PROFILE_SCOPE("generate");
+    std::vector<SpiroPolyline> paths(penCount);
+    if (rotations <= 0) {
+        return paths;
+    }
+
+    double tEnd = 2 * M_PI * rotations;
+    if (m_sampling.exploitSymmetry && m_params.outerRadius > 0 && m_params.innerRadius > 0) {
+        generateSymmetric(firstPen, tEnd, paths);
+    } else if (m_sampling.mode == SpiroSampling::Mode::Adaptive) {
+        generateAdaptive(firstPen, tEnd, paths);
+    } else {
+        generateFixed(firstPen, tEnd, paths);
+    }
+    for (const SpiroPolyline& path : paths) {
+        SPIRO_PROFILE_COUNT(VerticesGenerated, path.size());
+    }
+    return paths;
+}
+
+double SpiroGenerator::fixedStepSize() const
+{
+    return m_sampling.stepSize > 0 ? m_sampling.stepSize : 0.01;
+}
+
+std::size_t SpiroGenerator::fixedStepsPerRotation() const
+{
+    return static_cast<std::size_t>(2 * M_PI / fixedStepSize());
+}
+
+void SpiroGenerator::sampleFixed(int pen, std::size_t firstIndex, std::size_t count, double *x, double *y) const
+{
+    double stepSize = fixedStepSize();
+    TrochoidCoefficients c = coefficients(pen);
+
+    if (m_sampling.rotationRecurrence) {
+        evaluateTrochoidRecurrence(c, firstIndex * stepSize, stepSize, count, x, y);
+        return;
+    }
+
+    std::vector<double> t(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        t[i] = (firstIndex + i) * stepSize;
+    }
+    evaluateTrochoidBatch(c, t.data(), count, x, y);
+}
+
+void SpiroGenerator::generateFixed(int firstPen, double tEnd, std::vector<SpiroPolyline>& paths) const
+{
+    int rotations = static_cast<int>(std::lround(tEnd / (2 * M_PI)));
+    std::size_t count = fixedStepsPerRotation() * rotations + 1;
+    std::size_t chunks = (count + fixedChunkSamples - 1) / fixedChunkSamples;
+
+    for (auto& path : paths) {
+        path.x.resize(count);
+        path.y.resize(count);
+    }
+
+    // Each task owns a disjoint slice of one pen's buffers, so the result is
+    // already in order when the loop finishes
+    SpiroTaskPool::instance().parallelFor(paths.size() * chunks, [&](std::size_t task) {
+        if (isCancelled()) {
+            return;
+        }
+
+        std::size_t penIndex = task / chunks;
+        std::size_t begin = (task % chunks) * fixedChunkSamples;
+        std::size_t length = std::min(fixedChunkSamples, count - begin);
+        SpiroPolyline& path = paths[penIndex];
+        sampleFixed(firstPen + static_cast<int>(penIndex), begin, length,
+                    path.x.data() + begin, path.y.data() + begin);
+    });
+}
+
+void SpiroGenerator::generateAdaptive(int firstPen, double tEnd, std::vector<SpiroPolyline>& paths) const
+{
+    std::size_t maxChunks = 4 * static_cast<std::size_t>(SpiroTaskPool::instance().concurrency());
+    std::size_t chunks = std::max<std::size_t>(1, std::min(maxChunks,
+        static_cast<std::size_t>(std::ceil(tEnd / adaptiveChunkAngle))));
+
+    std::vector<SpiroPolyline> pieces(paths.size() * chunks);
+    SpiroTaskPool::instance().parallelFor(pieces.size(), [&](std::size_t task) {
+        if (isCancelled()) {
+            return;
+        }
+
+        std::size_t chunk = task % chunks;
+        int pen = firstPen + static_cast<int>(task / chunks);
+        double tBegin = tEnd * chunk / chunks;
+        double tChunkEnd = chunk + 1 == chunks ? tEnd : tEnd * (chunk + 1) / chunks;
+        sampleAdaptive(pen, tBegin, tChunkEnd, pieces[task]);
+    });
+
+    if (isCancelled()) {
+        return;
+    }
+
+    // Stitch the chunks; each one starts on the previous chunk's last point
+    for (std::size_t penIndex = 0; penIndex < paths.size(); ++penIndex) {
+        SpiroPolyline& path = paths[penIndex];
+        std::size_t total = 0;
+        for (std::size_t chunk = 0; chunk < chunks; ++chunk) {
+            total += pieces[penIndex * chunks + chunk].size();
+        }
+        path.reserve(total);
+
+        for (std::size_t chunk = 0; chunk < chunks; ++chunk) {
+            const SpiroPolyline& piece = pieces[penIndex * chunks + chunk];
+            std::size_t skip = (chunk == 0 || piece.empty()) ? 0 : 1;
+            path.x.insert(path.x.end(), piece.x.begin() + skip, piece.x.end());
+            path.y.insert(path.y.end(), piece.y.begin() + skip, piece.y.end());
+        }
+    }
+}
+
+void SpiroGenerator::sampleSpan(int pen, double span, double gridStep, SpiroPolyline& path) const
+{
+    if (m_sampling.mode == SpiroSampling::Mode::Adaptive) {
+        sampleAdaptive(pen, 0.0, span, path);
+        return;
+    }
+
+    std::size_t count = static_cast<std::size_t>(std::floor(span / gridStep + 1e-9)) + 1;
+    path.x.resize(count);
+    path.y.resize(count);
+    TrochoidCoefficients c = coefficients(pen);
+    if (m_sampling.rotationRecurrence) {
+        evaluateTrochoidRecurrence(c, 0.0, gridStep, count, path.x.data(), path.y.data());
+    } else {
+        std::vector<double> t(count);
+        for (std::size_t i = 0; i < count; ++i) {
+            t[i] = i * gridStep;
+        }
+        evaluateTrochoidBatch(c, t.data(), count, path.x.data(), path.y.data());
+    }
+
+    // Land exactly on the end of the span even when it is off the grid
+    if ((count - 1) * gridStep < span - 1e-9) {
+        double x, y;
+        evaluate(pen, span, x, y);
+        path.append(x, y);
+    }
+}
+
+void SpiroGenerator::generateSymmetric(int firstPen, double tEnd, std::vector<SpiroPolyline>& paths) const
+{
+    const double lobe = lobeAngle();
+    std::size_t fullLobes = static_cast<std::size_t>(std::floor(tEnd / lobe + 1e-9));
+    double remainder = tEnd - fullLobes * lobe;
+    if (remainder < 1e-9) {
+        remainder = 0.0;
+    }
+
+    // Fixed-step sampling uses the largest grid step that divides the lobe
+    // evenly, so every lobe starts and ends exactly on a sample
+    double stepSize = fixedStepSize();
+    double gridStep = lobe / std::max(1.0, std::ceil(lobe / stepSize - 1e-9));
+
+    std::vector<SpiroPolyline> lobes(paths.size());
+    std::vector<SpiroPolyline> partials(paths.size());
+    SpiroTaskPool::instance().parallelFor(paths.size() * 2, [&](std::size_t task) {
+        std::size_t penIndex = task / 2;
+        if (isCancelled()) {
+            return;
+        }
+        if (task % 2 == 0) {
+            sampleSpan(firstPen + static_cast<int>(penIndex), lobe, gridStep, lobes[penIndex]);
+        } else if (remainder > 0.0) {
+            sampleSpan(firstPen + static_cast<int>(penIndex), remainder, gridStep, partials[penIndex]);
+        }
+    });
+    if (isCancelled()) {
+        return;
+    }
+
+    // Lobe j is lobe 0 rotated by j * lobe; consecutive lobes share their
+    // joining point, which is only written once. Adaptive sampling gives each
+    // pen its own lobe length, so the stride is per pen.
+    std::vector<std::size_t> lobeStrides(paths.size());
+    std::size_t maxStride = 1;
+    for (std::size_t penIndex = 0; penIndex < paths.size(); ++penIndex) {
+        lobeStrides[penIndex] = lobes[penIndex].empty() ? 0 : lobes[penIndex].size() - 1;
+        maxStride = std::max(maxStride, lobeStrides[penIndex]);
+
+        std::size_t replicated = fullLobes > 0 ? fullLobes * lobeStrides[penIndex] + 1 : 0;
+        std::size_t partialPoints = partials[penIndex].empty() ? 0 : partials[penIndex].size() - (replicated > 0 ? 1 : 0);
+        paths[penIndex].x.resize(replicated + partialPoints);
+        paths[penIndex].y.resize(replicated + partialPoints);
+    }
+    std::size_t lobesPerTask = std::max<std::size_t>(1, replicationChunkSamples / maxStride);
+    std::size_t lobeTasks = fullLobes > 0 ? (fullLobes + lobesPerTask - 1) / lobesPerTask : 0;
+
+    SpiroTaskPool::instance().parallelFor(paths.size() * (lobeTasks + 1), [&](std::size_t task) {
+        if (isCancelled()) {
+            return;
+        }
+
+        std::size_t penIndex = task / (lobeTasks + 1);
+        std::size_t chunk = task % (lobeTasks + 1);
+        const SpiroPolyline& source = chunk < lobeTasks ? lobes[penIndex] : partials[penIndex];
+        SpiroPolyline& path = paths[penIndex];
+        std::size_t lobeStride = lobeStrides[penIndex];
+
+        std::size_t firstLobe = chunk < lobeTasks ? chunk * lobesPerTask : fullLobes;
+        std::size_t lastLobe = chunk < lobeTasks ? std::min(fullLobes, firstLobe + lobesPerTask) : fullLobes + 1;
+        for (std::size_t j = firstLobe; j < lastLobe && !source.empty(); ++j) {
+            double angle = j * lobe;
+            double cosA = std::cos(angle), sinA = std::sin(angle);
+            std::size_t begin = (j == 0) ? 0 : 1;
+            double *x = path.x.data() + j * lobeStride;
+            double *y = path.y.data() + j * lobeStride;
+            for (std::size_t i = begin; i < source.size(); ++i) {
+                x[i] = cosA * source.x[i] - sinA * source.y[i];
+                y[i] = sinA * source.x[i] + cosA * source.y[i];
+            }
+        }
+    });
+
+    // A whole number of periods ends exactly where it started
+    if (remainder == 0.0 && fullLobes > 0 && fullLobes % symmetryOrder() == 0) {
+        for (auto& path : paths) {
+            path.x.back() = path.x.front();
+            path.y.back() = path.y.front();
+        }
+    }
+}
+
+void SpiroGenerator::sampleAdaptive(int pen, double tBegin, double tEnd, SpiroPolyline& path) const
+{
+    double scale = m_sampling.millimetresPerUnit > 0 ? m_sampling.millimetresPerUnit : 1.0;
+    double tolerance = std::max(m_sampling.chordTolerance, 1e-6) / scale;
+
+    // Never step further than a fraction of the fastest angular frequency, so
+    // inflection points (zero curvature) cannot skip over a whole lobe
+    double frequency = std::max(1.0, std::fabs(static_cast<double>(m_params.outerRadius - m_params.innerRadius)
+                                               / m_params.innerRadius));
+    double maxStep = maxAdaptiveAngle / frequency;
+
+    double t = tBegin;
+    double x0, y0;
+    evaluate(pen, t, x0, y0);
+    if (path.empty()) {
+        path.append(x0, y0);
+    }
+
+    while (t < tEnd) {
+        double dt = std::min(std::max(curvatureStep(pen, t, tolerance), minAdaptiveStep), maxStep);
+        dt = std::min(dt, tEnd - t);
+
+        // The curvature estimate is local, so verify the midpoint deviation
+        // and shrink the step until the chord is within tolerance
+        double x1, y1;
+        for (;;) {
+            double xm, ym;
+            evaluate(pen, t + dt, x1, y1);
+            evaluate(pen, t + dt * 0.5, xm, ym);
+            if (dt <= minAdaptiveStep || distanceToChord(xm, ym, x0, y0, x1, y1) <= tolerance) {
+                break;
+            }
+            dt *= 0.5;
+        }
+
+        t += dt;
+        if (tEnd - t < minAdaptiveStep * 0.5) {
+            t = tEnd;
+            evaluate(pen, t, x1, y1);
+        }
+        path.append(x1, y1);
+        x0 = x1;
+        y0 = y1;
+    }
+}
+
+std::vector<SpiroPolyline> SpiroGenerator::generate() const
+{
+    return generate(m_params.rotations);
+}
+
+std::vector<SpiroPolyline> SpiroGenerator::generate(int rotations) const
+{
+    if (m_params.numPens <= 0 || m_params.innerRadius == 0) {
+        return std::vector<SpiroPolyline>();
+    }
+    return generatePens(0, m_params.numPens, rotations);
+}
+
+SpiroIncrementalGenerator::SpiroIncrementalGenerator(const SpiroParameters& params, const SpiroSampling& sampling)
+    : m_generator(params, sampling), m_t(0.0), m_nextIndex(0)
+{
+}
+
+double SpiroIncrementalGenerator::rotationsDone() const
+{
+    if (m_generator.sampling().mode == SpiroSampling::Mode::Adaptive) {
+        return m_t / (2 * M_PI);
+    }
+    std::size_t perRotation = m_generator.fixedStepsPerRotation();
+    return m_nextIndex == 0 ? 0.0 : static_cast<double>(m_nextIndex - 1) / perRotation;
+}
+
+bool SpiroIncrementalGenerator::advanceTo(double targetRotations, std::chrono::steady_clock::time_point deadline,
+                                          std::vector<SpiroPathBuffer>& paths)
+{
+    SPIRO_PROFILE_SCOPE("generate.incremental");
+    const SpiroParameters& params = m_generator.parameters();
+    if (params.numPens <= 0 || params.innerRadius == 0 || targetRotations <= 0) {
+        return true;
+    }
+    paths.resize(params.numPens);
+    m_scratch.resize(params.numPens);
+
+    // Slices are sampled in double precision and appended to the compact
+    // buffers; a slice repeats the point the previous one ended on
+    if (m_generator.sampling().mode == SpiroSampling::Mode::Adaptive) {
+        double tTarget = 2 * M_PI * targetRotations;
+        while (m_t < tTarget) {
+            double tNext = std::min(tTarget, m_t + adaptiveChunkAngle);
+            SpiroTaskPool::instance().parallelFor(paths.size(), [&](std::size_t pen) {
+                SpiroPolyline& slice = m_scratch[pen];
+                slice.clear();
+                m_generator.sampleAdaptive(static_cast<int>(pen), m_t, tNext, slice);
+                SPIRO_PROFILE_COUNT(VerticesGenerated, slice.size());
+                paths[pen].extend(slice, paths[pen].empty() ? 0 : 1);
+            });
+            m_t = tNext;
+
+            if (m_t < tTarget && std::chrono::steady_clock::now() >= deadline) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::size_t perRotation = m_generator.fixedStepsPerRotation();
+    std::size_t lastIndex = static_cast<std::size_t>(std::floor(targetRotations * perRotation + 1e-9));
+    while (m_nextIndex <= lastIndex) {
+        std::size_t count = std::min(fixedChunkSamples, lastIndex + 1 - m_nextIndex);
+        SpiroTaskPool::instance().parallelFor(paths.size(), [&](std::size_t pen) {
+            SpiroPolyline& slice = m_scratch[pen];
+            slice.x.resize(count);
+            slice.y.resize(count);
+            m_generator.sampleFixed(static_cast<int>(pen), m_nextIndex, count, slice.x.data(), slice.y.data());
+            paths[pen].extend(slice);
+        });
+        m_nextIndex += count;
+        SPIRO_PROFILE_COUNT(VerticesGenerated, count * paths.size());
+
+        if (m_nextIndex <= lastIndex && std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,369 @@
+#include "spiroindex.h"
+#include "spirotaskpool.h"
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace {
+
+// Target for segments per cell, and the most cells a grid gets
+const double segmentsPerCell = 2.0;
+const std::size_t maxCells = std::size_t(1) << 22;
+// Cells are at least this many times the mean segment size; smaller cells
+// would mostly list the same segments as their neighbours
+const double minCellSegments = 2.0;
+
+// Calls visit(pen, vertex) for every segment, stroke by stroke
+template <typename Visit>
+void forEachSegment(const std::vector<SpiroPathBuffer>& paths, Visit visit)
+{
+    for (std::size_t pen = 0; pen < paths.size(); ++pen) {
+        const SpiroPathBuffer& path = paths[pen];
+        for (std::size_t stroke = 0; stroke < path.strokeCount(); ++stroke) {
+            std::size_t end = path.strokeEnd(stroke);
+            for (std::size_t i = path.strokeBegin(stroke); i + 1 < end; ++i) {
+                visit(static_cast<std::uint32_t>(pen), static_cast<std::uint32_t>(i));
+            }
+        }
+    }
+}
+
+struct Segment
+{
+    double x0, y0, x1, y1;
+
+    Segment(const std::vector<SpiroPathBuffer>& paths, const SpiroSegmentRef& ref)
+    {
+        const SpiroPathBuffer& path = paths[ref.pen];
+        x0 = path.x()[ref.vertex];
+        y0 = path.y()[ref.vertex];
+        x1 = path.x()[ref.vertex + 1];
+        y1 = path.y()[ref.vertex + 1];
+    }
+
+    double minX() const { return std::min(x0, x1); }
+    double minY() const { return std::min(y0, y1); }
+    double maxX() const { return std::max(x0, x1); }
+    double maxY() const { return std::max(y0, y1); }
+};
+
+bool adjacent(const SpiroSegmentRef& a, const SpiroSegmentRef& b)
+{
+    return a.pen == b.pen && (a.vertex + 1 == b.vertex || b.vertex + 1 == a.vertex);
+}
+
+// Liang-Barsky: whether any part of the segment lies inside rect
+bool segmentTouchesRect(const Segment& s, const SpiroBounds& rect)
+{
+    double dx = s.x1 - s.x0;
+    double dy = s.y1 - s.y0;
+    double p[4] = { -dx, dx, -dy, dy };
+    double q[4] = { s.x0 - rect.minX, rect.maxX - s.x0, s.y0 - rect.minY, rect.maxY - s.y0 };
+    double enter = 0.0;
+    double leave = 1.0;
+    for (int i = 0; i < 4; ++i) {
+        if (p[i] == 0.0) {
+            if (q[i] < 0.0) {
+                return false;
+            }
+        } else {
+            double r = q[i] / p[i];
+            if (p[i] < 0.0) {
+                enter = std::max(enter, r);
+            } else {
+                leave = std::min(leave, r);
+            }
+        }
+    }
+    return enter <= leave;
+}
+
+} // namespace
+
+std::uint32_t SpiroIntersectionMap::countAt(double x, double y) const
+{
+    if (counts.empty() || x < bounds.minX || x > bounds.maxX || y < bounds.minY || y > bounds.maxY) {
+        return 0;
+    }
+    int column = binWidth() > 0.0 ? std::min(columns - 1, static_cast<int>((x - bounds.minX) / binWidth())) : 0;
+    int row = binHeight() > 0.0 ? std::min(rows - 1, static_cast<int>((y - bounds.minY) / binHeight())) : 0;
+    return counts[static_cast<std::size_t>(row) * columns + column];
+}
+
+SpiroSegmentIndex::SpiroSegmentIndex()
+    : m_cellSize(1.0), m_inverseCellSize(1.0), m_columns(0), m_rows(0), m_segmentCount(0)
+{
+}
+
+void SpiroSegmentIndex::clear()
+{
+    m_bounds = SpiroBounds();
+    m_columns = 0;
+    m_rows = 0;
+    m_segmentCount = 0;
+    m_cellStarts.clear();
+    m_refs.clear();
+}
+
+int SpiroSegmentIndex::cellX(double x) const
+{
+    double cell = std::floor((x - m_bounds.minX) * m_inverseCellSize);
+    return cell <= 0.0 ? 0 : (cell >= m_columns - 1 ? m_columns - 1 : static_cast<int>(cell));
+}
+
+int SpiroSegmentIndex::cellY(double y) const
+{
+    double cell = std::floor((y - m_bounds.minY) * m_inverseCellSize);
+    return cell <= 0.0 ? 0 : (cell >= m_rows - 1 ? m_rows - 1 : static_cast<int>(cell));
+}
+
+void SpiroSegmentIndex::build(const std::vector<SpiroPathBuffer>& paths)
+{
+    clear();
+    forEachSegment(paths, [this](std::uint32_t, std::uint32_t) { ++m_segmentCount; });
+    if (m_segmentCount == 0) {
+        return;
+    }
+
+    m_bounds = boundsOf(paths);
+    double width = m_bounds.width();
+    double height = m_bounds.height();
+    double extent = std::max(width, height);
+    if (extent <= 0.0) {
+        extent = 1.0;
+    }
+
+    // Square cells; a pattern squashed flat in one direction gets a single
+    // row or column
+    std::size_t targetCells = static_cast<std::size_t>(m_segmentCount / segmentsPerCell);
+    targetCells = std::max<std::size_t>(1, std::min(targetCells, maxCells));
+    double area = width * height;
+    m_cellSize = area > 0.0 ? std::sqrt(area / targetCells) : extent / targetCells;
+
+    double segmentSize = 0.0;
+    forEachSegment(paths, [&paths, &segmentSize](std::uint32_t pen, std::uint32_t vertex) {
+        Segment s(paths, SpiroSegmentRef{ pen, vertex });
+        segmentSize += std::max(s.maxX() - s.minX(), s.maxY() - s.minY());
+    });
+    m_cellSize = std::max(m_cellSize, minCellSegments * segmentSize / m_segmentCount);
+    m_cellSize = std::max(m_cellSize, extent * 1e-9);
+    m_inverseCellSize = 1.0 / m_cellSize;
+    m_columns = std::max(1, static_cast<int>(std::ceil(width * m_inverseCellSize)));
+    m_rows = std::max(1, static_cast<int>(std::ceil(height * m_inverseCellSize)));
+
+    // Counting pass, then a prefix sum gives every cell its slice of m_refs
+    const std::size_t cellCount = static_cast<std::size_t>(m_columns) * m_rows;
+    m_cellStarts.assign(cellCount + 1, 0);
+    auto forEachCell = [this, &paths](const SpiroSegmentRef& ref, auto visit) {
+        Segment s(paths, ref);
+        int lastColumn = cellX(s.maxX());
+        int lastRow = cellY(s.maxY());
+        for (int row = cellY(s.minY()); row <= lastRow; ++row) {
+            for (int column = cellX(s.minX()); column <= lastColumn; ++column) {
+                visit(static_cast<std::size_t>(row) * m_columns + column);
+            }
+        }
+    };
+    forEachSegment(paths, [&](std::uint32_t pen, std::uint32_t vertex) {
+        forEachCell(SpiroSegmentRef{ pen, vertex }, [this](std::size_t cell) { ++m_cellStarts[cell + 1]; });
+    });
+    for (std::size_t cell = 0; cell < cellCount; ++cell) {
+        m_cellStarts[cell + 1] += m_cellStarts[cell];
+    }
+
+    m_refs.resize(m_cellStarts[cellCount]);
+    std::vector<std::uint32_t> fill(m_cellStarts.begin(), m_cellStarts.end() - 1);
+    forEachSegment(paths, [&](std::uint32_t pen, std::uint32_t vertex) {
+        SpiroSegmentRef ref{ pen, vertex };
+        forEachCell(ref, [this, &fill, &ref](std::size_t cell) { m_refs[fill[cell]++] = ref; });
+    });
+}
+
+SpiroNearestPoint SpiroSegmentIndex::nearest(const std::vector<SpiroPathBuffer>& paths, double x, double y,
+                                             double maxDistance) const
+{
+    SpiroNearestPoint best;
+    if (empty() || !(maxDistance >= 0.0)) {
+        return best;
+    }
+    best.distance = maxDistance;
+
+    // Rings of cells around the one under the point, or the nearest one
+    // just outside the grid; a cell in ring r is at least (r - 1) cells
+    // away, so the search ends once that exceeds the best distance so far
+    const double gridX = (x - m_bounds.minX) * m_inverseCellSize;
+    const double gridY = (y - m_bounds.minY) * m_inverseCellSize;
+    const int centerX = static_cast<int>(std::floor(std::max(-1.0, std::min<double>(gridX, m_columns))));
+    const int centerY = static_cast<int>(std::floor(std::max(-1.0, std::min<double>(gridY, m_rows))));
+    const int lastRing = std::max(m_columns, m_rows) + 1;
+
+    for (int ring = 0; ring <= lastRing; ++ring) {
+        if ((ring - 1) * m_cellSize > best.distance) {
+            break;
+        }
+        for (int row = centerY - ring; row <= centerY + ring; ++row) {
+            if (row < 0 || row >= m_rows) {
+                continue;
+            }
+            // Only the outline of the ring; the inside was searched before
+            bool edgeRow = row == centerY - ring || row == centerY + ring;
+            int step = edgeRow || ring == 0 ? 1 : 2 * ring;
+            for (int column = centerX - ring; column <= centerX + ring; column += step) {
+                if (column < 0 || column >= m_columns) {
+                    continue;
+                }
+                std::size_t cell = static_cast<std::size_t>(row) * m_columns + column;
+                for (std::uint32_t i = m_cellStarts[cell]; i < m_cellStarts[cell + 1]; ++i) {
+                    Segment s(paths, m_refs[i]);
+                    double dx = s.x1 - s.x0;
+                    double dy = s.y1 - s.y0;
+                    double lengthSquared = dx * dx + dy * dy;
+                    double t = lengthSquared > 0.0 ? ((x - s.x0) * dx + (y - s.y0) * dy) / lengthSquared : 0.0;
+                    t = std::max(0.0, std::min(1.0, t));
+                    double px = s.x0 + t * dx;
+                    double py = s.y0 + t * dy;
+                    double distance = std::hypot(x - px, y - py);
+                    if (distance <= best.distance) {
+                        best.found = true;
+                        best.segment = m_refs[i];
+                        best.t = t;
+                        best.x = px;
+                        best.y = py;
+                        best.distance = distance;
+                    }
+                }
+            }
+        }
+    }
+    return best;
+}
+
+void SpiroSegmentIndex::segmentsInRect(const std::vector<SpiroPathBuffer>& paths, const SpiroBounds& rect,
+                                       std::vector<SpiroSegmentRef>& out) const
+{
+    if (empty() || !rect.isValid() || rect.maxX < m_bounds.minX || rect.minX > m_bounds.maxX
+        || rect.maxY < m_bounds.minY || rect.minY > m_bounds.maxY) {
+        return;
+    }
+
+    const int firstColumn = cellX(rect.minX);
+    const int lastColumn = cellX(rect.maxX);
+    const int firstRow = cellY(rect.minY);
+    const int lastRow = cellY(rect.maxY);
+    for (int row = firstRow; row <= lastRow; ++row) {
+        for (int column = firstColumn; column <= lastColumn; ++column) {
+            std::size_t cell = static_cast<std::size_t>(row) * m_columns + column;
+            for (std::uint32_t i = m_cellStarts[cell]; i < m_cellStarts[cell + 1]; ++i) {
+                Segment s(paths, m_refs[i]);
+                if (s.maxX() < rect.minX || s.minX() > rect.maxX || s.maxY() < rect.minY || s.minY() > rect.maxY) {
+                    continue;
+                }
+                // A segment is listed in every cell its box overlaps; only
+                // the cell holding the low corner of box and rect reports it
+                if (cellX(std::max(s.minX(), rect.minX)) != column || cellY(std::max(s.minY(), rect.minY)) != row) {
+                    continue;
+                }
+                if (segmentTouchesRect(s, rect)) {
+                    out.push_back(m_refs[i]);
+                }
+            }
+        }
+    }
+}
+
+SpiroIntersectionMap SpiroSegmentIndex::intersections(const std::vector<SpiroPathBuffer>& paths, int columns,
+                                                      int rows) const
+{
+    SpiroIntersectionMap map;
+    if (empty() || columns < 1 || rows < 1) {
+        return map;
+    }
+    map.bounds = m_bounds;
+    map.columns = columns;
+    map.rows = rows;
+    map.counts.assign(static_cast<std::size_t>(columns) * rows, 0);
+
+    const double binScaleX = m_bounds.width() > 0.0 ? columns / m_bounds.width() : 0.0;
+    const double binScaleY = m_bounds.height() > 0.0 ? rows / m_bounds.height() : 0.0;
+
+    // Bands of cell rows, each counting into its own map
+    SpiroTaskPool& pool = SpiroTaskPool::instance();
+    const std::size_t bandCount = std::min<std::size_t>(m_rows, pool.concurrency() * 4);
+    std::vector<std::vector<std::uint32_t>> bandCounts(bandCount);
+    std::vector<std::uint64_t> bandTotals(bandCount, 0);
+
+    pool.parallelFor(bandCount, [&](std::size_t band) {
+        std::vector<std::uint32_t>& counts = bandCounts[band];
+        counts.assign(map.counts.size(), 0);
+        const int firstRow = static_cast<int>(band * m_rows / bandCount);
+        const int endRow = static_cast<int>((band + 1) * m_rows / bandCount);
+
+        // Each cell's segments, sorted by their left edge so the pairs for
+        // one segment end at the first that starts right of it
+        std::vector<std::pair<Segment, SpiroSegmentRef>> local;
+        for (int row = firstRow; row < endRow; ++row) {
+            for (int column = 0; column < m_columns; ++column) {
+                std::size_t cell = static_cast<std::size_t>(row) * m_columns + column;
+                local.clear();
+                for (std::uint32_t i = m_cellStarts[cell]; i < m_cellStarts[cell + 1]; ++i) {
+                    local.emplace_back(Segment(paths, m_refs[i]), m_refs[i]);
+                }
+                std::sort(local.begin(), local.end(), [](const std::pair<Segment, SpiroSegmentRef>& a,
+                                                         const std::pair<Segment, SpiroSegmentRef>& b) {
+                    return a.first.minX() < b.first.minX();
+                });
+
+                for (std::size_t i = 0; i < local.size(); ++i) {
+                    const Segment& a = local[i].first;
+                    const double aMaxX = a.maxX();
+                    const double rx = a.x1 - a.x0;
+                    const double ry = a.y1 - a.y0;
+                    for (std::size_t j = i + 1; j < local.size(); ++j) {
+                        const Segment& b = local[j].first;
+                        if (b.minX() > aMaxX) {
+                            break;
+                        }
+                        if (b.maxY() < a.minY() || b.minY() > a.maxY() || adjacent(local[i].second, local[j].second)) {
+                            continue;
+                        }
+                        double sx = b.x1 - b.x0;
+                        double sy = b.y1 - b.y0;
+                        double denominator = rx * sy - ry * sx;
+                        if (denominator == 0.0) {
+                            continue;  // parallel, including overlapping runs
+                        }
+                        double qx = b.x0 - a.x0;
+                        double qy = b.y0 - a.y0;
+                        double t = (qx * sy - qy * sx) / denominator;
+                        double u = (qx * ry - qy * rx) / denominator;
+                        // Half-open, so a crossing exactly at a vertex is
+                        // counted for one of the two segments meeting there
+                        if (t < 0.0 || t >= 1.0 || u < 0.0 || u >= 1.0) {
+                            continue;
+                        }
+
+                        // Both segments are listed in every cell around the
+                        // crossing; the cell it lies in counts it
+                        double px = a.x0 + t * rx;
+                        double py = a.y0 + t * ry;
+                        if (cellX(px) != column || cellY(py) != row) {
+                            continue;
+                        }
+                        int binX = std::min(columns - 1, std::max(0, static_cast<int>((px - m_bounds.minX) * binScaleX)));
+                        int binY = std::min(rows - 1, std::max(0, static_cast<int>((py - m_bounds.minY) * binScaleY)));
+                        ++counts[static_cast<std::size_t>(binY) * columns + binX];
+                        ++bandTotals[band];
+                    }
+                }
+            }
+        }
+    });
+
+    for (std::size_t band = 0; band < bandCount; ++band) {
+        for (std::size_t bin = 0; bin < map.counts.size(); ++bin) {
+            map.counts[bin] += bandCounts[band][bin];
+        }
+        map.total += bandTotals[band];
+    }
+    return map;
+}
@@ -0,0 +1,260 @@
+#include "spirokernels.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SPIRO_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+const std::size_t recurrenceAnchorInterval = 256;
+
+void batchScalar(const TrochoidCoefficients& c, const double *t, std::size_t count, double *x, double *y)
+{
+    for (std::size_t i = 0; i < count; ++i) {
+        double u = c.k * t[i] + c.phase;
+        x[i] = c.a * std::cos(t[i]) + c.b * std::cos(u);
+        y[i] = c.a * std::sin(t[i]) - c.b * std::sin(u);
+    }
+}
+
+#ifdef SPIRO_X86_KERNELS
+
+// sin/cos share the fdlibm kernel polynomials, valid on [-pi/4, pi/4] after a
+// three-part Cody-Waite reduction by pi/2. Accurate to a few ulp for the
+// angle range a spirograph reaches (well below 1e6 radians).
+const double twoOverPi = 0.63661977236758134308;
+const double pio2Part1 = 1.57079632673412561417e+00;
+const double pio2Part2 = 6.07710050630396597660e-11;
+const double pio2Part3 = 2.02226624871116645580e-21;
+const double roundMagic = 6755399441055744.0;  // 1.5 * 2^52
+
+const double sinC1 = -1.66666666666666324348e-01;
+const double sinC2 = 8.33333333332248946124e-03;
+const double sinC3 = -1.98412698298579493134e-04;
+const double sinC4 = 2.75573137070700676789e-06;
+const double sinC5 = -2.50507602534068634195e-08;
+const double sinC6 = 1.58969099521155010221e-10;
+
+const double cosC1 = 4.16666666666666019037e-02;
+const double cosC2 = -1.38888888888741095749e-03;
+const double cosC3 = 2.48015872894767294178e-05;
+const double cosC4 = -2.75573143513906633035e-07;
+const double cosC5 = 2.08757232129817482790e-09;
+const double cosC6 = -1.13596475577881948265e-11;
+
+__attribute__((target("sse2")))
+inline void sincosSse2(__m128d v, __m128d &sinOut, __m128d &cosOut)
+{
+    const __m128d magic = _mm_set1_pd(roundMagic);
+    __m128d shifted = _mm_add_pd(_mm_mul_pd(v, _mm_set1_pd(twoOverPi)), magic);
+    __m128i quadrant = _mm_castpd_si128(shifted);
+    __m128d j = _mm_sub_pd(shifted, magic);
+
+    __m128d r = _mm_sub_pd(v, _mm_mul_pd(j, _mm_set1_pd(pio2Part1)));
+    r = _mm_sub_pd(r, _mm_mul_pd(j, _mm_set1_pd(pio2Part2)));
+    r = _mm_sub_pd(r, _mm_mul_pd(j, _mm_set1_pd(pio2Part3)));
+    __m128d z = _mm_mul_pd(r, r);
+
+    __m128d ps = _mm_add_pd(_mm_mul_pd(z, _mm_set1_pd(sinC6)), _mm_set1_pd(sinC5));
+    ps = _mm_add_pd(_mm_mul_pd(ps, z), _mm_set1_pd(sinC4));
+    ps = _mm_add_pd(_mm_mul_pd(ps, z), _mm_set1_pd(sinC3));
+    ps = _mm_add_pd(_mm_mul_pd(ps, z), _mm_set1_pd(sinC2));
+    ps = _mm_add_pd(_mm_mul_pd(ps, z), _mm_set1_pd(sinC1));
+    __m128d s = _mm_add_pd(r, _mm_mul_pd(_mm_mul_pd(r, z), ps));
+
+    __m128d pc = _mm_add_pd(_mm_mul_pd(z, _mm_set1_pd(cosC6)), _mm_set1_pd(cosC5));
+    pc = _mm_add_pd(_mm_mul_pd(pc, z), _mm_set1_pd(cosC4));
+    pc = _mm_add_pd(_mm_mul_pd(pc, z), _mm_set1_pd(cosC3));
+    pc = _mm_add_pd(_mm_mul_pd(pc, z), _mm_set1_pd(cosC2));
+    pc = _mm_add_pd(_mm_mul_pd(pc, z), _mm_set1_pd(cosC1));
+    __m128d c = _mm_add_pd(_mm_sub_pd(_mm_set1_pd(1.0), _mm_mul_pd(z, _mm_set1_pd(0.5))),
+                           _mm_mul_pd(_mm_mul_pd(z, z), pc));
+
+    // Odd quadrants swap sin and cos; bit 1 (of q for sin, q + 1 for cos)
+    // gives the sign
+    const __m128i one = _mm_set1_epi64x(1);
+    const __m128i two = _mm_set1_epi64x(2);
+    __m128d swap = _mm_castsi128_pd(_mm_sub_epi64(_mm_setzero_si128(), _mm_and_si128(quadrant, one)));
+    __m128d sinSign = _mm_castsi128_pd(_mm_slli_epi64(_mm_and_si128(quadrant, two), 62));
+    __m128d cosSign = _mm_castsi128_pd(_mm_slli_epi64(_mm_and_si128(_mm_add_epi64(quadrant, one), two), 62));
+
+    sinOut = _mm_xor_pd(_mm_or_pd(_mm_and_pd(swap, c), _mm_andnot_pd(swap, s)), sinSign);
+    cosOut = _mm_xor_pd(_mm_or_pd(_mm_and_pd(swap, s), _mm_andnot_pd(swap, c)), cosSign);
+}
+
+__attribute__((target("avx2,fma")))
+inline void sincosAvx2(__m256d v, __m256d &sinOut, __m256d &cosOut)
+{
+    const __m256d magic = _mm256_set1_pd(roundMagic);
+    __m256d shifted = _mm256_fmadd_pd(v, _mm256_set1_pd(twoOverPi), magic);
+    __m256i quadrant = _mm256_castpd_si256(shifted);
+    __m256d j = _mm256_sub_pd(shifted, magic);
+
+    __m256d r = _mm256_fnmadd_pd(j, _mm256_set1_pd(pio2Part1), v);
+    r = _mm256_fnmadd_pd(j, _mm256_set1_pd(pio2Part2), r);
+    r = _mm256_fnmadd_pd(j, _mm256_set1_pd(pio2Part3), r);
+    __m256d z = _mm256_mul_pd(r, r);
+
+    __m256d ps = _mm256_fmadd_pd(z, _mm256_set1_pd(sinC6), _mm256_set1_pd(sinC5));
+    ps = _mm256_fmadd_pd(ps, z, _mm256_set1_pd(sinC4));
+    ps = _mm256_fmadd_pd(ps, z, _mm256_set1_pd(sinC3));
+    ps = _mm256_fmadd_pd(ps, z, _mm256_set1_pd(sinC2));
+    ps = _mm256_fmadd_pd(ps, z, _mm256_set1_pd(sinC1));
+    __m256d s = _mm256_fmadd_pd(_mm256_mul_pd(r, z), ps, r);
+
+    __m256d pc = _mm256_fmadd_pd(z, _mm256_set1_pd(cosC6), _mm256_set1_pd(cosC5));
+    pc = _mm256_fmadd_pd(pc, z, _mm256_set1_pd(cosC4));
+    pc = _mm256_fmadd_pd(pc, z, _mm256_set1_pd(cosC3));
+    pc = _mm256_fmadd_pd(pc, z, _mm256_set1_pd(cosC2));
+    pc = _mm256_fmadd_pd(pc, z, _mm256_set1_pd(cosC1));
+    __m256d c = _mm256_fmadd_pd(_mm256_mul_pd(z, z), pc,
+                                _mm256_fnmadd_pd(z, _mm256_set1_pd(0.5), _mm256_set1_pd(1.0)));
+
+    const __m256i one = _mm256_set1_epi64x(1);
+    const __m256i two = _mm256_set1_epi64x(2);
+    __m256d swap = _mm256_castsi256_pd(_mm256_sub_epi64(_mm256_setzero_si256(), _mm256_and_si256(quadrant, one)));
+    __m256d sinSign = _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_and_si256(quadrant, two), 62));
+    __m256d cosSign = _mm256_castsi256_pd(
+        _mm256_slli_epi64(_mm256_and_si256(_mm256_add_epi64(quadrant, one), two), 62));
+
+    sinOut = _mm256_xor_pd(_mm256_blendv_pd(s, c, swap), sinSign);
+    cosOut = _mm256_xor_pd(_mm256_blendv_pd(c, s, swap), cosSign);
+}
+
+__attribute__((target("sse2")))
+void batchSse2(const TrochoidCoefficients& c, const double *t, std::size_t count, double *x, double *y)
+{
+    const __m128d a = _mm_set1_pd(c.a);
+    const __m128d b = _mm_set1_pd(c.b);
+    const __m128d k = _mm_set1_pd(c.k);
+    const __m128d phase = _mm_set1_pd(c.phase);
+
+    std::size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        __m128d tv = _mm_loadu_pd(t + i);
+        __m128d u = _mm_add_pd(_mm_mul_pd(k, tv), phase);
+        __m128d sinT, cosT, sinU, cosU;
+        sincosSse2(tv, sinT, cosT);
+        sincosSse2(u, sinU, cosU);
+        _mm_storeu_pd(x + i, _mm_add_pd(_mm_mul_pd(a, cosT), _mm_mul_pd(b, cosU)));
+        _mm_storeu_pd(y + i, _mm_sub_pd(_mm_mul_pd(a, sinT), _mm_mul_pd(b, sinU)));
+    }
+    batchScalar(c, t + i, count - i, x + i, y + i);
+}
+
+__attribute__((target("avx2,fma")))
+void batchAvx2(const TrochoidCoefficients& c, const double *t, std::size_t count, double *x, double *y)
+{
+    const __m256d a = _mm256_set1_pd(c.a);
+    const __m256d b = _mm256_set1_pd(c.b);
+    const __m256d k = _mm256_set1_pd(c.k);
+    const __m256d phase = _mm256_set1_pd(c.phase);
+
+    std::size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256d tv = _mm256_loadu_pd(t + i);
+        __m256d u = _mm256_fmadd_pd(k, tv, phase);
+        __m256d sinT, cosT, sinU, cosU;
+        sincosAvx2(tv, sinT, cosT);
+        sincosAvx2(u, sinU, cosU);
+        _mm256_storeu_pd(x + i, _mm256_fmadd_pd(a, cosT, _mm256_mul_pd(b, cosU)));
+        _mm256_storeu_pd(y + i, _mm256_fmsub_pd(a, sinT, _mm256_mul_pd(b, sinU)));
+    }
+    batchScalar(c, t + i, count - i, x + i, y + i);
+}
+
+#endif // SPIRO_X86_KERNELS
+
+} // namespace
+
+SpiroKernelIsa detectKernelIsa()
+{
+#ifdef SPIRO_X86_KERNELS
+    static const SpiroKernelIsa detected = []() {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+            return SpiroKernelIsa::AVX2;
+        }
+        if (__builtin_cpu_supports("sse2")) {
+            return SpiroKernelIsa::SSE2;
+        }
+        return SpiroKernelIsa::Scalar;
+    }();
+    return detected;
+#else
+    return SpiroKernelIsa::Scalar;
+#endif
+}
+
+const char *kernelIsaName(SpiroKernelIsa isa)
+{
+    switch (isa) {
+        case SpiroKernelIsa::AVX2:
+            return "AVX2";
+        case SpiroKernelIsa::SSE2:
+            return "SSE2";
+        case SpiroKernelIsa::Scalar:
+            break;
+    }
+    return "Scalar";
+}
+
+void evaluateTrochoidBatch(const TrochoidCoefficients& c, const double *t, std::size_t count,
+                           double *x, double *y)
+{
+    evaluateTrochoidBatch(c, t, count, x, y, detectKernelIsa());
+}
+
+void evaluateTrochoidBatch(const TrochoidCoefficients& c, const double *t, std::size_t count,
+                           double *x, double *y, SpiroKernelIsa isa)
+{
+    // Never run a kernel the CPU cannot execute, whatever the caller asked for
+    isa = std::min(isa, detectKernelIsa());
+
+#ifdef SPIRO_X86_KERNELS
+    switch (isa) {
+        case SpiroKernelIsa::AVX2:
+            batchAvx2(c, t, count, x, y);
+            return;
+        case SpiroKernelIsa::SSE2:
+            batchSse2(c, t, count, x, y);
+            return;
+        case SpiroKernelIsa::Scalar:
+            break;
+    }
+#endif
+    batchScalar(c, t, count, x, y);
+}
+
+void evaluateTrochoidRecurrence(const TrochoidCoefficients& c, double t0, double dt, std::size_t count,
+                                double *x, double *y)
+{
+    const double stepCos = std::cos(dt);
+    const double stepSin = std::sin(dt);
+    const double innerStepCos = std::cos(c.k * dt);
+    const double innerStepSin = std::sin(c.k * dt);
+
+    for (std::size_t start = 0; start < count; start += recurrenceAnchorInterval) {
+        double t = t0 + start * dt;
+        double u = c.k * t + c.phase;
+        double cosT = std::cos(t), sinT = std::sin(t);
+        double cosU = std::cos(u), sinU = std::sin(u);
+
+        std::size_t end = std::min(count, start + recurrenceAnchorInterval);
+        for (std::size_t i = start; i < end; ++i) {
+            x[i] = c.a * cosT + c.b * cosU;
+            y[i] = c.a * sinT - c.b * sinU;
+
+            double nextCosT = cosT * stepCos - sinT * stepSin;
+            sinT = sinT * stepCos + cosT * stepSin;
+            cosT = nextCosT;
+
+            double nextCosU = cosU * innerStepCos - sinU * innerStepSin;
+            sinU = sinU * innerStepCos + cosU * innerStepSin;
+            cosU = nextCosU;
+        }
+    }
+}
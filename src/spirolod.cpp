@@ -0,0 +1,102 @@
+#include "spirolod.h"
+#include <cmath>
+#include <utility>
+
+SpiroPolyline simplifyPolyline(const SpiroPolyline& path, double tolerance)
+{
+    const std::size_t count = path.size();
+    if (count <= 2 || tolerance <= 0.0) {
+        return path;
+    }
+
+    std::vector<char> keep(count, 0);
+    keep[0] = 1;
+    keep[count - 1] = 1;
+
+    // Explicit stack instead of recursion; long paths would otherwise nest
+    // deeply on spirals that never deviate much per span
+    std::vector<std::pair<std::size_t, std::size_t>> spans;
+    spans.push_back(std::make_pair(std::size_t(0), count - 1));
+    const double toleranceSquared = tolerance * tolerance;
+
+    while (!spans.empty()) {
+        std::size_t first = spans.back().first;
+        std::size_t last = spans.back().second;
+        spans.pop_back();
+        if (last <= first + 1) {
+            continue;
+        }
+
+        double ax = path.x[first], ay = path.y[first];
+        double dx = path.x[last] - ax, dy = path.y[last] - ay;
+        double lengthSquared = dx * dx + dy * dy;
+
+        std::size_t farthest = first;
+        double farthestDistance = -1.0;
+        for (std::size_t i = first + 1; i < last; ++i) {
+            double px = path.x[i] - ax, py = path.y[i] - ay;
+            double distance;
+            if (lengthSquared > 0.0) {
+                double cross = dx * py - dy * px;
+                distance = cross * cross / lengthSquared;
+            } else {
+                // Closed span: measure from the shared end point
+                distance = px * px + py * py;
+            }
+            if (distance > farthestDistance) {
+                farthestDistance = distance;
+                farthest = i;
+            }
+        }
+
+        if (farthestDistance > toleranceSquared) {
+            keep[farthest] = 1;
+            spans.push_back(std::make_pair(first, farthest));
+            spans.push_back(std::make_pair(farthest, last));
+        }
+    }
+
+    SpiroPolyline simplified;
+    for (std::size_t i = 0; i < count; ++i) {
+        if (keep[i]) {
+            simplified.append(path.x[i], path.y[i]);
+        }
+    }
+    return simplified;
+}
+
+void SpiroLodPyramid::build(const SpiroPolyline& path, double finestTolerance, int levelCount)
+{
+    clear();
+    if (finestTolerance <= 0.0) {
+        return;
+    }
+
+    // Each level is simplified from the previous one, which must not move
+    m_levels.reserve(levelCount);
+    const SpiroPolyline *source = &path;
+    double tolerance = finestTolerance;
+    for (int i = 0; i < levelCount; ++i) {
+        m_levels.push_back(simplifyPolyline(*source, tolerance));
+        m_tolerances.push_back(tolerance);
+        source = &m_levels.back();
+        tolerance *= 4.0;
+    }
+}
+
+void SpiroLodPyramid::clear()
+{
+    m_levels.clear();
+    m_tolerances.clear();
+}
+
+int SpiroLodPyramid::select(double maxTolerance) const
+{
+    int selected = -1;
+    for (int i = 0; i < levelCount(); ++i) {
+        if (m_tolerances[i] <= maxTolerance) {
+            selected = i;
+        }
+    }
+    return selected;
+}
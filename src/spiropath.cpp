@@ -0,0 +1,201 @@
+#include "spiropath.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+void SpiroPathBuffer::clear()
+{
+    m_x.clear();
+    m_y.clear();
+    m_strokeStarts.clear();
+}
+
+void SpiroPathBuffer::reserve(std::size_t count)
+{
+    m_x.reserve(count);
+    m_y.reserve(count);
+}
+
+std::size_t SpiroPathBuffer::strokeEnd(std::size_t stroke) const
+{
+    return stroke + 1 < m_strokeStarts.size() ? m_strokeStarts[stroke + 1] : m_x.size();
+}
+
+void SpiroPathBuffer::moveTo(double px, double py)
+{
+    m_strokeStarts.push_back(m_x.size());
+    m_x.push_back(static_cast<float>(px));
+    m_y.push_back(static_cast<float>(py));
+}
+
+void SpiroPathBuffer::lineTo(double px, double py)
+{
+    if (m_strokeStarts.empty()) {
+        m_strokeStarts.push_back(0);
+    }
+    m_x.push_back(static_cast<float>(px));
+    m_y.push_back(static_cast<float>(py));
+}
+
+void SpiroPathBuffer::appendStroke(const SpiroPolyline& source)
+{
+    if (source.empty()) {
+        return;
+    }
+    m_strokeStarts.push_back(m_x.size());
+    extend(source);
+}
+
+void SpiroPathBuffer::appendStroke(const SpiroPathBuffer& source, std::size_t stroke, bool reversed)
+{
+    std::size_t first = source.strokeBegin(stroke);
+    std::size_t last = source.strokeEnd(stroke);
+    if (first == last) {
+        return;
+    }
+
+    m_strokeStarts.push_back(m_x.size());
+    if (reversed) {
+        for (std::size_t i = last; i-- > first;) {
+            m_x.push_back(source.m_x[i]);
+            m_y.push_back(source.m_y[i]);
+        }
+    } else {
+        m_x.insert(m_x.end(), source.m_x.begin() + first, source.m_x.begin() + last);
+        m_y.insert(m_y.end(), source.m_y.begin() + first, source.m_y.begin() + last);
+    }
+}
+
+void SpiroPathBuffer::extend(const SpiroPolyline& source, std::size_t first)
+{
+    if (first >= source.size()) {
+        return;
+    }
+    if (m_strokeStarts.empty()) {
+        m_strokeStarts.push_back(0);
+    }
+
+    std::size_t begin = m_x.size();
+    std::size_t count = source.size() - first;
+    m_x.resize(begin + count);
+    m_y.resize(begin + count);
+    for (std::size_t i = 0; i < count; ++i) {
+        m_x[begin + i] = static_cast<float>(source.x[first + i]);
+        m_y[begin + i] = static_cast<float>(source.y[first + i]);
+    }
+}
+
+SpiroBounds::SpiroBounds()
+    : minX(std::numeric_limits<double>::max()), minY(std::numeric_limits<double>::max()),
+      maxX(std::numeric_limits<double>::lowest()), maxY(std::numeric_limits<double>::lowest())
+{
+}
+
+void SpiroBounds::include(double px, double py)
+{
+    minX = std::min(minX, px);
+    minY = std::min(minY, py);
+    maxX = std::max(maxX, px);
+    maxY = std::max(maxY, py);
+}
+
+void SpiroBounds::unite(const SpiroBounds& other)
+{
+    if (!other.isValid()) {
+        return;
+    }
+    include(other.minX, other.minY);
+    include(other.maxX, other.maxY);
+}
+
+SpiroBounds boundsOf(const SpiroPolyline& path)
+{
+    SpiroBounds bounds;
+    for (std::size_t i = 0; i < path.size(); ++i) {
+        bounds.include(path.x[i], path.y[i]);
+    }
+    return bounds;
+}
+
+SpiroBounds boundsOf(const std::vector<SpiroPolyline>& paths)
+{
+    SpiroBounds bounds;
+    for (const auto& path : paths) {
+        bounds.unite(boundsOf(path));
+    }
+    return bounds;
+}
+
+SpiroBounds boundsOf(const SpiroPathBuffer& path)
+{
+    if (path.empty()) {
+        return SpiroBounds();
+    }
+
+    const float *x = path.x();
+    const float *y = path.y();
+    float minX = x[0], minY = y[0], maxX = x[0], maxY = y[0];
+    for (std::size_t i = 1; i < path.size(); ++i) {
+        minX = std::min(minX, x[i]);
+        minY = std::min(minY, y[i]);
+        maxX = std::max(maxX, x[i]);
+        maxY = std::max(maxY, y[i]);
+    }
+
+    SpiroBounds bounds;
+    bounds.include(minX, minY);
+    bounds.include(maxX, maxY);
+    return bounds;
+}
+
+SpiroBounds boundsOf(const std::vector<SpiroPathBuffer>& paths)
+{
+    SpiroBounds bounds;
+    for (const auto& path : paths) {
+        bounds.unite(boundsOf(path));
+    }
+    return bounds;
+}
+
+double pathLength(const SpiroPolyline& path)
+{
+    double length = 0.0;
+    for (std::size_t i = 1; i < path.size(); ++i) {
+        length += std::hypot(path.x[i] - path.x[i - 1], path.y[i] - path.y[i - 1]);
+    }
+    return length;
+}
+
+double totalPathLength(const std::vector<SpiroPolyline>& paths)
+{
+    double length = 0.0;
+    for (const auto& path : paths) {
+        length += pathLength(path);
+    }
+    return length;
+}
+
+double pathLength(const SpiroPathBuffer& path)
+{
+    const float *x = path.x();
+    const float *y = path.y();
+    double length = 0.0;
+    for (std::size_t stroke = 0; stroke < path.strokeCount(); ++stroke) {
+        std::size_t end = path.strokeEnd(stroke);
+        for (std::size_t i = path.strokeBegin(stroke) + 1; i < end; ++i) {
+            double dx = x[i] - x[i - 1];
+            double dy = y[i] - y[i - 1];
+            length += std::sqrt(dx * dx + dy * dy);
+        }
+    }
+    return length;
+}
+
+double totalPathLength(const std::vector<SpiroPathBuffer>& paths)
+{
+    double length = 0.0;
+    for (const auto& path : paths) {
+        length += pathLength(path);
+    }
+    return length;
+}
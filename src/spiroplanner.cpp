@@ -0,0 +1,147 @@
+#include "spiroplanner.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+const double minLength = 1e-9;
+
+// Highest speed at which the corner from a into b stays within the junction
+// deviation, from the circle that touches both segments at that distance
+double junctionSpeed(const SpiroPlanSegment& a, const SpiroPlanSegment& b, const SpiroMotionLimits& limits)
+{
+    double cosTheta = -(a.endDirX * b.startDirX + a.endDirY * b.startDirY);
+    if (cosTheta < -0.999999) {
+        // Straight on
+        return std::numeric_limits<double>::infinity();
+    }
+    if (cosTheta > 0.999999) {
+        // Full reversal
+        return 0.0;
+    }
+    double sinHalfTheta = std::sqrt(0.5 * (1.0 - cosTheta));
+    return std::sqrt(limits.maxAcceleration * limits.junctionDeviation * sinHalfTheta / (1.0 - sinHalfTheta));
+}
+
+// Fills in the profile of one segment between the given end speeds
+void profileSegment(SpiroPlanSegment& segment, double entrySpeed, double exitSpeed, double acceleration)
+{
+    segment.entrySpeed = entrySpeed;
+    segment.exitSpeed = exitSpeed;
+
+    // Peak of the triangle that accelerates from entry and brakes to exit
+    // over the whole length, capped by the cruise speed
+    double peak = std::sqrt(acceleration * segment.length + 0.5 * (entrySpeed * entrySpeed + exitSpeed * exitSpeed));
+    peak = std::max(std::min(peak, segment.maxSpeed), std::max(entrySpeed, exitSpeed));
+    segment.peakSpeed = peak;
+
+    if (peak <= 0.0) {
+        segment.time = 0.0;
+        return;
+    }
+    double accelerateDistance = (peak * peak - entrySpeed * entrySpeed) / (2.0 * acceleration);
+    double brakeDistance = (peak * peak - exitSpeed * exitSpeed) / (2.0 * acceleration);
+    double cruiseDistance = std::max(0.0, segment.length - accelerateDistance - brakeDistance);
+    segment.time = (peak - entrySpeed) / acceleration + (peak - exitSpeed) / acceleration + cruiseDistance / peak;
+}
+
+} // namespace
+
+SpiroPlanSegment planSegment(double x0, double y0, const SpiroMove& move, double maxSpeed,
+                             const SpiroMotionLimits& limits)
+{
+    SpiroPlanSegment segment = {};
+    segment.maxSpeed = maxSpeed;
+
+    if (move.type == SpiroMove::Type::Line) {
+        double dx = move.x - x0, dy = move.y - y0;
+        double length = std::hypot(dx, dy);
+        if (length > minLength) {
+            segment.length = length;
+            segment.startDirX = segment.endDirX = dx / length;
+            segment.startDirY = segment.endDirY = dy / length;
+        }
+        return segment;
+    }
+
+    // Radius vectors from the centre to both ends
+    double cx = x0 + move.i, cy = y0 + move.j;
+    double ax = x0 - cx, ay = y0 - cy;
+    double bx = move.x - cx, by = move.y - cy;
+    double radius = std::hypot(ax, ay);
+    if (radius <= minLength) {
+        return segment;
+    }
+
+    bool clockwise = move.type == SpiroMove::Type::ClockwiseArc;
+    double sweep = std::atan2(ax * by - ay * bx, ax * bx + ay * by);
+    if (clockwise) {
+        sweep = -sweep;
+    }
+    if (sweep <= 0.0) {
+        sweep += 2 * M_PI;
+    }
+    segment.length = radius * sweep;
+
+    // Tangents are the radius vectors turned a quarter in the direction of travel
+    double endRadius = std::hypot(bx, by);
+    double turn = clockwise ? -1.0 : 1.0;
+    segment.startDirX = -turn * ay / radius;
+    segment.startDirY = turn * ax / radius;
+    segment.endDirX = -turn * by / endRadius;
+    segment.endDirY = turn * bx / endRadius;
+
+    segment.maxSpeed = std::min(maxSpeed, std::sqrt(limits.maxAcceleration * radius));
+    return segment;
+}
+
+double planMotion(std::vector<SpiroPlanSegment>& segments, const SpiroMotionLimits& limits,
+                  double entrySpeed)
+{
+    const std::size_t count = segments.size();
+    if (count == 0) {
+        return 0.0;
+    }
+    const double acceleration = limits.maxAcceleration;
+
+    // junction[k] is the speed between segment k - 1 and segment k; the run
+    // starts at entrySpeed and ends at rest
+    std::vector<double> junction(count + 1, 0.0);
+    junction[0] = entrySpeed;
+    for (std::size_t k = 1; k < count; ++k) {
+        const SpiroPlanSegment& a = segments[k - 1];
+        const SpiroPlanSegment& b = segments[k];
+        junction[k] = std::min({ junctionSpeed(a, b, limits), a.maxSpeed, b.maxSpeed });
+    }
+
+    // Every junction must leave room to brake for everything after it...
+    for (std::size_t k = count - 1; k >= 1; --k) {
+        double reachable = std::sqrt(junction[k + 1] * junction[k + 1] + 2.0 * acceleration * segments[k].length);
+        junction[k] = std::min(junction[k], reachable);
+    }
+    // ...and be reachable from everything before it
+    for (std::size_t k = 1; k < count; ++k) {
+        double reachable = std::sqrt(junction[k - 1] * junction[k - 1] + 2.0 * acceleration * segments[k - 1].length);
+        junction[k] = std::min(junction[k], reachable);
+    }
+
+    double total = 0.0;
+    for (std::size_t k = 0; k < count; ++k) {
+        profileSegment(segments[k], junction[k], junction[k + 1], acceleration);
+        total += segments[k].time;
+    }
+    return total;
+}
+
+double moveTime(double length, double maxSpeed, double maxAcceleration)
+{
+    if (length <= minLength || maxSpeed <= 0.0 || maxAcceleration <= 0.0) {
+        return 0.0;
+    }
+    SpiroPlanSegment segment = {};
+    segment.length = length;
+    segment.maxSpeed = maxSpeed;
+    profileSegment(segment, 0.0, 0.0, maxAcceleration);
+    return segment.time;
+}
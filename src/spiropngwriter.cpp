@@ -0,0 +1,181 @@
+#include "spiropngwriter.h"
+#include <zlib.h>
+#include <cstring>
+
+namespace {
+
+const unsigned char pngSignature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+
+// Compressed data is written out in IDAT chunks of this size
+const std::size_t idatChunkSize = 256 * 1024;
+
+const unsigned char filterUp = 2;
+
+void storeBigEndian(unsigned char* out, std::uint32_t value)
+{
+    out[0] = static_cast<unsigned char>(value >> 24);
+    out[1] = static_cast<unsigned char>(value >> 16);
+    out[2] = static_cast<unsigned char>(value >> 8);
+    out[3] = static_cast<unsigned char>(value);
+}
+
+} // namespace
+
+SpiroPngWriter::SpiroPngWriter(int compressionLevel)
+    : m_level(compressionLevel), m_file(nullptr), m_width(0), m_height(0), m_rowsWritten(0), m_failed(false)
+{
+}
+
+SpiroPngWriter::~SpiroPngWriter()
+{
+    release();
+}
+
+void SpiroPngWriter::release()
+{
+    if (m_stream) {
+        deflateEnd(m_stream.get());
+        m_stream.reset();
+    }
+    if (m_file) {
+        std::fclose(m_file);
+        m_file = nullptr;
+    }
+}
+
+bool SpiroPngWriter::open(const std::string& path, std::uint32_t width, std::uint32_t height)
+{
+    release();
+    m_failed = false;
+    m_rowsWritten = 0;
+    m_width = width;
+    m_height = height;
+
+    // A row plus its filter byte has to fit the 2^31 byte limit of a PNG row
+    if (width == 0 || height == 0 || width > 0x7fffffffu / 3 - 1 || height > 0x7fffffffu) {
+        m_failed = true;
+        return false;
+    }
+
+    m_file = std::fopen(path.c_str(), "wb");
+    if (!m_file) {
+        m_failed = true;
+        return false;
+    }
+
+    m_stream.reset(new z_stream_s());
+    if (deflateInit(m_stream.get(), m_level) != Z_OK) {
+        m_stream.reset();
+        m_failed = true;
+        return false;
+    }
+
+    std::size_t rowBytes = static_cast<std::size_t>(width) * 3;
+    m_previousRow.assign(rowBytes, 0);
+    m_filteredRow.assign(rowBytes + 1, 0);
+    m_output.resize(idatChunkSize);
+    m_stream->next_out = m_output.data();
+    m_stream->avail_out = static_cast<uInt>(m_output.size());
+
+    unsigned char header[13];
+    storeBigEndian(header, width);
+    storeBigEndian(header + 4, height);
+    header[8] = 8;   // bits per channel
+    header[9] = 2;   // truecolour
+    header[10] = 0;  // deflate
+    header[11] = 0;  // adaptive filtering
+    header[12] = 0;  // not interlaced
+    if (std::fwrite(pngSignature, sizeof(pngSignature), 1, m_file) != 1 || !writeChunk("IHDR", header, sizeof(header))) {
+        m_failed = true;
+    }
+    return !m_failed;
+}
+
+bool SpiroPngWriter::writeChunk(const char* type, const unsigned char* data, std::size_t length)
+{
+    unsigned char lengthAndType[8];
+    storeBigEndian(lengthAndType, static_cast<std::uint32_t>(length));
+    std::memcpy(lengthAndType + 4, type, 4);
+
+    uLong crc = crc32(0L, lengthAndType + 4, 4);
+    if (length > 0) {
+        crc = crc32(crc, data, static_cast<uInt>(length));
+    }
+    unsigned char crcBytes[4];
+    storeBigEndian(crcBytes, static_cast<std::uint32_t>(crc));
+
+    return std::fwrite(lengthAndType, sizeof(lengthAndType), 1, m_file) == 1
+        && (length == 0 || std::fwrite(data, length, 1, m_file) == 1)
+        && std::fwrite(crcBytes, sizeof(crcBytes), 1, m_file) == 1;
+}
+
+// Runs deflate over the pending input, writing an IDAT chunk whenever the
+// output buffer fills, and at the end of the stream whatever is left
+bool SpiroPngWriter::deflateInto(int flush)
+{
+    for (;;) {
+        int result = deflate(m_stream.get(), flush);
+        if (result == Z_STREAM_ERROR) {
+            return false;
+        }
+        bool full = m_stream->avail_out == 0;
+        bool finished = result == Z_STREAM_END;
+        if (full || (finished && m_stream->avail_out < m_output.size())) {
+            if (!writeChunk("IDAT", m_output.data(), m_output.size() - m_stream->avail_out)) {
+                return false;
+            }
+            m_stream->next_out = m_output.data();
+            m_stream->avail_out = static_cast<uInt>(m_output.size());
+        }
+        if (finished || (flush == Z_NO_FLUSH && m_stream->avail_in == 0 && !full)) {
+            return true;
+        }
+    }
+}
+
+bool SpiroPngWriter::writeRow(const unsigned char* rgb)
+{
+    if (m_failed || !m_file || m_rowsWritten >= m_height) {
+        m_failed = true;
+        return false;
+    }
+
+    std::size_t rowBytes = m_previousRow.size();
+    unsigned char* filtered = m_filteredRow.data() + 1;
+    m_filteredRow[0] = filterUp;
+    for (std::size_t i = 0; i < rowBytes; ++i) {
+        filtered[i] = static_cast<unsigned char>(rgb[i] - m_previousRow[i]);
+    }
+    std::memcpy(m_previousRow.data(), rgb, rowBytes);
+
+    m_stream->next_in = m_filteredRow.data();
+    m_stream->avail_in = static_cast<uInt>(m_filteredRow.size());
+    if (!deflateInto(Z_NO_FLUSH)) {
+        m_failed = true;
+        return false;
+    }
+    ++m_rowsWritten;
+    return true;
+}
+
+bool SpiroPngWriter::close()
+{
+    if (!m_file) {
+        return false;
+    }
+    if (!m_failed && m_rowsWritten == m_height) {
+        m_stream->next_in = nullptr;
+        m_stream->avail_in = 0;
+        m_failed = !deflateInto(Z_FINISH) || !writeChunk("IEND", nullptr, 0);
+    } else {
+        m_failed = true;
+    }
+
+    deflateEnd(m_stream.get());
+    m_stream.reset();
+    if (std::fclose(m_file) != 0) {
+        m_failed = true;
+    }
+    m_file = nullptr;
+    return !m_failed;
+}
@@ -0,0 +1,201 @@
+#include "spiroprofiler.h"
+#include <algorithm>
+#include <cstdio>
+
+namespace {
+
+// Small stable numbers for the trace viewer, in order of first use
+int currentThreadNumber()
+{
+    static std::atomic<int> nextNumber(1);
+    thread_local int number = nextNumber.fetch_add(1, std::memory_order_relaxed);
+    return number;
+}
+
+void writeJsonString(std::FILE* file, const char* text)
+{
+    std::fputc('"', file);
+    for (const char* c = text; *c; ++c) {
+        if (*c == '"' || *c == '\\') {
+            std::fputc('\\', file);
+        }
+        if (static_cast<unsigned char>(*c) >= 0x20) {
+            std::fputc(*c, file);
+        }
+    }
+    std::fputc('"', file);
+}
+
+} // namespace
+
+SpiroProfileSite::SpiroProfileSite(const char* name)
+    : m_name(name), m_calls(0), m_total(0), m_last(0), m_max(0)
+{
+    SpiroProfiler::instance().registerSite(this);
+}
+
+void SpiroProfileSite::record(std::int64_t nanoseconds)
+{
+    m_calls.fetch_add(1, std::memory_order_relaxed);
+    m_total.fetch_add(nanoseconds, std::memory_order_relaxed);
+    m_last.store(nanoseconds, std::memory_order_relaxed);
+    std::int64_t previous = m_max.load(std::memory_order_relaxed);
+    while (nanoseconds > previous && !m_max.compare_exchange_weak(previous, nanoseconds, std::memory_order_relaxed)) {
+    }
+}
+
+void SpiroProfileSite::reset()
+{
+    m_calls.store(0, std::memory_order_relaxed);
+    m_total.store(0, std::memory_order_relaxed);
+    m_last.store(0, std::memory_order_relaxed);
+    m_max.store(0, std::memory_order_relaxed);
+}
+
+SpiroScopedTimer::~SpiroScopedTimer()
+{
+    SpiroProfiler::Clock::time_point end = SpiroProfiler::Clock::now();
+    m_site.record(std::chrono::duration_cast<std::chrono::nanoseconds>(end - m_start).count());
+
+    SpiroProfiler& profiler = SpiroProfiler::instance();
+    if (profiler.isTracing()) {
+        profiler.addTraceEvent(m_site, m_start, end);
+    }
+}
+
+SpiroProfiler::SpiroProfiler()
+    : m_tracing(false), m_maxEvents(0), m_droppedEvents(0)
+{
+    for (auto& counter : m_counters) {
+        counter.store(0, std::memory_order_relaxed);
+    }
+}
+
+SpiroProfiler& SpiroProfiler::instance()
+{
+    static SpiroProfiler profiler;
+    return profiler;
+}
+
+void SpiroProfiler::registerSite(SpiroProfileSite* site)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_sites.push_back(site);
+}
+
+std::vector<SpiroProfiler::SiteStats> SpiroProfiler::sites() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<SiteStats> result;
+    result.reserve(m_sites.size());
+    for (const SpiroProfileSite* site : m_sites) {
+        result.push_back(SiteStats{ site->name(), site->calls(), site->totalNanoseconds() * 1e-6,
+                                    site->lastNanoseconds() * 1e-6, site->maxNanoseconds() * 1e-6 });
+    }
+    return result;
+}
+
+const SpiroProfileSite* SpiroProfiler::site(const std::string& name) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const SpiroProfileSite* site : m_sites) {
+        if (name == site->name()) {
+            return site;
+        }
+    }
+    return nullptr;
+}
+
+const char* SpiroProfiler::counterName(SpiroCounter counter)
+{
+    switch (counter) {
+    case SpiroCounter::VerticesGenerated:
+        return "vertices generated";
+    case SpiroCounter::CacheHits:
+        return "cache hits";
+    case SpiroCounter::CacheMisses:
+        return "cache misses";
+    case SpiroCounter::ExportBytes:
+        return "export bytes";
+    case SpiroCounter::Count:
+        break;
+    }
+    return "";
+}
+
+void SpiroProfiler::reset()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& counter : m_counters) {
+        counter.store(0, std::memory_order_relaxed);
+    }
+    for (SpiroProfileSite* site : m_sites) {
+        site->reset();
+    }
+}
+
+void SpiroProfiler::startTrace(std::size_t maxEvents)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_events.clear();
+    m_events.reserve(std::min<std::size_t>(maxEvents, 65536));
+    m_maxEvents = maxEvents;
+    m_droppedEvents = 0;
+    m_traceStart = Clock::now();
+    m_tracing.store(true, std::memory_order_relaxed);
+}
+
+void SpiroProfiler::stopTrace()
+{
+    m_tracing.store(false, std::memory_order_relaxed);
+}
+
+void SpiroProfiler::addTraceEvent(const SpiroProfileSite& site, Clock::time_point start, Clock::time_point end)
+{
+    int thread = currentThreadNumber();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_tracing.load(std::memory_order_relaxed) || start < m_traceStart) {
+        return;
+    }
+    if (m_events.size() >= m_maxEvents) {
+        ++m_droppedEvents;
+        return;
+    }
+    m_events.push_back(TraceEvent{ site.name(), thread,
+                                   std::chrono::duration_cast<std::chrono::nanoseconds>(start - m_traceStart).count(),
+                                   std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() });
+}
+
+bool SpiroProfiler::writeTrace(const std::string& path) const
+{
+    std::FILE* file = std::fopen(path.c_str(), "w");
+    if (!file) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::int64_t end = 0;
+    std::fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", file);
+    bool first = true;
+    for (const TraceEvent& event : m_events) {
+        // Timestamps are in microseconds, with the nanoseconds kept as decimals
+        std::fprintf(file, "%s{\"name\":", first ? "" : ",\n");
+        writeJsonString(file, event.name);
+        std::fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", event.thread,
+                     event.start * 1e-3, event.duration * 1e-3);
+        end = std::max(end, event.start + event.duration);
+        first = false;
+    }
+    // Totals at the end of the trace, shown as counter tracks
+    for (int i = 0; i < static_cast<int>(SpiroCounter::Count); ++i) {
+        SpiroCounter which = static_cast<SpiroCounter>(i);
+        std::fprintf(file, "%s{\"name\":", first ? "" : ",\n");
+        writeJsonString(file, counterName(which));
+        std::fprintf(file, ",\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,\"args\":{\"value\":%llu}}", end * 1e-3,
+                     static_cast<unsigned long long>(counter(which)));
+        first = false;
+    }
+    std::fprintf(file, "\n],\"otherData\":{\"droppedEvents\":%llu}}\n",
+                 static_cast<unsigned long long>(m_droppedEvents));
+    return std::fclose(file) == 0;
+}
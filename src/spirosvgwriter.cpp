@@ -0,0 +1,212 @@
+#include "spirosvgwriter.h"
+#include "spirolod.h"
+#include <cmath>
+
+namespace {
+
+// Path data gets a line break after this many points to keep lines short
+// enough for text editors and diff tools
+const int pointsPerLine = 64;
+
+const int maxPrecision = 6;
+
+} // namespace
+
+SpiroSvgWriter::SpiroSvgWriter()
+    : m_stepsPerUnit(1.0), m_layers(0)
+{
+}
+
+bool SpiroSvgWriter::open(const std::string& path, const SpiroSvgOptions& options)
+{
+    m_options = options;
+    m_options.precision = options.precision < 0 ? 0 : (options.precision > maxPrecision ? maxPrecision : options.precision);
+    m_stepsPerUnit = std::pow(10.0, m_options.precision);
+    m_layers = 0;
+
+    if (!m_out.open(path)) {
+        return false;
+    }
+
+    m_out.write("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                "<svg xmlns=\"http://www.w3.org/2000/svg\""
+                " xmlns:inkscape=\"http://www.inkscape.org/namespaces/inkscape\" width=\"");
+    writeLength(m_options.width);
+    m_out.write("\" height=\"");
+    writeLength(m_options.height);
+    m_out.write("\" viewBox=\"0 0 ");
+    writeLength(m_options.width);
+    m_out.put(' ');
+    writeLength(m_options.height);
+    m_out.write("\">\n");
+    if (!m_options.title.empty()) {
+        m_out.write("<title>");
+        writeText(m_options.title);
+        m_out.write("</title>\n");
+    }
+    if (!m_options.description.empty()) {
+        m_out.write("<desc>");
+        writeText(m_options.description);
+        m_out.write("</desc>\n");
+    }
+    return m_out.ok();
+}
+
+void SpiroSvgWriter::writePen(const SpiroPathBuffer& path, std::uint32_t rgb, const std::string& label)
+{
+    static const char hexDigits[] = "0123456789abcdef";
+
+    ++m_layers;
+    m_out.write("<g id=\"pen");
+    m_out.writeInt(m_layers);
+    m_out.write("\" inkscape:groupmode=\"layer\" inkscape:label=\"");
+    writeText(label);
+    m_out.write("\" fill=\"none\" stroke=\"#");
+    for (int shift = 20; shift >= 0; shift -= 4) {
+        m_out.put(hexDigits[(rgb >> shift) & 0xf]);
+    }
+    m_out.write("\" stroke-width=\"");
+    writeLength(m_options.strokeWidth);
+    // The caps and joins QPainter's default pen used to produce
+    m_out.write("\" stroke-linecap=\"square\" stroke-linejoin=\"bevel\">\n");
+
+    const double scale = m_options.scale * m_stepsPerUnit;
+    const double offsetX = m_options.offsetX * m_stepsPerUnit;
+    const double offsetY = m_options.offsetY * m_stepsPerUnit;
+    bool pathOpen = false;
+    SpiroPolyline stroke;
+
+    for (std::size_t s = 0; s < path.strokeCount(); ++s) {
+        const std::size_t begin = path.strokeBegin(s);
+        const std::size_t end = path.strokeEnd(s);
+        if (end - begin < 2) {
+            continue;
+        }
+
+        // Document coordinates, in output steps
+        stroke.clear();
+        stroke.reserve(end - begin);
+        for (std::size_t i = begin; i < end; ++i) {
+            stroke.append(path.x()[i] * scale + offsetX, path.y()[i] * scale + offsetY);
+        }
+        if (m_options.simplifyTolerance > 0.0) {
+            stroke = simplifyPolyline(stroke, m_options.simplifyTolerance * m_stepsPerUnit);
+        }
+
+        long long lastX = std::llround(stroke.x[0]);
+        long long lastY = std::llround(stroke.y[0]);
+        bool started = false;
+        int pointsOnLine = 0;
+        for (std::size_t i = 1; i < stroke.size(); ++i) {
+            long long x = std::llround(stroke.x[i]);
+            long long y = std::llround(stroke.y[i]);
+            if (x == lastX && y == lastY) {
+                continue;
+            }
+
+            // The moveto waits for the first point that survives rounding,
+            // so strokes that collapse to a dot leave nothing behind
+            if (!started) {
+                m_out.write(pathOpen ? "\n" : "<path d=\"");
+                pathOpen = true;
+                m_out.put('M');
+                writeStep(lastX);
+                m_out.put(' ');
+                writeStep(lastY);
+                m_out.put('l');
+                started = true;
+            } else if (++pointsOnLine == pointsPerLine) {
+                m_out.put('\n');
+                pointsOnLine = 0;
+            } else if (x - lastX >= 0) {
+                m_out.put(' ');
+            }
+
+            writeStep(x - lastX);
+            if (y - lastY >= 0) {
+                m_out.put(' ');
+            }
+            writeStep(y - lastY);
+            lastX = x;
+            lastY = y;
+        }
+    }
+
+    if (pathOpen) {
+        m_out.write("\"/>\n");
+    }
+    m_out.write("</g>\n");
+}
+
+bool SpiroSvgWriter::close()
+{
+    if (!m_out.isOpen()) {
+        return false;
+    }
+    m_out.write("</svg>\n");
+    return m_out.close();
+}
+
+// XML character data and attribute values alike
+void SpiroSvgWriter::writeText(const std::string& text)
+{
+    for (char c : text) {
+        switch (c) {
+        case '&':
+            m_out.write("&amp;");
+            break;
+        case '<':
+            m_out.write("&lt;");
+            break;
+        case '>':
+            m_out.write("&gt;");
+            break;
+        case '"':
+            m_out.write("&quot;");
+            break;
+        default:
+            m_out.put(c);
+        }
+    }
+}
+
+// A count of output steps as the shortest decimal SVG accepts: no trailing
+// fraction zeros and no zero before the point, so 0.50 is written ".5"
+void SpiroSvgWriter::writeStep(long long steps)
+{
+    if (steps < 0) {
+        m_out.put('-');
+    }
+    unsigned long long magnitude = steps < 0 ? 0ULL - static_cast<unsigned long long>(steps)
+                                             : static_cast<unsigned long long>(steps);
+
+    unsigned long long divisor = 1;
+    for (int i = 0; i < m_options.precision; ++i) {
+        divisor *= 10;
+    }
+    unsigned long long whole = magnitude / divisor;
+    unsigned long long fraction = magnitude % divisor;
+
+    if (whole > 0 || fraction == 0) {
+        m_out.writeInt(static_cast<long long>(whole));
+    }
+    if (fraction > 0) {
+        int decimals = m_options.precision;
+        while (fraction % 10 == 0) {
+            fraction /= 10;
+            --decimals;
+        }
+        char digits[maxPrecision + 1];
+        digits[0] = '.';
+        for (int i = decimals; i > 0; --i) {
+            digits[i] = static_cast<char>('0' + fraction % 10);
+            fraction /= 10;
+        }
+        m_out.write(digits, decimals + 1);
+    }
+}
+
+void SpiroSvgWriter::writeLength(double value)
+{
+    m_out.writeFixed(value, 3, true);
+}
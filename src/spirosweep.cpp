@@ -0,0 +1,108 @@
+#include "spirosweep.h"
+#include <cmath>
+#include <cstdlib>
+#include <map>
+#include <numeric>
+#include <tuple>
+
+namespace {
+
+// Every distinct curve, as the canonical parameters that identify it
+using CurveKey = std::tuple<int, int, int, int, int, double>;
+
+CurveKey curveKey(const SpiroParameters& params)
+{
+    return CurveKey(params.outerRadius, params.innerRadius, params.penOffset, params.rotations,
+                    params.numPens, params.rotationOffset);
+}
+
+int roundedValue(double value)
+{
+    return static_cast<int>(std::lround(value));
+}
+
+} // namespace
+
+std::vector<double> SpiroSweepRange::values() const
+{
+    std::vector<double> result;
+    if (step <= 0.0 || last < first) {
+        result.push_back(first);
+        return result;
+    }
+    // Counted rather than accumulated so the last value is not lost to rounding
+    std::size_t count = static_cast<std::size_t>(std::floor((last - first) / step + 1e-9)) + 1;
+    result.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        result.push_back(first + i * step);
+    }
+    return result;
+}
+
+SpiroParameters canonicalParameters(const SpiroParameters& params)
+{
+    SpiroParameters canonical = params;
+    int divisor = std::gcd(std::gcd(std::abs(params.outerRadius), std::abs(params.innerRadius)),
+                           std::abs(params.penOffset));
+    if (divisor > 1) {
+        canonical.outerRadius /= divisor;
+        canonical.innerRadius /= divisor;
+        canonical.penOffset /= divisor;
+    }
+
+    int closing = SpiroGenerator::rotationsToClose(params.outerRadius, params.innerRadius);
+    if (canonical.rotations > closing) {
+        canonical.rotations = closing;
+    }
+
+    canonical.rotationOffset = std::fmod(params.rotationOffset, 360.0);
+    if (canonical.rotationOffset < 0.0) {
+        canonical.rotationOffset += 360.0;
+    }
+    return canonical;
+}
+
+std::vector<SpiroSweepEntry> expandSweep(const SpiroSweep& sweep)
+{
+    std::vector<SpiroSweepEntry> entries;
+    std::map<CurveKey, std::size_t> seen;
+
+    for (double outerRadius : sweep.outerRadius.values()) {
+        for (double innerRadius : sweep.innerRadius.values()) {
+            for (double penOffset : sweep.penOffset.values()) {
+                for (double rotations : sweep.rotations.values()) {
+                    for (double numPens : sweep.numPens.values()) {
+                        for (double rotationOffset : sweep.rotationOffset.values()) {
+                            SpiroSweepEntry entry;
+                            entry.parameters.outerRadius = roundedValue(outerRadius);
+                            entry.parameters.innerRadius = roundedValue(innerRadius);
+                            entry.parameters.penOffset = roundedValue(penOffset);
+                            entry.parameters.rotations = roundedValue(rotations);
+                            entry.parameters.numPens = roundedValue(numPens);
+                            entry.parameters.rotationOffset = rotationOffset;
+
+                            const SpiroParameters& params = entry.parameters;
+                            if (params.outerRadius < 1 || params.innerRadius < 1 || params.numPens < 1) {
+                                continue;
+                            }
+                            if (sweep.closeLoops) {
+                                entry.parameters.rotations =
+                                    SpiroGenerator::rotationsToClose(params.outerRadius, params.innerRadius);
+                            } else if (params.rotations < 1) {
+                                continue;
+                            }
+
+                            entry.original = entries.size();
+                            auto inserted = seen.emplace(curveKey(canonicalParameters(entry.parameters)), entry.original);
+                            if (!inserted.second) {
+                                entry.original = inserted.first->second;
+                            }
+                            entries.push_back(entry);
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return entries;
+}
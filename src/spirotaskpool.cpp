@@ -0,0 +1,137 @@
+#include "spirotaskpool.h"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+
+struct SpiroTaskPool::Batch
+{
+    const std::function<void(std::size_t)>* task;
+    std::size_t count;
+    std::atomic<std::size_t> next;
+    std::atomic<std::size_t> finished;
+
+    std::mutex doneMutex;
+    std::condition_variable doneCondition;
+    std::exception_ptr error;
+
+    Batch(const std::function<void(std::size_t)>* task, std::size_t count)
+        : task(task), count(count), next(0), finished(0) {}
+};
+
+SpiroTaskPool::SpiroTaskPool(unsigned workerCount)
+    : m_stopping(false)
+{
+    if (workerCount == 0) {
+        unsigned hardware = std::thread::hardware_concurrency();
+        workerCount = hardware > 1 ? hardware - 1 : 0;
+    }
+
+    m_workers.reserve(workerCount);
+    for (unsigned i = 0; i < workerCount; ++i) {
+        m_workers.emplace_back(&SpiroTaskPool::workerLoop, this);
+    }
+}
+
+SpiroTaskPool::~SpiroTaskPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+    for (auto& worker : m_workers) {
+        worker.join();
+    }
+}
+
+SpiroTaskPool& SpiroTaskPool::instance()
+{
+    static SpiroTaskPool pool;
+    return pool;
+}
+
+void SpiroTaskPool::runBatch(Batch& batch)
+{
+    for (;;) {
+        std::size_t index = batch.next.fetch_add(1);
+        if (index >= batch.count) {
+            return;
+        }
+
+        try {
+            (*batch.task)(index);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(batch.doneMutex);
+            if (!batch.error) {
+                batch.error = std::current_exception();
+            }
+        }
+
+        if (batch.finished.fetch_add(1) + 1 == batch.count) {
+            std::lock_guard<std::mutex> lock(batch.doneMutex);
+            batch.doneCondition.notify_all();
+        }
+    }
+}
+
+void SpiroTaskPool::workerLoop()
+{
+    for (;;) {
+        std::shared_ptr<Batch> batch;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [this]() { return m_stopping || !m_queue.empty(); });
+            if (m_queue.empty()) {
+                return;
+            }
+            batch = m_queue.front();
+        }
+
+        runBatch(*batch);
+
+        // Every index has been claimed; retire the batch so idle workers
+        // move on to the next one
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_queue.empty() && m_queue.front() == batch) {
+            m_queue.pop_front();
+        }
+    }
+}
+
+void SpiroTaskPool::parallelFor(std::size_t count, const std::function<void(std::size_t)>& task)
+{
+    if (count == 0) {
+        return;
+    }
+    if (count == 1 || m_workers.empty()) {
+        for (std::size_t i = 0; i < count; ++i) {
+            task(i);
+        }
+        return;
+    }
+
+    auto batch = std::make_shared<Batch>(&task, count);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queue.push_back(batch);
+    }
+    m_wake.notify_all();
+
+    runBatch(*batch);
+
+    {
+        std::unique_lock<std::mutex> lock(batch->doneMutex);
+        batch->doneCondition.wait(lock, [&batch]() { return batch->finished.load() == batch->count; });
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = std::find(m_queue.begin(), m_queue.end(), batch);
+        if (it != m_queue.end()) {
+            m_queue.erase(it);
+        }
+    }
+
+    if (batch->error) {
+        std::rethrow_exception(batch->error);
+    }
+}
@@ -0,0 +1,190 @@
+#include "spirotravel.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace {
+
+// 2-opt looks at most this many strokes ahead, and gives up after this many
+// passes; both only matter for patterns with thousands of strokes
+const std::size_t twoOptWindow = 250;
+const int maxTwoOptPasses = 20;
+
+struct StrokeEnds
+{
+    double startX;
+    double startY;
+    double endX;
+    double endY;
+};
+
+class Tour
+{
+public:
+    Tour(const std::vector<StrokeEnds>& ends, double startX, double startY)
+        : m_ends(ends), m_startX(startX), m_startY(startY) {}
+
+    std::vector<std::size_t> order;
+    std::vector<char> reversed;
+
+    // Where the pen goes down for, and comes up after, tour position k
+    double entryX(std::size_t k) const { const StrokeEnds& e = m_ends[order[k]]; return reversed[k] ? e.endX : e.startX; }
+    double entryY(std::size_t k) const { const StrokeEnds& e = m_ends[order[k]]; return reversed[k] ? e.endY : e.startY; }
+    double exitX(std::size_t k) const { const StrokeEnds& e = m_ends[order[k]]; return reversed[k] ? e.startX : e.endX; }
+    double exitY(std::size_t k) const { const StrokeEnds& e = m_ends[order[k]]; return reversed[k] ? e.startY : e.endY; }
+
+    double previousExitX(std::size_t k) const { return k == 0 ? m_startX : exitX(k - 1); }
+    double previousExitY(std::size_t k) const { return k == 0 ? m_startY : exitY(k - 1); }
+
+    double length() const
+    {
+        double total = 0.0;
+        for (std::size_t k = 0; k < order.size(); ++k) {
+            total += std::hypot(entryX(k) - previousExitX(k), entryY(k) - previousExitY(k));
+        }
+        return total;
+    }
+
+    void buildNearestNeighbour();
+    void improveTwoOpt();
+
+private:
+    const std::vector<StrokeEnds>& m_ends;
+    double m_startX;
+    double m_startY;
+};
+
+void Tour::buildNearestNeighbour()
+{
+    const std::size_t count = m_ends.size();
+    std::vector<char> used(count, 0);
+    order.clear();
+    reversed.clear();
+
+    double x = m_startX, y = m_startY;
+    for (std::size_t step = 0; step < count; ++step) {
+        std::size_t best = count;
+        bool bestReversed = false;
+        double bestDistance = 0.0;
+        for (std::size_t i = 0; i < count; ++i) {
+            if (used[i]) {
+                continue;
+            }
+            const StrokeEnds& e = m_ends[i];
+            double forward = (e.startX - x) * (e.startX - x) + (e.startY - y) * (e.startY - y);
+            double backward = (e.endX - x) * (e.endX - x) + (e.endY - y) * (e.endY - y);
+            if (best == count || std::min(forward, backward) < bestDistance) {
+                best = i;
+                bestReversed = backward < forward;
+                bestDistance = std::min(forward, backward);
+            }
+        }
+
+        used[best] = 1;
+        order.push_back(best);
+        reversed.push_back(bestReversed ? 1 : 0);
+        x = bestReversed ? m_ends[best].startX : m_ends[best].endX;
+        y = bestReversed ? m_ends[best].startY : m_ends[best].endY;
+    }
+}
+
+void Tour::improveTwoOpt()
+{
+    const std::size_t count = order.size();
+    for (int pass = 0; pass < maxTwoOptPasses; ++pass) {
+        bool improved = false;
+        for (std::size_t k = 0; k < count; ++k) {
+            std::size_t lastM = std::min(count - 1, k + twoOptWindow);
+            for (std::size_t m = k; m <= lastM; ++m) {
+                // Reversing positions k..m makes the block enter at the old
+                // exit of m and leave at the old entry of k. With k == m
+                // this just flips one stroke.
+                double px = previousExitX(k), py = previousExitY(k);
+                double before = std::hypot(entryX(k) - px, entryY(k) - py);
+                double after = std::hypot(exitX(m) - px, exitY(m) - py);
+                if (m + 1 < count) {
+                    before += std::hypot(entryX(m + 1) - exitX(m), entryY(m + 1) - exitY(m));
+                    after += std::hypot(entryX(m + 1) - entryX(k), entryY(m + 1) - entryY(k));
+                }
+
+                if (after < before - 1e-9) {
+                    std::reverse(order.begin() + k, order.begin() + m + 1);
+                    std::reverse(reversed.begin() + k, reversed.begin() + m + 1);
+                    for (std::size_t i = k; i <= m; ++i) {
+                        reversed[i] = !reversed[i];
+                    }
+                    improved = true;
+                }
+            }
+        }
+        if (!improved) {
+            break;
+        }
+    }
+}
+
+} // namespace
+
+double penUpTravel(const SpiroPathBuffer& path, double startX, double startY)
+{
+    const float *x = path.x();
+    const float *y = path.y();
+    double travel = 0.0;
+    double penX = startX, penY = startY;
+    for (std::size_t stroke = 0; stroke < path.strokeCount(); ++stroke) {
+        std::size_t begin = path.strokeBegin(stroke);
+        std::size_t end = path.strokeEnd(stroke);
+        if (begin == end) {
+            continue;
+        }
+        travel += std::hypot(x[begin] - penX, y[begin] - penY);
+        penX = x[end - 1];
+        penY = y[end - 1];
+    }
+    return travel;
+}
+
+SpiroTravelReport optimizeStrokeOrder(const SpiroPathBuffer& path, double startX, double startY,
+                                      SpiroPathBuffer& ordered)
+{
+    SpiroTravelReport report;
+    report.before = penUpTravel(path, startX, startY);
+    report.after = report.before;
+
+    const float *x = path.x();
+    const float *y = path.y();
+    std::vector<StrokeEnds> ends;
+    std::vector<std::size_t> strokes;
+    for (std::size_t stroke = 0; stroke < path.strokeCount(); ++stroke) {
+        std::size_t begin = path.strokeBegin(stroke);
+        std::size_t end = path.strokeEnd(stroke);
+        if (begin == end) {
+            continue;
+        }
+        StrokeEnds e = { x[begin], y[begin], x[end - 1], y[end - 1] };
+        ends.push_back(e);
+        strokes.push_back(stroke);
+    }
+
+    Tour tour(ends, startX, startY);
+    double optimized = report.before;
+    if (ends.size() > 1) {
+        tour.buildNearestNeighbour();
+        tour.improveTwoOpt();
+        optimized = tour.length();
+    }
+
+    ordered.clear();
+    ordered.reserve(path.size());
+    if (optimized < report.before) {
+        for (std::size_t k = 0; k < tour.order.size(); ++k) {
+            ordered.appendStroke(path, strokes[tour.order[k]], tour.reversed[k] != 0);
+        }
+        report.after = optimized;
+    } else {
+        for (std::size_t stroke : strokes) {
+            ordered.appendStroke(path, stroke);
+        }
+    }
+    return report;
+}
@@ -0,0 +1,250 @@
+#include "sweeprenderer.h"
+#include "patternexporter.h"
+#include "spirocache.h"
+#include "spirotaskpool.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QPainter>
+#include <QTextStream>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Space under each thumbnail for its parameters
+const int captionHeight = 16;
+// Blank border around the curve inside its thumbnail
+const int thumbnailMargin = 4;
+
+bool fail(QString *error, const QString &message)
+{
+    if (error) {
+        *error = message;
+    }
+    return false;
+}
+
+bool readRange(const QJsonObject &json, const QString &key, SpiroSweepRange &range, QString *error)
+{
+    QJsonValue value = json[key];
+    if (value.isUndefined()) {
+        return true;
+    }
+    if (value.isDouble()) {
+        range = SpiroSweepRange(value.toDouble());
+        return true;
+    }
+    QJsonArray array = value.toArray();
+    if (value.isArray() && (array.size() == 2 || array.size() == 3)) {
+        range = SpiroSweepRange(array[0].toDouble(), array[1].toDouble(), array.size() == 3 ? array[2].toDouble() : 1.0);
+        return true;
+    }
+    return fail(error, QString("%1 must be a number or [first, last, step]").arg(key));
+}
+
+QString caption(const SpiroParameters &params)
+{
+    QString text = QString("R%1 r%2 d%3").arg(params.outerRadius).arg(params.innerRadius).arg(params.penOffset);
+    if (params.numPens > 1) {
+        text += QString(" x%1").arg(params.numPens);
+    }
+    return text;
+}
+
+} // namespace
+
+SweepRenderer::Settings::Settings()
+{
+    sampling.chordTolerance = 0.25;
+}
+
+bool SweepRenderer::loadSettings(const QString &path, Settings &settings, QString *error)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return fail(error, QString("cannot open %1: %2").arg(path, file.errorString()));
+    }
+
+    QJsonParseError parseError;
+    QJsonDocument document = QJsonDocument::fromJson(file.readAll(), &parseError);
+    if (!document.isObject()) {
+        return fail(error, QString("%1: %2").arg(path, document.isNull() ? parseError.errorString() : "not an object"));
+    }
+    QJsonObject json = document.object();
+
+    QString message;
+    SpiroSweep &sweep = settings.sweep;
+    if (json["rotations"].toString() == "close") {
+        sweep.closeLoops = true;
+    } else if (!readRange(json, "rotations", sweep.rotations, &message)) {
+        return fail(error, QString("%1: %2").arg(path, message));
+    }
+    if (!readRange(json, "outerRadius", sweep.outerRadius, &message)
+        || !readRange(json, "innerRadius", sweep.innerRadius, &message)
+        || !readRange(json, "penOffset", sweep.penOffset, &message)
+        || !readRange(json, "numPens", sweep.numPens, &message)
+        || !readRange(json, "rotationOffset", sweep.rotationOffset, &message)) {
+        return fail(error, QString("%1: %2").arg(path, message));
+    }
+
+    settings.lineThickness = json["lineThickness"].toDouble(settings.lineThickness);
+    if (json.contains("adaptive")) {
+        settings.sampling.mode = json["adaptive"].toBool() ? SpiroSampling::Mode::Adaptive
+                                                           : SpiroSampling::Mode::FixedStep;
+    }
+    settings.sampling.chordTolerance = json["chordTolerance"].toDouble(settings.sampling.chordTolerance);
+    settings.sampling.stepSize = json["stepSize"].toDouble(settings.sampling.stepSize);
+    settings.thumbnailSize = json["thumbnailSize"].toInt(settings.thumbnailSize);
+    settings.columns = json["columns"].toInt(settings.columns);
+    settings.rows = json["rows"].toInt(settings.rows);
+
+    QDir baseDir = QFileInfo(path).absoluteDir();
+    settings.outputDirectory = baseDir.absoluteFilePath(json["output"].toString(QFileInfo(path).completeBaseName()));
+
+    if (settings.thumbnailSize < 2 * thumbnailMargin + 8 || settings.columns < 1 || settings.rows < 1) {
+        return fail(error, QString("%1: thumbnailSize, columns or rows out of range").arg(path));
+    }
+    if (settings.sampling.chordTolerance <= 0.0 || settings.sampling.stepSize <= 0.0) {
+        return fail(error, QString("%1: chordTolerance and stepSize must be positive").arg(path));
+    }
+    return true;
+}
+
+SweepRenderer::SweepRenderer(const Settings &settings)
+    : m_settings(settings), m_entries(expandSweep(settings.sweep)), m_renderedCount(0)
+{
+}
+
+void SweepRenderer::setProgressCallback(std::function<void(int, int)> callback)
+{
+    m_progressCallback = std::move(callback);
+}
+
+QImage SweepRenderer::renderThumbnail(const SpiroParameters &parameters) const
+{
+    const int size = m_settings.thumbnailSize;
+
+    // The pen never gets further from the centre than this, so the curve can
+    // be sized, and sampled at the thumbnail's resolution, before generating
+    double extent = std::abs(parameters.outerRadius - parameters.innerRadius) + std::abs(parameters.penOffset);
+    double scale = extent > 0.0 ? (size / 2.0 - thumbnailMargin) / extent : 1.0;
+
+    SpiroSampling sampling = m_settings.sampling;
+    sampling.millimetresPerUnit = scale;
+    SpiroGenerator generator(parameters, sampling);
+    std::shared_ptr<const SpiroGeometry> geometry =
+        SpiroGeometryCache::instance().generate(generator, parameters.rotations);
+    const std::vector<SpiroPolyline> &polylines = *geometry;
+
+    QImage image(size, size, QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::white);
+
+    QPainter painter(&image);
+    painter.setRenderHint(QPainter::Antialiasing, true);
+    painter.translate(size / 2.0, size / 2.0);
+    painter.scale(scale, scale);
+
+    QVector<QColor> colors = PatternExporter::penColors(static_cast<int>(polylines.size()));
+    for (std::size_t pen = 0; pen < polylines.size(); ++pen) {
+        SpiroPathBuffer path;
+        path.appendStroke(polylines[pen]);
+        painter.setPen(QPen(colors.value(static_cast<int>(pen), Qt::black), m_settings.lineThickness / scale));
+        painter.drawPath(PatternExporter::toPainterPath(path));
+    }
+    painter.end();
+    return image;
+}
+
+bool SweepRenderer::run(QString *error)
+{
+    if (!QDir().mkpath(m_settings.outputDirectory)) {
+        return fail(error, QString("cannot create %1").arg(m_settings.outputDirectory));
+    }
+    QDir outputDir(m_settings.outputDirectory);
+
+    // Only the first entry of each distinct curve gets a cell
+    std::vector<std::size_t> rendered;
+    std::vector<int> cellOf(m_entries.size(), -1);
+    for (std::size_t i = 0; i < m_entries.size(); ++i) {
+        if (m_entries[i].original == i) {
+            cellOf[i] = static_cast<int>(rendered.size());
+            rendered.push_back(i);
+        }
+    }
+
+    const int size = m_settings.thumbnailSize;
+    const int columns = m_settings.columns;
+    const int cellsPerSheet = columns * m_settings.rows;
+    const int total = static_cast<int>(rendered.size());
+    m_renderedCount = 0;
+
+    // One sheet at a time keeps at most a sheet's worth of thumbnails in memory
+    for (int first = 0; first < total; first += cellsPerSheet) {
+        int count = std::min(cellsPerSheet, total - first);
+        std::vector<QImage> thumbnails(count);
+        SpiroTaskPool::instance().parallelFor(count, [&](std::size_t cell) {
+            thumbnails[cell] = renderThumbnail(m_entries[rendered[first + cell]].parameters);
+        });
+
+        int rowsUsed = (count + columns - 1) / columns;
+        QImage sheet(std::min(count, columns) * size, rowsUsed * (size + captionHeight), QImage::Format_ARGB32_Premultiplied);
+        sheet.fill(Qt::white);
+
+        QPainter painter(&sheet);
+        QFont font = painter.font();
+        font.setPixelSize(captionHeight - 5);
+        painter.setFont(font);
+        painter.setPen(Qt::darkGray);
+        for (int cell = 0; cell < count; ++cell) {
+            int x = (cell % columns) * size;
+            int y = (cell / columns) * (size + captionHeight);
+            painter.drawImage(x, y, thumbnails[cell]);
+            QRect captionRect(x, y + size, size, captionHeight);
+            painter.drawText(captionRect, Qt::AlignCenter,
+                             QString("#%1  %2").arg(rendered[first + cell] + 1).arg(caption(m_entries[rendered[first + cell]].parameters)));
+        }
+        painter.end();
+
+        QString sheetName = QString("sheet_%1.png").arg(first / cellsPerSheet + 1, 3, 10, QChar('0'));
+        if (!sheet.save(outputDir.filePath(sheetName), "PNG")) {
+            return fail(error, QString("failed to write %1").arg(outputDir.filePath(sheetName)));
+        }
+
+        m_renderedCount += count;
+        if (m_progressCallback) {
+            m_progressCallback(m_renderedCount, total);
+        }
+    }
+
+    // Every entry, duplicates included, with the cell that shows its curve
+    QFile indexFile(outputDir.filePath("index.csv"));
+    if (!indexFile.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        return fail(error, QString("cannot write %1").arg(indexFile.fileName()));
+    }
+    QTextStream index(&indexFile);
+    index << "id,sheet,row,column,outerRadius,innerRadius,penOffset,rotations,numPens,rotationOffset,sameAs\n";
+    for (std::size_t i = 0; i < m_entries.size(); ++i) {
+        const SpiroSweepEntry &entry = m_entries[i];
+        const SpiroParameters &params = entry.parameters;
+        int cell = cellOf[entry.original];
+        index << i + 1 << ','
+              << QString("sheet_%1.png").arg(cell / cellsPerSheet + 1, 3, 10, QChar('0')) << ','
+              << (cell % cellsPerSheet) / columns + 1 << ','
+              << cell % columns + 1 << ','
+              << params.outerRadius << ',' << params.innerRadius << ',' << params.penOffset << ','
+              << params.rotations << ',' << params.numPens << ',' << params.rotationOffset << ',';
+        if (entry.original != i) {
+            index << entry.original + 1;
+        }
+        index << '\n';
+    }
+    index.flush();
+    if (indexFile.error() != QFileDevice::NoError) {
+        return fail(error, QString("failed to write %1").arg(indexFile.fileName()));
+    }
+    return true;
+}